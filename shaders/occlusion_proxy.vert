@@ -0,0 +1,61 @@
+#version 450
+
+// bounding box of one instance for its occlusion query, see
+// OcclusionQueries in occlusion_queries.hpp. Drawn with 36 vertices and
+// firstInstance = the object, without a fragment shader
+
+// per instance, see InstanceData in instancing.hpp
+layout(location = 3) in vec4 inInstanceRow0;  // upper three rows of the
+layout(location = 4) in vec4 inInstanceRow1;  // instance transform
+layout(location = 5) in vec4 inInstanceRow2;
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 viewProj;
+    vec4 positionScale;
+    vec4 positionOffset;
+} ubo;
+
+// the model transform the object's draws pushed, see DrawConstants
+layout(push_constant) uniform DrawConstants {
+    mat4 model;
+} draw;
+
+// corners of the 12 triangles, bit 0 x, bit 1 y, bit 2 z
+const int CORNERS[36] = int[](
+    0, 2, 1, 1, 2, 3,  // z = 0
+    4, 5, 6, 5, 7, 6,  // z = 1
+    0, 1, 4, 1, 5, 4,  // y = 0
+    2, 6, 3, 3, 6, 7,  // y = 1
+    0, 4, 2, 2, 4, 6,  // x = 0
+    1, 3, 5, 3, 7, 5   // x = 1
+);
+
+// clip position of a corner of the mesh bounds (the quantization box)
+vec4 cornerPosition(int corner)
+{
+    vec3 unit = vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+    vec4 meshPosition =
+        vec4(unit * ubo.positionScale.xyz + ubo.positionOffset.xyz, 1.0);
+    vec3 position = vec3(dot(inInstanceRow0, meshPosition),
+                         dot(inInstanceRow1, meshPosition),
+                         dot(inInstanceRow2, meshPosition));
+    return ubo.viewProj * (draw.model * vec4(position, 1.0));
+}
+
+void main()
+{
+    int corner = CORNERS[gl_VertexIndex];
+    gl_Position = cornerPosition(corner);
+
+    // * a box reaching in front of the near plane gets clipped and may
+    // * only show faces the object hides, it covers the screen at the
+    // * nearest depth instead so the query always passes
+    bool nearClipped = false;
+    for (int i = 0; i < 8; i++) {
+        nearClipped = nearClipped || cornerPosition(i).z < 0.0;
+    }
+    if (nearClipped) {
+        gl_Position = vec4(vec2(corner & 1, (corner >> 1) & 1) * 2.0 - 1.0,
+                           0.0, 1.0);
+    }
+}
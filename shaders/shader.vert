@@ -1,30 +1,66 @@
 #version 460
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec3 inColor;
-layout(location = 3) in vec2 inTexCoord;
+// quantized vertex, see Vertex in main_simple.cpp
+layout(location = 0) in vec4 inPosition;  // unorm16 inside the mesh bounds
+layout(location = 1) in vec2 inNormal;    // octahedral, snorm16
+layout(location = 2) in vec2 inTexCoord;  // half float
+
+// per instance, see InstanceData in instancing.hpp
+layout(location = 3) in vec4 inInstanceRow0;  // upper three rows of the
+layout(location = 4) in vec4 inInstanceRow1;  // instance transform
+layout(location = 5) in vec4 inInstanceRow2;
+layout(location = 6) in vec4 inInstanceTint;  // rgba8 unorm
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
+// per view, see UniformBufferObject in main_simple.cpp
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
+    mat4 viewProj;  // proj * view, combined on the host
+    vec4 positionScale;
+    vec4 positionOffset;
 } ubo;
 
+// per draw, see DrawConstants in main_simple.cpp
+layout(push_constant) uniform DrawConstants {
+    mat4 model;
+    mat3 normalMatrix;  // transpose(inverse(model)), from the host
+    uint material;  // read by shader_bindless.frag
+} draw;
+
+// point light, specialization constants set in createGraphicsPipeline
+layout(constant_id = 0) const float LIGHT_POSITION_X = 0.0;
+layout(constant_id = 1) const float LIGHT_POSITION_Y = 0.0;
+layout(constant_id = 2) const float LIGHT_POSITION_Z = 10.0;
+layout(constant_id = 3) const float LIGHT_COLOR_R = 1.0;
+layout(constant_id = 4) const float LIGHT_COLOR_G = 0.95;
+layout(constant_id = 5) const float LIGHT_COLOR_B = 0.8;
+layout(constant_id = 6) const float LIGHT_INTENSITY = 50.0;
+
+vec3 decodeOctahedral(vec2 e){
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main(){
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    vec4 meshPosition = vec4(inPosition.xyz * ubo.positionScale.xyz + ubo.positionOffset.xyz, 1.0);
+    vec3 position = vec3(dot(inInstanceRow0, meshPosition),
+                         dot(inInstanceRow1, meshPosition),
+                         dot(inInstanceRow2, meshPosition));
+
+    vec4 worldPosition = draw.model * vec4(position, 1.0);
+    gl_Position = ubo.viewProj * worldPosition;
     fragTexCoord = inTexCoord;
     
     
-    vec3 lightPos = vec3(0.0, 0.0, 10.0);  // world-space position of point light
-    vec3 lightColor = vec3(1.0, 0.95, 0.8);  // slightly warm light
-    float lightIntensity = 50.0;  // brightness scale
+    vec3 lightPos = vec3(LIGHT_POSITION_X, LIGHT_POSITION_Y, LIGHT_POSITION_Z);  // world-space position of point light
+    vec3 lightColor = vec3(LIGHT_COLOR_R, LIGHT_COLOR_G, LIGHT_COLOR_B);
+    float lightIntensity = LIGHT_INTENSITY;  // brightness scale
 
-    vec3 fragPos = inPosition;  // your fragment world position
-    vec3 normal = normalize(inNormal);
+    vec3 fragPos = worldPosition.xyz;  // your fragment world position
+    vec3 normal = normalize(draw.normalMatrix * decodeOctahedral(inNormal));
 
     // Direction from fragment to light
     vec3 L = lightPos - fragPos;
@@ -38,5 +74,6 @@ void main(){
     float NdotL = max(dot(normal, L), 0.0);
     vec3 diffuse = attenuation * lightColor * NdotL;
     
-    fragColor = inColor;
+    // the per-vertex color used to be constant white
+    fragColor = inInstanceTint.rgb;
 }
\ No newline at end of file
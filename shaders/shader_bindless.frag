@@ -0,0 +1,22 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+
+// shader.frag with the texture taken from the global array, see
+// BindlessTextures in bindless_textures.hpp
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// the draw's material id, after the model and normal matrices in
+// DrawConstants (main_simple.cpp)
+layout(push_constant) uniform DrawConstants {
+    layout(offset = 112) uint material;
+} draw;
+
+void main(){
+    vec3 texel = texture(textures[draw.material], fragTexCoord).rgb;
+    outColor = vec4(fragColor * texel, 1.0);
+}
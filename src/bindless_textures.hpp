@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vulkan/vulkan.h>
+
+/*
+	One global array of combined image samplers that every draw indexes
+	with its material id, instead of a descriptor set per texture that has
+	to be bound in front of the draws using it.
+
+	The array is a single binding of a single set, created with the
+	VK_EXT_descriptor_indexing binding flags
+		update after bind	add() writes a new texture into a set that
+							command buffers already bound, even while they
+							are pending (update unused while pending), so
+							a texture loaded later needs no new set and no
+							re-recording for the draws not using it
+		partially bound		slots nobody added a texture to stay unwritten
+		variable count		the layout only states the upper bound, the
+							set is allocated with capacity slots
+	The set is bound once per command buffer as set 1, next to the per
+	frame set; a draw only pushes its material id (a push constant the
+	fragment shader indexes the array with, see shader_bindless.frag).
+	Textures are never removed, their views and samplers must outlive the
+	array.
+*/
+
+class BindlessTextures {
+  public:
+	// * capacity is clamped by the caller to the device's update after
+	// * bind sampled image limits
+	void create(VkDevice device, uint32_t capacity) {
+		this->device = device;
+		this->textureCapacity = capacity;
+
+		VkDescriptorSetLayoutBinding binding{};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = capacity;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorBindingFlags bindingFlags =
+			VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+			VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+		VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+		bindingFlagsInfo.sType =
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		bindingFlagsInfo.bindingCount = 1;
+		bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.pNext = &bindingFlagsInfo;
+		layoutInfo.flags =
+			VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		layoutInfo.bindingCount = 1;
+		layoutInfo.pBindings = &binding;
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
+										&layout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture array layout!");
+		}
+
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSize.descriptorCount = capacity;
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		poolInfo.maxSets = 1;
+		if (vkCreateDescriptorPool(device, &poolInfo, nullptr,
+								   &descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture array pool!");
+		}
+
+		VkDescriptorSetVariableDescriptorCountAllocateInfo countInfo{};
+		countInfo.sType =
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+		countInfo.descriptorSetCount = 1;
+		countInfo.pDescriptorCounts = &capacity;
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.pNext = &countInfo;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+		if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate texture array!");
+		}
+	}
+
+	// the device must be idle
+	void destroy() {
+		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(device, layout, nullptr);
+		textureCount = 0;
+	}
+
+	// * writes the texture into the next free slot and returns it, the
+	// * material id of the draws sampling it
+	uint32_t add(VkImageView imageView, VkSampler sampler) {
+		if (textureCount == textureCapacity) {
+			throw std::runtime_error("texture array is full!");
+		}
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = imageView;
+		imageInfo.sampler = sampler;
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptorSet;
+		write.dstBinding = 0;
+		write.dstArrayElement = textureCount;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.descriptorCount = 1;
+		write.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+		return textureCount++;
+	}
+
+	VkDescriptorSetLayout setLayout() const { return layout; }
+	VkDescriptorSet set() const { return descriptorSet; }
+	uint32_t count() const { return textureCount; }
+	uint32_t capacity() const { return textureCapacity; }
+
+  private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	uint32_t textureCapacity = 0;
+	uint32_t textureCount = 0;
+};
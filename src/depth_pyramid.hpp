@@ -0,0 +1,415 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "device_allocator.hpp"
+#include "upload_batch.hpp"
+
+/*
+	Hierarchical depth (Hi-Z) pyramid of the depth attachment, for
+	occlusion culling in a compute shader.
+
+	Level 0 is the depth attachment rounded down to a power of two on each
+	side, every further level halves it until 1x1. A texel stores the
+	largest (farthest, the depth test is VK_COMPARE_OP_LESS) depth of the
+	area it covers, so a bounding sphere whose nearest depth lies behind
+	every texel under its screen rectangle is hidden. The culling shader
+	picks the level where that rectangle spans at most 2x2 texels.
+
+	record() builds it after the depth was written: the attachment goes to
+	SHADER_READ_ONLY_OPTIMAL, depth_reduce.comp reduces it into level 0
+	and every level into the next, then the attachment goes back to
+	DEPTH_STENCIL_ATTACHMENT_OPTIMAL for the passes that follow. The
+	pyramid itself always stays in VK_IMAGE_LAYOUT_GENERAL; it is cleared
+	to the far plane on creation, so it hides nothing until first built.
+
+	There is one pyramid for all frames in flight, like the depth
+	attachment it is built from: submissions on the queue execute in
+	order and the barriers in record() cover the previous frame's reads.
+*/
+
+const uint32_t DEPTH_PYRAMID_WORKGROUP_SIZE = 8;
+
+// push constants of depth_reduce.comp
+struct DepthReduceSizes {
+	int32_t sourceSize[2];
+	int32_t destinationSize[2];
+};
+
+class DepthPyramid {
+  public:
+	void create(VkDevice device, DeviceAllocator &allocator) {
+		this->device = device;
+		this->allocator = &allocator;
+
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
+										&setLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth reduce layout!");
+		}
+
+		VkPushConstantRange pushConstant{};
+		pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstant.size = sizeof(DepthReduceSizes);
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &setLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+								   &layout) != VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to create depth reduce pipeline layout!");
+		}
+
+		// * texelFetch only, the sampler never filters
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		if (vkCreateSampler(device, &samplerInfo, nullptr, &pyramidSampler) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid sampler!");
+		}
+	}
+
+	// the device must be idle
+	void destroy() {
+		destroyImage();
+		vkDestroySampler(device, pyramidSampler, nullptr);
+		vkDestroyPipelineLayout(device, layout, nullptr);
+		vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+	}
+
+	// * (re)creates the pyramid for a depth attachment of extent and
+	// * records its clear. depthImage must be in
+	// * DEPTH_STENCIL_ATTACHMENT_OPTIMAL between frames and have
+	// * VK_IMAGE_USAGE_SAMPLED_BIT, depthView is a depth aspect only view.
+	// * Without a depthView the pyramid is never built and only stands in
+	// * for a culling shader that binds it with occlusion culling off. No
+	// * frame in flight may still use the pyramid
+	void resize(UploadBatch &uploads, VkExtent2D extent, VkImage depthImage,
+				VkImageView depthView, VkImageAspectFlags depthAspect) {
+		destroyImage();
+		this->depthImage = depthImage;
+		this->depthAspect = depthAspect;
+		depthExtent = extent;
+		levelWidth = previousPowerOfTwo(extent.width);
+		levelHeight = previousPowerOfTwo(extent.height);
+		levels = 1;
+		while ((levelWidth >> levels) != 0 || (levelHeight >> levels) != 0) {
+			levels++;
+		}
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent = {levelWidth, levelHeight, 1};
+		imageInfo.mipLevels = levels;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT |
+						  VK_IMAGE_USAGE_SAMPLED_BIT |
+						  VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid!");
+		}
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(device, image, &memRequirements);
+		imageMemory = allocator->allocate(
+			memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			DeviceResourceKind::Image, DeviceMemoryCategory::RenderTarget);
+		vkBindImageMemory(device, image, imageMemory.memory,
+						  imageMemory.offset);
+
+		// * the whole chain for the culling shader, one view per level for
+		// * the reduction
+		allView = createView(0, levels);
+		levelViews.resize(levels);
+		for (uint32_t level = 0; level < levels; level++) {
+			levelViews[level] = createView(level, 1);
+		}
+
+		if (depthView != VK_NULL_HANDLE) {
+			createReduceSets(depthView);
+		}
+
+		VkImageMemoryBarrier barrier = pyramidBarrier(0, levels);
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		uploads.imageBarrier(barrier, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		VkClearColorValue farPlane{};
+		farPlane.float32[0] = 1.0f;
+		VkImageSubresourceRange range = barrier.subresourceRange;
+		vkCmdClearColorImage(uploads.record(), image, VK_IMAGE_LAYOUT_GENERAL,
+							 &farPlane, 1, &range);
+
+		barrier = pyramidBarrier(0, levels);
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		uploads.imageBarrier(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
+
+	VkPipelineLayout pipelineLayout() const { return layout; }
+	// every level, VK_IMAGE_LAYOUT_GENERAL
+	VkImageView view() const { return allView; }
+	VkSampler sampler() const { return pyramidSampler; }
+	uint32_t width() const { return levelWidth; }
+	uint32_t height() const { return levelHeight; }
+	uint32_t levelCount() const { return levels; }
+
+	// * outside a render pass, after the depth attachment was written and
+	// * before anything reads the new pyramid
+	void record(VkCommandBuffer commandBuffer, VkPipeline pipeline) {
+		// * culling recorded earlier may still read the old pyramid
+		VkImageMemoryBarrier depthBarrier = attachmentBarrier();
+		depthBarrier.oldLayout =
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		depthBarrier.srcAccessMask =
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+							 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+								 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+							 nullptr, 0, nullptr, 1, &depthBarrier);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+						  pipeline);
+		for (uint32_t level = 0; level < levels; level++) {
+			uint32_t width = levelSize(levelWidth, level);
+			uint32_t height = levelSize(levelHeight, level);
+			VkExtent2D source = depthExtent;
+			if (level > 0) {
+				source = {levelSize(levelWidth, level - 1),
+						  levelSize(levelHeight, level - 1)};
+			}
+			DepthReduceSizes sizes{};
+			sizes.sourceSize[0] = static_cast<int32_t>(source.width);
+			sizes.sourceSize[1] = static_cast<int32_t>(source.height);
+			sizes.destinationSize[0] = static_cast<int32_t>(width);
+			sizes.destinationSize[1] = static_cast<int32_t>(height);
+
+			vkCmdBindDescriptorSets(commandBuffer,
+									VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0,
+									1, &sets[level], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, layout,
+							   VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sizes),
+							   &sizes);
+			vkCmdDispatch(commandBuffer, groupCount(width),
+						  groupCount(height), 1);
+
+			// * the next level (or the culling shader) reads this one
+			VkImageMemoryBarrier levelBarrier = pyramidBarrier(level, 1);
+			levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer,
+								 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+								 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+								 nullptr, 0, nullptr, 1, &levelBarrier);
+		}
+
+		depthBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		depthBarrier.newLayout =
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthBarrier.srcAccessMask = 0;
+		depthBarrier.dstAccessMask =
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+							 VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+								 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+							 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+	}
+
+  private:
+	void createReduceSets(VkImageView depthView) {
+		std::array<VkDescriptorPoolSize, 2> poolSizes{};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[0].descriptorCount = levels;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		poolSizes[1].descriptorCount = levels;
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = levels;
+		if (vkCreateDescriptorPool(device, &poolInfo, nullptr,
+								   &descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to create depth reduce descriptor pool!");
+		}
+
+		std::vector<VkDescriptorSetLayout> layouts(levels, setLayout);
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = levels;
+		allocInfo.pSetLayouts = layouts.data();
+		sets.resize(levels);
+		if (vkAllocateDescriptorSets(device, &allocInfo, sets.data()) !=
+			VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to allocate depth reduce descriptors!");
+		}
+
+		for (uint32_t level = 0; level < levels; level++) {
+			VkDescriptorImageInfo sourceInfo{};
+			sourceInfo.sampler = pyramidSampler;
+			sourceInfo.imageView =
+				level == 0 ? depthView : levelViews[level - 1];
+			sourceInfo.imageLayout =
+				level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+						   : VK_IMAGE_LAYOUT_GENERAL;
+			VkDescriptorImageInfo destinationInfo{};
+			destinationInfo.imageView = levelViews[level];
+			destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			std::array<VkWriteDescriptorSet, 2> writes{};
+			for (uint32_t i = 0; i < writes.size(); i++) {
+				writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[i].dstSet = sets[level];
+				writes[i].dstBinding = i;
+				writes[i].descriptorCount = 1;
+			}
+			writes[0].descriptorType =
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[0].pImageInfo = &sourceInfo;
+			writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[1].pImageInfo = &destinationInfo;
+			vkUpdateDescriptorSets(device,
+								   static_cast<uint32_t>(writes.size()),
+								   writes.data(), 0, nullptr);
+		}
+	}
+
+	static uint32_t previousPowerOfTwo(uint32_t value) {
+		uint32_t power = 1;
+		while (power * 2 <= value) {
+			power *= 2;
+		}
+		return power;
+	}
+
+	static uint32_t levelSize(uint32_t size, uint32_t level) {
+		return std::max(size >> level, 1u);
+	}
+
+	static uint32_t groupCount(uint32_t size) {
+		return (size + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) /
+			   DEPTH_PYRAMID_WORKGROUP_SIZE;
+	}
+
+	VkImageView createView(uint32_t baseLevel, uint32_t levelCount) {
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, baseLevel,
+									 levelCount, 0, 1};
+		VkImageView view;
+		if (vkCreateImageView(device, &viewInfo, nullptr, &view) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid view!");
+		}
+		return view;
+	}
+
+	VkImageMemoryBarrier pyramidBarrier(uint32_t baseLevel,
+										uint32_t levelCount) const {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, baseLevel,
+									levelCount, 0, 1};
+		return barrier;
+	}
+
+	VkImageMemoryBarrier attachmentBarrier() const {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = depthImage;
+		barrier.subresourceRange = {depthAspect, 0, 1, 0, 1};
+		return barrier;
+	}
+
+	void destroyImage() {
+		if (image == VK_NULL_HANDLE) {
+			return;
+		}
+		if (descriptorPool != VK_NULL_HANDLE) {
+			vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+			descriptorPool = VK_NULL_HANDLE;
+		}
+		for (VkImageView view : levelViews) {
+			vkDestroyImageView(device, view, nullptr);
+		}
+		levelViews.clear();
+		vkDestroyImageView(device, allView, nullptr);
+		vkDestroyImage(device, image, nullptr);
+		allocator->free(imageMemory);
+		image = VK_NULL_HANDLE;
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	DeviceAllocator *allocator = nullptr;
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkSampler pyramidSampler = VK_NULL_HANDLE;
+
+	VkImage depthImage = VK_NULL_HANDLE;
+	VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	VkExtent2D depthExtent{};
+
+	VkImage image = VK_NULL_HANDLE;
+	DeviceAllocation imageMemory;
+	VkImageView allView = VK_NULL_HANDLE;
+	std::vector<VkImageView> levelViews;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	// [level], reads level - 1 (the depth attachment for 0), writes level
+	std::vector<VkDescriptorSet> sets;
+	uint32_t levelWidth = 0;
+	uint32_t levelHeight = 0;
+	uint32_t levels = 0;
+};
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/*
+	Descriptor sets without a pool sized up front for every set that will
+	ever exist.
+
+	DescriptorAllocator hands out sets from a list of pools. A pool is
+	sized for a number of sets, with perSet descriptors of every type per
+	set. When vkAllocateDescriptorSets fails with
+	VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL the next pool
+	takes over, twice as large as the last one up to
+	DESCRIPTOR_POOL_MAX_SETS. Sets are never freed one by one, reset()
+	returns all of them at once (vkResetDescriptorPool) and keeps the pools
+	for the next round, so an allocator used as
+		persistent	lives as long as its sets, destroy() frees them
+		transient	one per frame in flight, reset once the frame's fence
+					signaled and filled again while recording the frame
+	never creates a pool after the first few frames.
+
+	DescriptorUpdateTemplate writes every binding of a set from one
+	struct in a single call, vkUpdateDescriptorSetWithTemplateKHR reads
+	the descriptor infos straight out of it instead of going through a
+	VkWriteDescriptorSet per binding. Without
+	VK_KHR_descriptor_update_template the same entries are turned into
+	plain writes.
+*/
+
+// * the largest pool DescriptorAllocator grows to, later pools stay at
+// * this size
+const uint32_t DESCRIPTOR_POOL_MAX_SETS = 4096;
+
+struct DescriptorPoolRatio {
+	VkDescriptorType type;
+	// descriptors of this type per set
+	uint32_t perSet;
+};
+
+class DescriptorAllocator {
+  public:
+	void create(VkDevice device, const std::vector<DescriptorPoolRatio> &ratios,
+				uint32_t setsPerPool) {
+		this->device = device;
+		this->ratios = ratios;
+		this->nextPoolSets = setsPerPool;
+	}
+
+	// the device must be idle
+	void destroy() {
+		for (VkDescriptorPool pool : usedPools) {
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		}
+		for (VkDescriptorPool pool : freePools) {
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		}
+		usedPools.clear();
+		freePools.clear();
+	}
+
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout) {
+		if (usedPools.empty()) {
+			usedPools.push_back(takePool());
+		}
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = usedPools.back();
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+
+		VkDescriptorSet set;
+		VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+		if (result == VK_ERROR_OUT_OF_POOL_MEMORY ||
+			result == VK_ERROR_FRAGMENTED_POOL) {
+			// * the current pool is full, the set goes into the next one
+			usedPools.push_back(takePool());
+			allocInfo.descriptorPool = usedPools.back();
+			result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+		}
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate descriptor set!");
+		}
+		return set;
+	}
+
+	// * every set allocated so far, none of them may still be in use
+	void reset() {
+		for (VkDescriptorPool pool : usedPools) {
+			vkResetDescriptorPool(device, pool, 0);
+			freePools.push_back(pool);
+		}
+		usedPools.clear();
+	}
+
+	uint32_t poolCount() const {
+		return static_cast<uint32_t>(usedPools.size() + freePools.size());
+	}
+
+  private:
+	// a pool reset() gave back, or a new one grown from the last size
+	VkDescriptorPool takePool() {
+		if (!freePools.empty()) {
+			VkDescriptorPool pool = freePools.back();
+			freePools.pop_back();
+			return pool;
+		}
+		VkDescriptorPool pool = createPool(nextPoolSets);
+		nextPoolSets = std::min(2 * nextPoolSets, DESCRIPTOR_POOL_MAX_SETS);
+		return pool;
+	}
+
+	VkDescriptorPool createPool(uint32_t sets) {
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		for (const DescriptorPoolRatio &ratio : ratios) {
+			poolSizes.push_back({ratio.type, ratio.perSet * sets});
+		}
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = sets;
+
+		VkDescriptorPool pool;
+		if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create descriptor pool!");
+		}
+		return pool;
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<DescriptorPoolRatio> ratios;
+	uint32_t nextPoolSets = 0;
+	// the last one is the pool sets are allocated from
+	std::vector<VkDescriptorPool> usedPools;
+	std::vector<VkDescriptorPool> freePools;
+};
+
+class DescriptorUpdateTemplate {
+  public:
+	// * entries locate each binding's VkDescriptorBufferInfo or
+	// * VkDescriptorImageInfo in the struct update() is given, stride is
+	// * the size of that info. createTemplate, destroyTemplate and
+	// * updateWithTemplate are nullptr without
+	// * VK_KHR_descriptor_update_template
+	void create(VkDevice device, VkDescriptorSetLayout layout,
+				const std::vector<VkDescriptorUpdateTemplateEntry> &entries,
+				PFN_vkCreateDescriptorUpdateTemplateKHR createTemplate,
+				PFN_vkDestroyDescriptorUpdateTemplateKHR destroyTemplate,
+				PFN_vkUpdateDescriptorSetWithTemplateKHR updateWithTemplate) {
+		this->device = device;
+		this->entries = entries;
+		this->destroyTemplate = destroyTemplate;
+		this->updateWithTemplate = updateWithTemplate;
+		if (updateWithTemplate == nullptr) {
+			return;
+		}
+
+		VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+		templateInfo.sType =
+			VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		templateInfo.descriptorUpdateEntryCount =
+			static_cast<uint32_t>(entries.size());
+		templateInfo.pDescriptorUpdateEntries = entries.data();
+		templateInfo.templateType =
+			VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		templateInfo.descriptorSetLayout = layout;
+		if (createTemplate(device, &templateInfo, nullptr,
+						   &updateTemplate) != VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to create descriptor update template!");
+		}
+	}
+
+	void destroy() {
+		if (updateTemplate != VK_NULL_HANDLE) {
+			destroyTemplate(device, updateTemplate, nullptr);
+			updateTemplate = VK_NULL_HANDLE;
+		}
+	}
+
+	void update(VkDescriptorSet set, const void *data) const {
+		if (updateTemplate != VK_NULL_HANDLE) {
+			updateWithTemplate(device, set, updateTemplate, data);
+			return;
+		}
+		std::vector<VkWriteDescriptorSet> writes(entries.size());
+		for (size_t i = 0; i < entries.size(); i++) {
+			const VkDescriptorUpdateTemplateEntry &entry = entries[i];
+			const char *info = static_cast<const char *>(data) + entry.offset;
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = set;
+			writes[i].dstBinding = entry.dstBinding;
+			writes[i].dstArrayElement = entry.dstArrayElement;
+			writes[i].descriptorCount = entry.descriptorCount;
+			writes[i].descriptorType = entry.descriptorType;
+			if (bufferDescriptor(entry.descriptorType)) {
+				writes[i].pBufferInfo =
+					reinterpret_cast<const VkDescriptorBufferInfo *>(info);
+			} else {
+				writes[i].pImageInfo =
+					reinterpret_cast<const VkDescriptorImageInfo *>(info);
+			}
+		}
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()),
+							   writes.data(), 0, nullptr);
+	}
+
+	bool usesTemplate() const { return updateTemplate != VK_NULL_HANDLE; }
+
+  private:
+	static bool bufferDescriptor(VkDescriptorType type) {
+		return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
+			   type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<VkDescriptorUpdateTemplateEntry> entries;
+	PFN_vkDestroyDescriptorUpdateTemplateKHR destroyTemplate = nullptr;
+	PFN_vkUpdateDescriptorSetWithTemplateKHR updateWithTemplate = nullptr;
+	VkDescriptorUpdateTemplate updateTemplate = VK_NULL_HANDLE;
+};
@@ -0,0 +1,753 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/*
+	Sub-allocates buffers and images out of large VkDeviceMemory blocks, so
+	the apps call vkAllocateMemory once per block instead of once per
+	resource (maxMemoryAllocationCount is as low as 4096 on some drivers).
+
+	Blocks are grouped in pools by memory type, strategy and resource kind:
+
+	- General blocks use a two level segregated fit (TLSF) allocator, free
+	  chunks are bucketed by size class and found with two bitmap scans,
+	  freeing merges a chunk with its free neighbours.
+	- Linear blocks only bump an offset, for resources that live as long
+	  as the app. A linear block becomes reusable once all of its
+	  allocations have been freed.
+	- Allocations of at least half a block, images of at least
+	  DEVICE_DEDICATED_IMAGE_SIZE and the Dedicated strategy get their
+	  own VkDeviceMemory.
+
+	bufferImageGranularity: when the device reports more than 1, buffers
+	(and linear images) and optimal images never share a block, so no
+	linear and non-linear resource can end up on the same page.
+
+	Host visible blocks are mapped once when they are created,
+	DeviceAllocation::mapped points at the allocation. The allocator is
+	thread safe.
+
+	Accounting: every allocation carries a DeviceMemoryCategory and a serial
+	number. printReport() lists the usage per heap and category next to
+	the heap budget, which comes from VK_EXT_memory_budget when
+	enableBudget() was given vkGetPhysicalDeviceMemoryProperties2 and falls
+	back to the heap size otherwise. reportLeaks() lists every allocation
+	that is still alive, call it right before destroy().
+*/
+
+const VkDeviceSize DEVICE_BLOCK_SIZE = 64 * 1024 * 1024;
+const VkDeviceSize DEVICE_DEDICATED_IMAGE_SIZE = 16 * 1024 * 1024;
+
+enum class DeviceResourceKind { Buffer, Image };
+// Dedicated always gets its own VkDeviceMemory
+enum class DeviceAllocationStrategy { General, Linear, Dedicated };
+
+enum class DeviceMemoryCategory {
+	VertexBuffer,
+	IndexBuffer,
+	UniformBuffer,
+	StorageBuffer,
+	IndirectBuffer,
+	Staging,
+	Texture,
+	DepthImage,
+	RenderTarget,
+	Other,
+	Count
+};
+
+inline const char *deviceMemoryCategoryName(DeviceMemoryCategory category) {
+	static const char *names[] = {"vertex buffers",	 "index buffers",
+								  "uniform buffers", "storage buffers",
+								  "indirect buffers", "staging",
+								  "textures",		 "depth images",
+								  "render targets",	 "other"};
+	return names[static_cast<size_t>(category)];
+}
+
+// the most specific usage wins, e.g. a storage buffer that is also bound
+// as vertex buffer counts as storage
+inline DeviceMemoryCategory bufferMemoryCategory(VkBufferUsageFlags usage) {
+	if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+		return DeviceMemoryCategory::StorageBuffer;
+	} else if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+		return DeviceMemoryCategory::UniformBuffer;
+	} else if (usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) {
+		return DeviceMemoryCategory::IndirectBuffer;
+	} else if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) {
+		return DeviceMemoryCategory::IndexBuffer;
+	} else if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) {
+		return DeviceMemoryCategory::VertexBuffer;
+	} else if (usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) {
+		return DeviceMemoryCategory::Staging;
+	}
+	return DeviceMemoryCategory::Other;
+}
+
+inline DeviceMemoryCategory imageMemoryCategory(VkImageUsageFlags usage) {
+	if (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+		return DeviceMemoryCategory::DepthImage;
+	} else if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) {
+		return DeviceMemoryCategory::RenderTarget;
+	} else if (usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+		return DeviceMemoryCategory::Texture;
+	}
+	return DeviceMemoryCategory::Other;
+}
+
+// index of the lowest set bit, mask must not be 0
+inline uint32_t lowestSetBit(uint64_t mask) {
+	uint32_t bit = 0;
+	for (uint32_t shift = 32; shift > 0; shift /= 2) {
+		uint64_t low = mask & ((uint64_t(1) << shift) - 1);
+		if (low == 0) {
+			mask >>= shift;
+			bit += shift;
+		} else {
+			mask = low;
+		}
+	}
+	return bit;
+}
+
+inline uint32_t highestSetBit(uint64_t value) {
+	uint32_t bit = 0;
+	while (value >>= 1) {
+		bit++;
+	}
+	return bit;
+}
+
+// * TLSF bookkeeping for one block, no Vulkan involved. Chunks cover the
+// * block without gaps, free ones are additionally linked into the list
+// * of their size class
+class TlsfHeap {
+  public:
+	static constexpr uint32_t SL_BITS = 4;
+	static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+	static constexpr uint32_t FL_COUNT = 64 - SL_BITS + 1;
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	void init(VkDeviceSize size) {
+		chunks.clear();
+		unusedChunks.clear();
+		flBitmap = 0;
+		std::fill(std::begin(slBitmap), std::end(slBitmap), 0u);
+		for (auto &row : heads) {
+			std::fill(std::begin(row), std::end(row), NONE);
+		}
+		uint32_t chunk = newChunk(0, size);
+		insertFree(chunk);
+	}
+
+	// returns the chunk id, or NONE when nothing large enough is free
+	uint32_t allocate(VkDeviceSize size, VkDeviceSize alignment,
+					  VkDeviceSize &offset) {
+		// * the padding needed for the alignment is not known before the
+		// * chunk is, so search for a chunk that fits even the worst case.
+		// * rounding up to the next size class makes every chunk of the
+		// * class found large enough
+		VkDeviceSize request = size + alignment - 1;
+		if (request >= SL_COUNT) {
+			request += (VkDeviceSize(1) << (highestSetBit(request) - SL_BITS)) -
+					   1;
+		}
+		uint32_t fl, sl;
+		mapping(request, fl, sl);
+
+		uint32_t slMap = fl < FL_COUNT ? slBitmap[fl] & (~0u << sl) : 0;
+		if (slMap == 0) {
+			uint64_t flMap =
+				fl + 1 < 64 ? flBitmap & (~uint64_t(0) << (fl + 1)) : 0;
+			if (flMap == 0) {
+				return NONE;
+			}
+			fl = lowestSetBit(flMap);
+			slMap = slBitmap[fl];
+		}
+		sl = lowestSetBit(slMap);
+
+		uint32_t chunk = heads[fl][sl];
+		removeFree(chunk);
+
+		// alignment padding stays inside the allocated chunk
+		offset = (chunks[chunk].offset + alignment - 1) / alignment * alignment;
+		VkDeviceSize used = offset + size - chunks[chunk].offset;
+		if (chunks[chunk].size > used) {
+			uint32_t rest = newChunk(chunks[chunk].offset + used,
+									 chunks[chunk].size - used);
+			chunks[rest].prevPhys = chunk;
+			chunks[rest].nextPhys = chunks[chunk].nextPhys;
+			if (chunks[chunk].nextPhys != NONE) {
+				chunks[chunks[chunk].nextPhys].prevPhys = rest;
+			}
+			chunks[chunk].nextPhys = rest;
+			chunks[chunk].size = used;
+			insertFree(rest);
+		}
+		return chunk;
+	}
+
+	void free(uint32_t chunk) {
+		uint32_t prev = chunks[chunk].prevPhys;
+		if (prev != NONE && chunks[prev].free) {
+			removeFree(prev);
+			chunk = merge(prev, chunk);
+		}
+		uint32_t next = chunks[chunk].nextPhys;
+		if (next != NONE && chunks[next].free) {
+			removeFree(next);
+			chunk = merge(chunk, next);
+		}
+		insertFree(chunk);
+	}
+
+	// bytes of the chunk, including its alignment padding
+	VkDeviceSize chunkSize(uint32_t chunk) const { return chunks[chunk].size; }
+
+  private:
+	struct Chunk {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		uint32_t prevPhys;
+		uint32_t nextPhys;
+		uint32_t prevFree;
+		uint32_t nextFree;
+		bool free;
+	};
+
+	static void mapping(VkDeviceSize size, uint32_t &fl, uint32_t &sl) {
+		if (size < SL_COUNT) {
+			fl = 0;
+			sl = static_cast<uint32_t>(size);
+			return;
+		}
+		uint32_t top = highestSetBit(size);
+		fl = top - SL_BITS + 1;
+		sl = static_cast<uint32_t>(size >> (top - SL_BITS)) - SL_COUNT;
+	}
+
+	uint32_t newChunk(VkDeviceSize offset, VkDeviceSize size) {
+		Chunk chunk{offset, size, NONE, NONE, NONE, NONE, false};
+		if (!unusedChunks.empty()) {
+			uint32_t id = unusedChunks.back();
+			unusedChunks.pop_back();
+			chunks[id] = chunk;
+			return id;
+		}
+		chunks.push_back(chunk);
+		return static_cast<uint32_t>(chunks.size() - 1);
+	}
+
+	// folds second into first, its physical successor
+	uint32_t merge(uint32_t first, uint32_t second) {
+		chunks[first].size += chunks[second].size;
+		chunks[first].nextPhys = chunks[second].nextPhys;
+		if (chunks[second].nextPhys != NONE) {
+			chunks[chunks[second].nextPhys].prevPhys = first;
+		}
+		unusedChunks.push_back(second);
+		return first;
+	}
+
+	void insertFree(uint32_t chunk) {
+		uint32_t fl, sl;
+		mapping(chunks[chunk].size, fl, sl);
+		chunks[chunk].free = true;
+		chunks[chunk].prevFree = NONE;
+		chunks[chunk].nextFree = heads[fl][sl];
+		if (heads[fl][sl] != NONE) {
+			chunks[heads[fl][sl]].prevFree = chunk;
+		}
+		heads[fl][sl] = chunk;
+		slBitmap[fl] |= 1u << sl;
+		flBitmap |= uint64_t(1) << fl;
+	}
+
+	void removeFree(uint32_t chunk) {
+		uint32_t fl, sl;
+		mapping(chunks[chunk].size, fl, sl);
+		chunks[chunk].free = false;
+		if (chunks[chunk].prevFree != NONE) {
+			chunks[chunks[chunk].prevFree].nextFree = chunks[chunk].nextFree;
+		} else {
+			heads[fl][sl] = chunks[chunk].nextFree;
+		}
+		if (chunks[chunk].nextFree != NONE) {
+			chunks[chunks[chunk].nextFree].prevFree = chunks[chunk].prevFree;
+		}
+		if (heads[fl][sl] == NONE) {
+			slBitmap[fl] &= ~(1u << sl);
+			if (slBitmap[fl] == 0) {
+				flBitmap &= ~(uint64_t(1) << fl);
+			}
+		}
+	}
+
+	std::vector<Chunk> chunks;
+	std::vector<uint32_t> unusedChunks;
+	uint64_t flBitmap = 0;
+	uint32_t slBitmap[FL_COUNT] = {};
+	uint32_t heads[FL_COUNT][SL_COUNT];
+};
+
+struct DeviceMemoryBlock {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	char *mapped = nullptr;
+	uint32_t memoryType = 0;
+	bool dedicated = false;
+	DeviceAllocationStrategy strategy = DeviceAllocationStrategy::General;
+	uint32_t liveCount = 0;
+	// Linear blocks
+	VkDeviceSize head = 0;
+	// General blocks
+	TlsfHeap tlsf;
+};
+
+struct DeviceAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	// host visible memory only
+	void *mapped = nullptr;
+
+	DeviceMemoryBlock *block = nullptr;
+	uint32_t chunk = TlsfHeap::NONE;
+	// serial number, 0 for an empty allocation
+	uint32_t id = 0;
+};
+
+struct DeviceHeapStats {
+	VkDeviceSize heapSize = 0;
+	bool deviceLocal = false;
+	uint32_t blockCount = 0;
+	uint32_t dedicatedCount = 0;
+	// bytes of VkDeviceMemory allocated from the heap
+	VkDeviceSize blockBytes = 0;
+	uint32_t allocationCount = 0;
+	// bytes requested by the resources placed in those blocks
+	VkDeviceSize allocationBytes = 0;
+	uint32_t categoryCount[size_t(DeviceMemoryCategory::Count)] = {};
+	VkDeviceSize categoryBytes[size_t(DeviceMemoryCategory::Count)] = {};
+};
+
+class DeviceAllocator {
+  public:
+	void create(VkDevice device, VkPhysicalDevice physicalDevice,
+				VkDeviceSize blockSize = DEVICE_BLOCK_SIZE) {
+		this->device = device;
+		this->blockSize = blockSize;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		separateImages = properties.limits.bufferImageGranularity > 1;
+
+		pools.resize(memProperties.memoryTypeCount * POOLS_PER_TYPE);
+		heapStats.resize(memProperties.memoryHeapCount);
+		for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++) {
+			heapStats[i].heapSize = memProperties.memoryHeaps[i].size;
+			heapStats[i].deviceLocal = (memProperties.memoryHeaps[i].flags &
+										VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		}
+	}
+
+	// * vkGetPhysicalDeviceMemoryProperties2(KHR), only when the device
+	// * was created with VK_EXT_memory_budget enabled
+	void enableBudget(VkPhysicalDevice physicalDevice,
+					  PFN_vkGetPhysicalDeviceMemoryProperties2KHR
+						  getMemoryProperties2) {
+		this->physicalDevice = physicalDevice;
+		this->getMemoryProperties2 = getMemoryProperties2;
+	}
+
+	// allocations that are still alive are leaked, see reportLeaks
+	void destroy() {
+		for (auto &pool : pools) {
+			for (auto &block : pool) {
+				releaseBlock(*block);
+			}
+			pool.clear();
+		}
+	}
+
+	DeviceAllocation
+	allocate(const VkMemoryRequirements &requirements,
+			 VkMemoryPropertyFlags properties, DeviceResourceKind kind,
+			 DeviceMemoryCategory category,
+			 DeviceAllocationStrategy strategy =
+				 DeviceAllocationStrategy::General) {
+		uint32_t memoryType = findMemoryType(requirements.memoryTypeBits,
+											 properties);
+		std::lock_guard<std::mutex> lock(mutex);
+		DeviceAllocation allocation =
+			allocateLocked(requirements, memoryType, kind, strategy);
+
+		allocation.id = ++serial;
+		uint32_t heap = heapIndex(allocation.block->memoryType);
+		liveAllocations[allocation.id] = {category, heap, allocation.size};
+		heapStats[heap].categoryCount[size_t(category)]++;
+		heapStats[heap].categoryBytes[size_t(category)] += allocation.size;
+		return allocation;
+	}
+
+	void free(DeviceAllocation &allocation) {
+		if (allocation.block == nullptr) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		DeviceMemoryBlock &block = *allocation.block;
+		DeviceHeapStats &stats = heapStats[heapIndex(block.memoryType)];
+		stats.allocationCount--;
+		stats.allocationBytes -= allocation.size;
+
+		auto live = liveAllocations.find(allocation.id);
+		size_t category = size_t(live->second.category);
+		stats.categoryCount[category]--;
+		stats.categoryBytes[category] -= allocation.size;
+		liveAllocations.erase(live);
+		block.liveCount--;
+
+		if (block.dedicated) {
+			releaseBlock(block);
+			delete allocation.block;
+		} else {
+			if (block.strategy == DeviceAllocationStrategy::Linear) {
+				if (block.liveCount == 0) {
+					block.head = 0;
+				}
+			} else {
+				block.tlsf.free(allocation.chunk);
+			}
+			if (block.liveCount == 0) {
+				releaseEmptyBlock(block);
+			}
+		}
+		allocation = DeviceAllocation{};
+	}
+
+	const std::vector<DeviceHeapStats> &stats() const { return heapStats; }
+	// vkAllocateMemory calls made so far
+	uint32_t deviceAllocationCount() const { return deviceAllocations; }
+
+	// per heap usage and budget, then the bytes of every category
+	void printReport(std::ostream &out) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<VkDeviceSize> usage, budget;
+		bool measured = queryBudget(usage, budget);
+		for (size_t i = 0; i < heapStats.size(); i++) {
+			const DeviceHeapStats &stats = heapStats[i];
+			if (stats.blockCount == 0) {
+				continue;
+			}
+			out << "    heap " << i
+				<< (stats.deviceLocal ? " (device local): " : " (host): ")
+				<< stats.allocationCount << " allocations using "
+				<< stats.allocationBytes / 1024 << " KiB of "
+				<< stats.blockBytes / 1024 << " KiB in " << stats.blockCount
+				<< " blocks (" << stats.dedicatedCount << " dedicated)"
+				<< std::endl;
+			out << "        " << (measured ? "process usage " : "usage ")
+				<< usage[i] / (1024 * 1024) << " MiB of "
+				<< budget[i] / (1024 * 1024)
+				<< (measured ? " MiB budget (" : " MiB heap size (")
+				<< 100.0 * usage[i] / std::max<VkDeviceSize>(budget[i], 1)
+				<< "%)" << std::endl;
+			for (size_t c = 0; c < size_t(DeviceMemoryCategory::Count); c++) {
+				if (stats.categoryCount[c] == 0) {
+					continue;
+				}
+				out << "        "
+					<< deviceMemoryCategoryName(DeviceMemoryCategory(c))
+					<< ": " << stats.categoryCount[c] << " allocations, "
+					<< stats.categoryBytes[c] / 1024 << " KiB" << std::endl;
+			}
+		}
+		out << "    " << deviceAllocations
+			<< " vkAllocateMemory calls in total" << std::endl;
+	}
+
+	// one row per heap and category, for spreadsheets and regression diffs
+	bool exportReport(const std::string &path) {
+		std::ofstream file(path);
+		if (!file) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<VkDeviceSize> usage, budget;
+		queryBudget(usage, budget);
+		file << "heap,category,allocations,bytes,heap_usage,heap_budget\n";
+		for (size_t i = 0; i < heapStats.size(); i++) {
+			const DeviceHeapStats &stats = heapStats[i];
+			for (size_t c = 0; c < size_t(DeviceMemoryCategory::Count); c++) {
+				if (stats.categoryCount[c] == 0) {
+					continue;
+				}
+				file << i << ","
+					 << deviceMemoryCategoryName(DeviceMemoryCategory(c)) << ","
+					 << stats.categoryCount[c] << "," << stats.categoryBytes[c]
+					 << "," << usage[i] << "," << budget[i] << "\n";
+			}
+		}
+		return true;
+	}
+
+	// returns the number of allocations that were never freed
+	size_t reportLeaks(std::ostream &out) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const auto &live : liveAllocations) {
+			out << "[WARNING] leaked device memory #" << live.first << ": "
+				<< deviceMemoryCategoryName(live.second.category) << ", "
+				<< live.second.size << " bytes in heap " << live.second.heap
+				<< std::endl;
+		}
+		return liveAllocations.size();
+	}
+
+  private:
+	static constexpr uint32_t POOLS_PER_TYPE = 4;
+
+	struct LiveAllocation {
+		DeviceMemoryCategory category;
+		uint32_t heap;
+		VkDeviceSize size;
+	};
+
+	DeviceAllocation allocateLocked(const VkMemoryRequirements &requirements,
+									uint32_t memoryType,
+									DeviceResourceKind kind,
+									DeviceAllocationStrategy strategy) {
+		bool dedicated = strategy == DeviceAllocationStrategy::Dedicated ||
+						 requirements.size >= blockSize / 2 ||
+						 (kind == DeviceResourceKind::Image &&
+						  requirements.size >= DEVICE_DEDICATED_IMAGE_SIZE);
+		if (dedicated) {
+			return allocateDedicated(requirements.size, memoryType);
+		}
+
+		auto &pool = pools[poolIndex(memoryType, kind, strategy)];
+		DeviceAllocation allocation;
+		for (auto &block : pool) {
+			if (allocateFromBlock(*block, requirements, allocation)) {
+				return allocation;
+			}
+		}
+
+		// * blocks of a pool start at an eighth of blockSize and double up
+		// * to it, so a handful of uniform buffers does not claim 64 MiB
+		VkDeviceSize size = blockSize / 8;
+		if (!pool.empty()) {
+			size = std::min(pool.back()->size * 2, blockSize);
+		}
+		while (size < requirements.size + requirements.alignment) {
+			size *= 2;
+		}
+		pool.push_back(createBlock(size, memoryType, strategy, false));
+		if (!allocateFromBlock(*pool.back(), requirements, allocation)) {
+			throw std::runtime_error("failed to sub-allocate memory!");
+		}
+		return allocation;
+	}
+
+	// * without VK_EXT_memory_budget the usage is what this allocator holds
+	// * and the budget is the whole heap, returns whether it was measured
+	bool queryBudget(std::vector<VkDeviceSize> &usage,
+					 std::vector<VkDeviceSize> &budget) const {
+		usage.resize(heapStats.size());
+		budget.resize(heapStats.size());
+		if (getMemoryProperties2 != nullptr) {
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+			budgetProperties.sType =
+				VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+			VkPhysicalDeviceMemoryProperties2 properties{};
+			properties.sType =
+				VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			properties.pNext = &budgetProperties;
+			getMemoryProperties2(physicalDevice, &properties);
+			for (size_t i = 0; i < heapStats.size(); i++) {
+				usage[i] = budgetProperties.heapUsage[i];
+				budget[i] = budgetProperties.heapBudget[i];
+			}
+			return true;
+		}
+		for (size_t i = 0; i < heapStats.size(); i++) {
+			usage[i] = heapStats[i].blockBytes;
+			budget[i] = heapStats[i].heapSize;
+		}
+		return false;
+	}
+
+	uint32_t poolIndex(uint32_t memoryType, DeviceResourceKind kind,
+					   DeviceAllocationStrategy strategy) const {
+		uint32_t index = memoryType * POOLS_PER_TYPE;
+		if (strategy == DeviceAllocationStrategy::Linear) {
+			index += 2;
+		}
+		if (separateImages && kind == DeviceResourceKind::Image) {
+			index += 1;
+		}
+		return index;
+	}
+
+	uint32_t heapIndex(uint32_t memoryType) const {
+		return memProperties.memoryTypes[memoryType].heapIndex;
+	}
+
+	uint32_t findMemoryType(uint32_t typeFilter,
+							VkMemoryPropertyFlags properties) const {
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			if ((typeFilter & (1u << i)) &&
+				(memProperties.memoryTypes[i].propertyFlags & properties) ==
+					properties) {
+				return i;
+			}
+		}
+		throw std::runtime_error("failed to find suitable memory type!");
+	}
+
+	std::unique_ptr<DeviceMemoryBlock>
+	createBlock(VkDeviceSize size, uint32_t memoryType,
+				DeviceAllocationStrategy strategy, bool dedicated) {
+		std::unique_ptr<DeviceMemoryBlock> block(new DeviceMemoryBlock());
+		block->size = size;
+		block->memoryType = memoryType;
+		block->strategy = strategy;
+		block->dedicated = dedicated;
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate device memory block!");
+		}
+		deviceAllocations++;
+
+		if (memProperties.memoryTypes[memoryType].propertyFlags &
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			void *data;
+			vkMapMemory(device, block->memory, 0, size, 0, &data);
+			block->mapped = static_cast<char *>(data);
+		}
+		if (!dedicated && strategy == DeviceAllocationStrategy::General) {
+			block->tlsf.init(size);
+		}
+
+		DeviceHeapStats &stats = heapStats[heapIndex(memoryType)];
+		stats.blockCount++;
+		stats.blockBytes += size;
+		if (dedicated) {
+			stats.dedicatedCount++;
+		}
+		return block;
+	}
+
+	void releaseBlock(DeviceMemoryBlock &block) {
+		if (block.mapped != nullptr) {
+			vkUnmapMemory(device, block.memory);
+		}
+		vkFreeMemory(device, block.memory, nullptr);
+
+		DeviceHeapStats &stats = heapStats[heapIndex(block.memoryType)];
+		stats.blockCount--;
+		stats.blockBytes -= block.size;
+		if (block.dedicated) {
+			stats.dedicatedCount--;
+		}
+	}
+
+	// keeps the last block of each pool around so that freeing and
+	// allocating a single resource does not hit vkAllocateMemory every time
+	void releaseEmptyBlock(DeviceMemoryBlock &block) {
+		for (auto &pool : pools) {
+			for (size_t i = 0; i < pool.size(); i++) {
+				if (pool[i].get() == &block) {
+					if (pool.size() > 1) {
+						releaseBlock(block);
+						pool.erase(pool.begin() + i);
+					}
+					return;
+				}
+			}
+		}
+	}
+
+	DeviceAllocation allocateDedicated(VkDeviceSize size,
+									   uint32_t memoryType) {
+		DeviceMemoryBlock *block =
+			createBlock(size, memoryType, DeviceAllocationStrategy::General,
+						true)
+				.release();
+		block->liveCount = 1;
+
+		DeviceAllocation allocation;
+		allocation.memory = block->memory;
+		allocation.size = size;
+		allocation.mapped = block->mapped;
+		allocation.block = block;
+
+		DeviceHeapStats &stats = heapStats[heapIndex(memoryType)];
+		stats.allocationCount++;
+		stats.allocationBytes += size;
+		return allocation;
+	}
+
+	bool allocateFromBlock(DeviceMemoryBlock &block,
+						   const VkMemoryRequirements &requirements,
+						   DeviceAllocation &allocation) {
+		VkDeviceSize offset;
+		if (block.strategy == DeviceAllocationStrategy::Linear) {
+			offset = (block.head + requirements.alignment - 1) /
+					 requirements.alignment * requirements.alignment;
+			if (offset + requirements.size > block.size) {
+				return false;
+			}
+			block.head = offset + requirements.size;
+		} else {
+			allocation.chunk = block.tlsf.allocate(
+				requirements.size, requirements.alignment, offset);
+			if (allocation.chunk == TlsfHeap::NONE) {
+				return false;
+			}
+		}
+		block.liveCount++;
+
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.size = requirements.size;
+		allocation.mapped =
+			block.mapped != nullptr ? block.mapped + offset : nullptr;
+		allocation.block = &block;
+
+		DeviceHeapStats &stats = heapStats[heapIndex(block.memoryType)];
+		stats.allocationCount++;
+		stats.allocationBytes += requirements.size;
+		return true;
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2 = nullptr;
+	VkPhysicalDeviceMemoryProperties memProperties{};
+	VkDeviceSize blockSize = DEVICE_BLOCK_SIZE;
+	bool separateImages = false;
+
+	std::mutex mutex;
+	std::vector<std::vector<std::unique_ptr<DeviceMemoryBlock>>> pools;
+	std::vector<DeviceHeapStats> heapStats;
+	uint32_t deviceAllocations = 0;
+	uint32_t serial = 0;
+	std::map<uint32_t, LiveAllocation> liveAllocations;
+};
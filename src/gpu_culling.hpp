@@ -0,0 +1,568 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "device_allocator.hpp"
+
+/*
+	Frustum culls objects in a compute shader and draws the survivors with
+	draw commands the shader wrote itself, so the CPU records the same few
+	commands whether there are ten objects or a few hundred thousand.
+
+	The objects are the instances of one mesh: a storage buffer of
+	InstanceData transforms (see instancing.hpp). Per frame in flight the
+	culler owns
+		- a host visible GpuCullParams uniform: frustum planes in the space
+		  the transforms map into, the mesh bounding sphere, the model view
+		  and projection terms for the occlusion test, the index range to
+		  draw and the object count, rewritten every frame
+		- two device local draw buffers, one per phase: the draw count and
+		  the occluded count, padded to 16 bytes, followed by one
+		  VkDrawIndexedIndirectCommand per object
+		- a device local word per object the two phases hand over in
+		- host visible words the counts are copied back into
+	instance_cull.comp tests one object per invocation and appends a command
+	(firstInstance = the object) for every visible one. Nothing recorded
+	depends on the camera, so the recorded commands stay valid from frame
+	to frame.
+
+	With occlusion culling, the frame is drawn in two phases around a
+	DepthPyramid (depth_pyramid.hpp):
+		early	record(): frustum test, then an occlusion test against the
+				previous frame's pyramid. Survivors are drawn, objects in the
+				frustum that failed are marked pending
+		build	the pyramid is rebuilt from the early pass depth
+		late	recordLate(): the pending objects against the new pyramid,
+				the ones it does not hide are drawn in a second render pass
+	Objects the previous frame's depth hides by mistake (the camera or an
+	occluder moved) show up in the late phase, so nothing visible is lost,
+	and whatever the late phase still rejects is counted as occluded.
+
+	draw() consumes the commands with vkCmdDrawIndexedIndirectCountKHR
+	(VK_KHR_draw_indirect_count). Without it the whole buffer is cleared
+	before culling and every slot is drawn with a fixed count, the slots
+	past the visible ones are zero and draw nothing. firstInstance != 0
+	needs the drawIndirectFirstInstance feature.
+
+	When the queue supports timestamps the pass that tests every object
+	(clears and first dispatch) is timed every frame, cullMilliseconds()
+	is the GPU side of the comparison with the CPU culling in
+	frustum_culling.hpp.
+*/
+
+const uint32_t GPU_CULL_WORKGROUP_SIZE = 64;
+// * bytes in front of the commands, the draw and occluded counts padded to
+// * a 16 byte boundary
+const VkDeviceSize GPU_CULL_COUNT_SIZE = 16;
+
+// std140, matches CullParams in instance_cull.comp
+struct GpuCullParams {
+	float planes[6][4];
+	// mesh bounding sphere, xyz center and w radius
+	float sphere[4];
+	// * column-major, into view space. Occlusion culling only, as is
+	// * projection: proj[0][0], proj[1][1], proj[2][2] and proj[3][2]
+	float modelView[16];
+	float projection[4];
+	float pyramidSize[2];
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	uint32_t objectCount;
+	uint32_t padding;
+};
+
+// push constant of instance_cull.comp
+enum class GpuCullPhase : uint32_t { Frustum, Early, Late };
+
+class GpuCuller {
+  public:
+	// * drawIndexedIndirectCount is VK_NULL_HANDLE without the extension,
+	// * then draw() falls back to fixed count indirect draws. Without valid
+	// * timestamp bits on the queue the pass is not timed
+	void create(VkDevice device, DeviceAllocator &allocator,
+				uint32_t frameCount, const VkPhysicalDeviceLimits &limits,
+				bool multiDrawIndirect,
+				PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount,
+				uint32_t timestampValidBits) {
+		this->device = device;
+		this->allocator = &allocator;
+		this->maxDrawIndirectCount = limits.maxDrawIndirectCount;
+		this->multiDrawIndirect = multiDrawIndirect;
+		this->drawIndexedIndirectCount = drawIndexedIndirectCount;
+		this->timestampPeriod = limits.timestampPeriod;
+		timestampMask = timestampValidBits >= 64
+							? ~uint64_t(0)
+							: (uint64_t(1) << timestampValidBits) - 1;
+
+		if (timestampValidBits != 0) {
+			VkQueryPoolCreateInfo queryInfo{};
+			queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryInfo.queryCount = 2 * frameCount;
+			if (vkCreateQueryPool(device, &queryInfo, nullptr, &queryPool) !=
+				VK_SUCCESS) {
+				throw std::runtime_error("failed to create cull query pool!");
+			}
+		}
+
+		std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+		for (uint32_t i = 0; i < bindings.size(); i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = bindingType(i);
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
+										&setLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create cull set layout!");
+		}
+
+		VkPushConstantRange pushConstant{};
+		pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstant.size = sizeof(GpuCullPhase);
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &setLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+								   &layout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create cull pipeline layout!");
+		}
+
+		// * a set per phase and frame, they only differ in the draw buffer
+		uint32_t setCount = 2 * frameCount;
+		std::array<VkDescriptorPoolSize, 3> poolSizes{};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		poolSizes[0].descriptorCount = setCount;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[1].descriptorCount = 3 * setCount;
+		poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[2].descriptorCount = setCount;
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = setCount;
+		if (vkCreateDescriptorPool(device, &poolInfo, nullptr,
+								   &descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create cull descriptor pool!");
+		}
+
+		std::vector<VkDescriptorSetLayout> layouts(setCount, setLayout);
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = setCount;
+		allocInfo.pSetLayouts = layouts.data();
+		frames.resize(frameCount);
+		std::vector<VkDescriptorSet> sets(setCount);
+		if (vkAllocateDescriptorSets(device, &allocInfo, sets.data()) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate cull descriptors!");
+		}
+
+		for (uint32_t i = 0; i < frameCount; i++) {
+			Frame &frame = frames[i];
+			frame.set = sets[2 * i];
+			frame.lateSet = sets[2 * i + 1];
+			frame.params = createBuffer(
+				sizeof(GpuCullParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				frame.paramsMemory);
+			frame.readback = createBuffer(
+				sizeof(ReadbackCounts), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				frame.readbackMemory);
+			*static_cast<ReadbackCounts *>(frame.readbackMemory.mapped) = {};
+		}
+	}
+
+	// the device must be idle
+	void destroy() {
+		for (Frame &frame : frames) {
+			destroyBuffer(frame.params, frame.paramsMemory);
+			destroyBuffer(frame.readback, frame.readbackMemory);
+			destroyBuffer(frame.draws, frame.drawsMemory);
+			destroyBuffer(frame.lateDraws, frame.lateDrawsMemory);
+			destroyBuffer(frame.pending, frame.pendingMemory);
+		}
+		frames.clear();
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
+		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+		vkDestroyPipelineLayout(device, layout, nullptr);
+		vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+	}
+
+	// * culls the first count InstanceData of objects from now on, the draw
+	// * buffers only grow. No frame in flight may still use the culler
+	void setObjects(VkBuffer objects, uint32_t count) {
+		if (count > capacity) {
+			const VkBufferUsageFlags drawUsage =
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			for (Frame &frame : frames) {
+				destroyBuffer(frame.draws, frame.drawsMemory);
+				destroyBuffer(frame.lateDraws, frame.lateDrawsMemory);
+				destroyBuffer(frame.pending, frame.pendingMemory);
+				frame.draws = createBuffer(drawBufferSize(count), drawUsage,
+										   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+										   frame.drawsMemory);
+				frame.lateDraws = createBuffer(
+					drawBufferSize(count), drawUsage,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.lateDrawsMemory);
+				frame.pending = createBuffer(
+					VkDeviceSize(count) * sizeof(uint32_t),
+					VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.pendingMemory);
+			}
+			capacity = count;
+		}
+		objectCount = count;
+
+		for (Frame &frame : frames) {
+			VkDescriptorSet sets[2] = {frame.set, frame.lateSet};
+			VkBuffer draws[2] = {frame.draws, frame.lateDraws};
+			for (uint32_t phase = 0; phase < 2; phase++) {
+				VkDescriptorBufferInfo bufferInfos[4] = {
+					{frame.params, 0, sizeof(GpuCullParams)},
+					{objects, 0, VK_WHOLE_SIZE},
+					{draws[phase], 0, VK_WHOLE_SIZE},
+					{frame.pending, 0, VK_WHOLE_SIZE}};
+				std::array<VkWriteDescriptorSet, 4> writes{};
+				for (uint32_t i = 0; i < writes.size(); i++) {
+					writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					writes[i].dstSet = sets[phase];
+					writes[i].dstBinding = i;
+					writes[i].descriptorType = bindingType(i);
+					writes[i].descriptorCount = 1;
+					writes[i].pBufferInfo = &bufferInfos[i];
+				}
+				vkUpdateDescriptorSets(device,
+									   static_cast<uint32_t>(writes.size()),
+									   writes.data(), 0, nullptr);
+			}
+		}
+	}
+
+	// * the depth pyramid the occlusion test samples, level 0 is width x
+	// * height. Needed once before the first frame even without occlusion
+	// * culling, and again whenever the pyramid is recreated. No frame in
+	// * flight may still use the culler
+	void setDepthPyramid(VkImageView view, VkSampler sampler, uint32_t width,
+						 uint32_t height) {
+		pyramidWidth = width;
+		pyramidHeight = height;
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.sampler = sampler;
+		imageInfo.imageView = view;
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		for (Frame &frame : frames) {
+			std::array<VkWriteDescriptorSet, 2> writes{};
+			VkDescriptorSet sets[2] = {frame.set, frame.lateSet};
+			for (uint32_t phase = 0; phase < 2; phase++) {
+				writes[phase].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[phase].dstSet = sets[phase];
+				writes[phase].dstBinding = 4;
+				writes[phase].descriptorType = bindingType(4);
+				writes[phase].descriptorCount = 1;
+				writes[phase].pImageInfo = &imageInfo;
+			}
+			vkUpdateDescriptorSets(device,
+								   static_cast<uint32_t>(writes.size()),
+								   writes.data(), 0, nullptr);
+		}
+	}
+
+	// * once before the first frame, so cullMilliseconds() never reads a
+	// * query that was not reset yet
+	void resetQueries(VkCommandBuffer commandBuffer) {
+		if (queryPool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(commandBuffer, queryPool, 0,
+								2 * static_cast<uint32_t>(frames.size()));
+		}
+	}
+
+	VkPipelineLayout pipelineLayout() const { return layout; }
+	bool drawCountSupported() const {
+		return drawIndexedIndirectCount != nullptr;
+	}
+
+	// * the frame's parameters, written by the host before its submission
+	// * and after its previous one finished. objectCount and pyramidSize
+	// * are filled in here
+	GpuCullParams &params(uint32_t frame) {
+		auto *params =
+			static_cast<GpuCullParams *>(frames[frame].paramsMemory.mapped);
+		params->objectCount = objectCount;
+		params->pyramidSize[0] = static_cast<float>(pyramidWidth);
+		params->pyramidSize[1] = static_cast<float>(pyramidHeight);
+		return *params;
+	}
+
+	// * outside a render pass: resets the draw counts (and with the fixed
+	// * count fallback every command), then culls into the frame's buffer.
+	// * With occlusion, the depth pyramid must be rebuilt and recordLate()
+	// * recorded after the draws
+	void record(VkCommandBuffer commandBuffer, uint32_t frame,
+				VkPipeline pipeline, bool occlusion) {
+		const Frame &current = frames[frame];
+		if (queryPool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(commandBuffer, queryPool, 2 * frame, 2);
+			vkCmdWriteTimestamp(commandBuffer,
+								VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool,
+								2 * frame);
+		}
+		VkDeviceSize clearSize =
+			drawCountSupported() ? GPU_CULL_COUNT_SIZE : VK_WHOLE_SIZE;
+		vkCmdFillBuffer(commandBuffer, current.draws, 0, clearSize, 0);
+		vkCmdFillBuffer(commandBuffer, current.lateDraws, 0, clearSize, 0);
+
+		// * the depth pyramid was written by the previous frame
+		VkMemoryBarrier clearBarrier{};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask =
+			VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		clearBarrier.dstAccessMask =
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT |
+								 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+							 &clearBarrier, 0, nullptr, 0, nullptr);
+
+		dispatch(commandBuffer, current.set, pipeline,
+				 occlusion ? GpuCullPhase::Early : GpuCullPhase::Frustum);
+		if (queryPool != VK_NULL_HANDLE) {
+			vkCmdWriteTimestamp(commandBuffer,
+								VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+								queryPool, 2 * frame + 1);
+		}
+	}
+
+	// * outside a render pass, after the early draws and the depth pyramid
+	// * build: culls the pending objects into the late draw buffer
+	void recordLate(VkCommandBuffer commandBuffer, uint32_t frame,
+					VkPipeline pipeline) {
+		dispatch(commandBuffer, frames[frame].lateSet, pipeline,
+				 GpuCullPhase::Late);
+	}
+
+	// * inside the render pass, with the mesh's pipeline and buffers bound,
+	// * the early phase's (or the only) draws
+	void draw(VkCommandBuffer commandBuffer, uint32_t frame) {
+		drawBuffer(commandBuffer, frames[frame].draws);
+	}
+
+	// inside the second render pass, the objects the late phase uncovered
+	void drawLate(VkCommandBuffer commandBuffer, uint32_t frame) {
+		drawBuffer(commandBuffer, frames[frame].lateDraws);
+	}
+
+	// * outside a render pass: copies the counts where visibleCount() and
+	// * occludedCount() read them once the frame's fence signaled
+	void recordReadback(VkCommandBuffer commandBuffer, uint32_t frame) {
+		VkBufferCopy regions[2] = {};
+		regions[0].size = sizeof(uint32_t);
+		regions[1].dstOffset = offsetof(ReadbackCounts, lateDrawn);
+		regions[1].size = 2 * sizeof(uint32_t);
+		vkCmdCopyBuffer(commandBuffer, frames[frame].draws,
+						frames[frame].readback, 1, &regions[0]);
+		vkCmdCopyBuffer(commandBuffer, frames[frame].lateDraws,
+						frames[frame].readback, 1, &regions[1]);
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0,
+							 nullptr, 0, nullptr);
+	}
+
+	// objects drawn by the frame's last finished submission, both phases
+	uint32_t visibleCount(uint32_t frame) const {
+		const ReadbackCounts &counts = readbackCounts(frame);
+		return counts.earlyDrawn + counts.lateDrawn;
+	}
+
+	// * objects inside the frustum that the late phase still found hidden,
+	// * 0 without occlusion culling
+	uint32_t occludedCount(uint32_t frame) const {
+		return readbackCounts(frame).occluded;
+	}
+
+	// * GPU time of the frame's last finished culling pass, the previous
+	// * value while the newest one is not available (0 without timestamps)
+	double cullMilliseconds(uint32_t frame) {
+		if (queryPool == VK_NULL_HANDLE) {
+			return 0.0;
+		}
+		uint64_t timestamps[2];
+		if (vkGetQueryPoolResults(device, queryPool, 2 * frame, 2,
+								  sizeof(timestamps), timestamps,
+								  sizeof(uint64_t),
+								  VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+			frames[frame].cullMillis = ticks * timestampPeriod / 1000000.0;
+		}
+		return frames[frame].cullMillis;
+	}
+
+  private:
+	// layout of the readback buffer, copied from both draw buffer headers
+	struct ReadbackCounts {
+		uint32_t earlyDrawn;
+		uint32_t lateDrawn;
+		uint32_t occluded;
+	};
+
+	struct Frame {
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		VkDescriptorSet lateSet = VK_NULL_HANDLE;
+		VkBuffer params = VK_NULL_HANDLE;
+		DeviceAllocation paramsMemory;
+		VkBuffer draws = VK_NULL_HANDLE;
+		DeviceAllocation drawsMemory;
+		VkBuffer lateDraws = VK_NULL_HANDLE;
+		DeviceAllocation lateDrawsMemory;
+		VkBuffer pending = VK_NULL_HANDLE;
+		DeviceAllocation pendingMemory;
+		VkBuffer readback = VK_NULL_HANDLE;
+		DeviceAllocation readbackMemory;
+		double cullMillis = 0.0;
+	};
+
+	// * 0 params, 1 objects, 2 draws, 3 pending, 4 depth pyramid
+	static VkDescriptorType bindingType(uint32_t binding) {
+		switch (binding) {
+		case 0:
+			return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		case 4:
+			return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		default:
+			return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		}
+	}
+
+	const ReadbackCounts &readbackCounts(uint32_t frame) const {
+		return *static_cast<const ReadbackCounts *>(
+			frames[frame].readbackMemory.mapped);
+	}
+
+	// * one culling phase into set's draw buffer, then makes the draws
+	// * visible to the indirect draw and the readback copy
+	void dispatch(VkCommandBuffer commandBuffer, VkDescriptorSet set,
+				  VkPipeline pipeline, GpuCullPhase phase) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+						  pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+								layout, 0, 1, &set, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_COMPUTE_BIT,
+						   0, sizeof(phase), &phase);
+		vkCmdDispatch(commandBuffer,
+					  (objectCount + GPU_CULL_WORKGROUP_SIZE - 1) /
+						  GPU_CULL_WORKGROUP_SIZE,
+					  1, 1);
+
+		VkMemoryBarrier cullBarrier{};
+		cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+									VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+							 VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+								 VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	void drawBuffer(VkCommandBuffer commandBuffer, VkBuffer draws) {
+		const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		uint32_t maxDraws = std::min(objectCount, maxDrawIndirectCount);
+		if (drawCountSupported()) {
+			drawIndexedIndirectCount(commandBuffer, draws, GPU_CULL_COUNT_SIZE,
+									 draws, 0, maxDraws, stride);
+			return;
+		}
+		uint32_t batch = multiDrawIndirect ? maxDraws : 1;
+		for (uint32_t first = 0; first < objectCount; first += batch) {
+			vkCmdDrawIndexedIndirect(
+				commandBuffer, draws,
+				GPU_CULL_COUNT_SIZE + VkDeviceSize(first) * stride,
+				std::min(batch, objectCount - first), stride);
+		}
+	}
+
+	static VkDeviceSize drawBufferSize(uint32_t count) {
+		return GPU_CULL_COUNT_SIZE +
+			   VkDeviceSize(count) * sizeof(VkDrawIndexedIndirectCommand);
+	}
+
+	VkBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+						  VkMemoryPropertyFlags properties,
+						  DeviceAllocation &memory) {
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		VkBuffer buffer;
+		if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create cull buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+		memory = allocator->allocate(
+			memRequirements, properties, DeviceResourceKind::Buffer,
+			bufferMemoryCategory(usage), DeviceAllocationStrategy::General);
+		vkBindBufferMemory(device, buffer, memory.memory, memory.offset);
+		return buffer;
+	}
+
+	void destroyBuffer(VkBuffer &buffer, DeviceAllocation &memory) {
+		if (buffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(device, buffer, nullptr);
+			allocator->free(memory);
+			buffer = VK_NULL_HANDLE;
+		}
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	DeviceAllocator *allocator = nullptr;
+	uint32_t maxDrawIndirectCount = 0;
+	bool multiDrawIndirect = false;
+	PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	float timestampPeriod = 1.0f;
+	uint64_t timestampMask = 0;
+
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	std::vector<Frame> frames;
+	uint32_t capacity = 0;
+	uint32_t objectCount = 0;
+	uint32_t pyramidWidth = 1;
+	uint32_t pyramidHeight = 1;
+};
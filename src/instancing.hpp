@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <vector>
+
+#include "vertex_layout.hpp"
+
+/*
+	Per-instance data for drawing many copies of one mesh with a single
+	instanced draw.
+
+	Every instance carries an affine transform (the upper three rows of a
+	4x4 matrix, row-major, so the shader takes three dot products) and an
+	RGBA8 tint. They live in their own vertex buffer bound with
+	VK_VERTEX_INPUT_RATE_INSTANCE next to the mesh vertices.
+
+	generateInstances() lays the copies out on the xy plane (z is up, as
+	for the placeholder floor) over a square field the size of the mesh
+	itself, around the mesh center: count copies are scaled down by the
+	grid side so the field always covers the same screen area and only the
+	vertex work grows with the count. One instance is the identity.
+		Grid	rows of untinted copies, one per cell
+		Random	random positions inside the field, random rotations about
+				z and random tints
+
+	InstanceBenchmark steps through a list of instance counts, discards a
+	few warmup frames after every change and averages the frame time of
+	the following ones.
+*/
+
+struct InstanceData {
+	float transform[12];
+	uint8_t tint[4];
+
+	using Layout =
+		VertexLayout<VertexAttribute<3, VK_FORMAT_R32G32B32A32_SFLOAT>,
+					 VertexAttribute<4, VK_FORMAT_R32G32B32A32_SFLOAT>,
+					 VertexAttribute<5, VK_FORMAT_R32G32B32A32_SFLOAT>,
+					 VertexAttribute<6, VK_FORMAT_R8G8B8A8_UNORM>>;
+};
+
+static_assert(InstanceData::Layout::stride == sizeof(InstanceData),
+			  "InstanceData does not match its layout");
+
+enum class InstanceDistribution { Grid, Random };
+
+// copies per row and column of the field
+inline uint32_t instanceGridSide(uint32_t count) {
+	uint32_t side =
+		static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+	return std::max(side, 1u);
+}
+
+// * every copy is scaled by this, the mesh bounds shrunk to one grid cell
+inline float instanceScale(uint32_t count) {
+	return 1.0f / static_cast<float>(instanceGridSide(count));
+}
+
+// * count instances over a size x size field around center (the mesh
+// * center). A copy is placed so its own center lands on its position
+inline std::vector<InstanceData>
+generateInstances(uint32_t count, InstanceDistribution distribution,
+				  const float center[3], float size, uint32_t seed = 1) {
+	uint32_t side = instanceGridSide(count);
+	float scale = instanceScale(count);
+	float cell = size * scale;
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	std::vector<InstanceData> instances(count);
+	for (uint32_t i = 0; i < count; i++) {
+		float x, y, angle = 0.0f;
+		uint8_t tint[4] = {255, 255, 255, 255};
+		if (distribution == InstanceDistribution::Grid || count == 1) {
+			x = (static_cast<float>(i % side) + 0.5f) * cell;
+			y = (static_cast<float>(i / side) + 0.5f) * cell;
+		} else {
+			// half a cell of margin keeps every copy inside the field
+			x = 0.5f * cell + unit(random) * (size - cell);
+			y = 0.5f * cell + unit(random) * (size - cell);
+			angle = unit(random) * 6.28318531f;
+			for (int c = 0; c < 3; c++) {
+				tint[c] = static_cast<uint8_t>(64 + unit(random) * 191.0f);
+			}
+		}
+		x += center[0] - 0.5f * size;
+		y += center[1] - 0.5f * size;
+
+		// translate(x, y, center.z) * rotateZ(angle) * scale * translate(-c)
+		float cosine = std::cos(angle) * scale;
+		float sine = std::sin(angle) * scale;
+		float *rows = instances[i].transform;
+		rows[0] = cosine;
+		rows[1] = -sine;
+		rows[2] = 0.0f;
+		rows[4] = sine;
+		rows[5] = cosine;
+		rows[6] = 0.0f;
+		rows[8] = 0.0f;
+		rows[9] = 0.0f;
+		rows[10] = scale;
+		float offset[3] = {x, y, center[2]};
+		for (int row = 0; row < 3; row++) {
+			float *r = rows + row * 4;
+			r[3] = offset[row] - (r[0] * center[0] + r[1] * center[1] +
+								  r[2] * center[2]);
+		}
+		std::copy(tint, tint + 4, instances[i].tint);
+	}
+	return instances;
+}
+
+class InstanceBenchmark {
+  public:
+	// * trianglesPerInstance only feeds the throughput column
+	void start(std::vector<uint32_t> counts, uint32_t warmupFrames,
+			   uint32_t measuredFrames, uint64_t trianglesPerInstance) {
+		this->counts = std::move(counts);
+		this->warmupFrames = warmupFrames;
+		this->measuredFrames = measuredFrames;
+		this->trianglesPerInstance = trianglesPerInstance;
+		results.assign(this->counts.size(), 0.0);
+		step = 0;
+		frame = 0;
+		milliseconds = 0.0;
+		begun = true;
+	}
+
+	bool started() const { return begun; }
+	bool running() const { return begun && step < counts.size(); }
+
+	// instance count of the current step
+	uint32_t instanceCount() const { return counts[step]; }
+
+	// * adds the time of one frame drawn with instanceCount() instances,
+	// * returns true when that moved on to the next step or finished
+	bool addFrame(double frameMilliseconds) {
+		if (frame++ < warmupFrames) {
+			return false;
+		}
+		milliseconds += frameMilliseconds;
+		if (frame < warmupFrames + measuredFrames) {
+			return false;
+		}
+		results[step] = milliseconds / measuredFrames;
+		step++;
+		frame = 0;
+		milliseconds = 0.0;
+		return true;
+	}
+
+	// * one line per step, e.g.
+	// *     10000 instances: 4.2 ms per frame, 1078.1 M triangles/s
+	void printResults(std::ostream &out) const {
+		for (size_t i = 0; i < step; i++) {
+			double triangles =
+				static_cast<double>(counts[i]) * trianglesPerInstance;
+			out << "    " << counts[i] << " instances: " << results[i]
+				<< " ms per frame, " << triangles / results[i] / 1000.0
+				<< " M triangles/s" << std::endl;
+		}
+	}
+
+  private:
+	std::vector<uint32_t> counts;
+	std::vector<double> results;
+	uint32_t warmupFrames = 0;
+	uint32_t measuredFrames = 0;
+	uint64_t trianglesPerInstance = 0;
+	size_t step = 0;
+	uint32_t frame = 0;
+	double milliseconds = 0.0;
+	bool begun = false;
+};
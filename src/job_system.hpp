@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+	Small fixed-size worker pool shared by the CPU side of the renderer.
+
+	submit() queues a single job and hands back a future for its result,
+	parallelFor() spreads body(i), i in [0, count), over the workers and the
+	calling thread and returns once every index has run. Exceptions thrown by
+	a job resurface from future::get() or from parallelFor() respectively.
+
+	parallelFor() may be nested inside a job (the caller just ends up doing
+	most of the work itself), blocking on a future from inside a job may
+	deadlock once every worker waits and should be avoided.
+
+	threadIndex() numbers the workers from 1, every other thread is 0, so
+	per-thread state (command pools, scratch buffers) can be kept in an
+	array of threadCount() entries. That needs a single JobSystem per
+	process, and only one outside thread may use such an array since all
+	of them are 0.
+*/
+class JobSystem {
+  public:
+	// threadCount includes the calling thread, 0 picks the core count
+	explicit JobSystem(unsigned threadCount = 0) {
+		if (threadCount == 0) {
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+		// * the thread calling parallelFor works too, so spawn one fewer
+		unsigned workerCount = std::max(1u, threadCount - 1);
+		workers.reserve(workerCount);
+		for (unsigned i = 0; i < workerCount; i++) {
+			workers.emplace_back([this, i]() {
+				currentThreadIndex() = i + 1;
+				workerLoop();
+			});
+		}
+	}
+
+	JobSystem(const JobSystem &) = delete;
+	JobSystem &operator=(const JobSystem &) = delete;
+
+	~JobSystem() {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		queueCondition.notify_all();
+		for (auto &worker : workers) {
+			worker.join();
+		}
+	}
+
+	unsigned threadCount() const {
+		return static_cast<unsigned>(workers.size()) + 1;
+	}
+
+	// 0 outside the pool, 1 to threadCount() - 1 on the workers
+	static unsigned threadIndex() { return currentThreadIndex(); }
+
+	template <typename F> auto submit(F &&job) -> std::future<decltype(job())> {
+		using Result = decltype(job());
+		auto task =
+			std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+		std::future<Result> future = task->get_future();
+		enqueue([task]() { (*task)(); });
+		return future;
+	}
+
+	void parallelFor(size_t count, const std::function<void(size_t)> &body) {
+		if (count == 0) {
+			return;
+		}
+		if (count == 1) {
+			body(0);
+			return;
+		}
+
+		// * helpers grab indices from a shared counter, a helper that only
+		// * gets scheduled after everything is done finds no index left and
+		// * never touches body, so body may live on the caller's stack
+		auto state = std::make_shared<ParallelForState>();
+		state->count = count;
+		state->body = &body;
+
+		auto run = [state]() {
+			size_t finished = 0;
+			size_t i;
+			while ((i = state->next.fetch_add(1)) < state->count) {
+				try {
+					(*state->body)(i);
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(state->mutex);
+					if (!state->error) {
+						state->error = std::current_exception();
+					}
+				}
+				finished++;
+			}
+			if (finished != 0 &&
+				state->done.fetch_add(finished) + finished == state->count) {
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->condition.notify_all();
+			}
+		};
+
+		size_t helpers = std::min(workers.size(), count - 1);
+		for (size_t i = 0; i < helpers; i++) {
+			enqueue(run);
+		}
+		run();
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->condition.wait(
+			lock, [&]() { return state->done.load() == state->count; });
+		if (state->error) {
+			std::rethrow_exception(state->error);
+		}
+	}
+
+  private:
+	struct ParallelForState {
+		std::atomic<size_t> next{0};
+		std::atomic<size_t> done{0};
+		size_t count = 0;
+		const std::function<void(size_t)> *body = nullptr;
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::exception_ptr error;
+	};
+
+	static unsigned &currentThreadIndex() {
+		static thread_local unsigned index = 0;
+		return index;
+	}
+
+	void enqueue(std::function<void()> job) {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			queue.push_back(std::move(job));
+		}
+		queueCondition.notify_one();
+	}
+
+	void workerLoop() {
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueCondition.wait(
+					lock, [this]() { return stopping || !queue.empty(); });
+				if (queue.empty()) {
+					return;
+				}
+				job = std::move(queue.front());
+				queue.pop_front();
+			}
+			job();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> queue;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	bool stopping = false;
+};
@@ -23,6 +23,14 @@
 #include <stdexcept>
 #include <vector>
 
+#include "device_allocator.hpp"
+#include "job_system.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_compiler.hpp"
+#include "staging_ring.hpp"
+#include "upload_batch.hpp"
+#include "workgroup_tuner.hpp"
+
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
@@ -30,6 +38,23 @@ const uint32_t PARTICLE_COUNT = 1280;
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// persistently mapped ring all uploads are staged through
+const VkDeviceSize STAGING_RING_SIZE = 4 * 1024 * 1024;
+
+// driver compiled pipelines, reused by the next run
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache_compute.bin";
+
+// particle workgroup size (a specialization constant of the compute shader)
+// until the autotuner picked one for this device
+const uint32_t DEFAULT_WORKGROUP_SIZE = 256;
+// smallest candidate when the subgroup size cannot be queried
+const uint32_t FALLBACK_SUBGROUP_SIZE = 32;
+// benchmark the candidate sizes on devices without a stored result,
+// FORCE_WORKGROUP_AUTOTUNE re-runs the benchmark on every launch
+const bool ENABLE_WORKGROUP_AUTOTUNE = true;
+const bool FORCE_WORKGROUP_AUTOTUNE = false;
+const std::string WORKGROUP_TUNING_PATH = "workgroup_tuning.txt";
+
 const std::vector<const char *> validationLayers = {
 	"VK_LAYER_KHRONOS_validation"};
 
@@ -136,6 +161,7 @@ class ComputeShaderApplication {
 
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	VkDevice device;
+	DeviceAllocator deviceAllocator;
 
 	VkQueue graphicsQueue;
 	VkQueue computeQueue;
@@ -150,19 +176,30 @@ class ComputeShaderApplication {
 
 	VkRenderPass renderPass;
 	VkPipelineLayout pipelineLayout;
-	VkPipeline graphicsPipeline;
+	PipelineRequest graphicsPipeline;
 
 	VkDescriptorSetLayout computeDescriptorSetLayout;
 	VkPipelineLayout computePipelineLayout;
-	VkPipeline computePipeline;
+	PipelineRequest computePipeline;
+	uint32_t workgroupSize = DEFAULT_WORKGROUP_SIZE;
+	WorkgroupTuner workgroupTuner;
+	uint32_t timestampValidBits = 0;
+	bool physicalDeviceProperties2 = false;
+
+	PipelineCache pipelineCache;
+	PipelineCompiler pipelineCompiler;
+	bool pipelinesReported = false;
+	JobSystem jobSystem;
 
 	VkCommandPool commandPool;
 
+	StagingRing stagingRing;
+
 	std::vector<VkBuffer> shaderStorageBuffers;
-	std::vector<VkDeviceMemory> shaderStorageBuffersMemory;
+	std::vector<DeviceAllocation> shaderStorageBuffersMemory;
 
 	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
+	std::vector<DeviceAllocation> uniformBuffersMemory;
 	std::vector<void *> uniformBuffersMapped;
 
 	VkDescriptorPool descriptorPool;
@@ -209,18 +246,35 @@ class ComputeShaderApplication {
 		createSurface();
 		pickPhysicalDevice();
 		createLogicalDevice();
+		deviceAllocator.create(device, physicalDevice);
 		createSwapChain();
 		createImageViews();
 		createRenderPass();
 		createComputeDescriptorSetLayout();
-		createGraphicsPipeline();
-		createComputePipeline();
+		pipelineCache.create(device, physicalDevice, PIPELINE_CACHE_PATH);
+		// both compile in parallel on the workers, frames skip the dispatch
+		// and the draw until they are ready
+		pipelineCompiler.create(device, jobSystem);
+		graphicsPipeline = pipelineCompiler.request(
+			[this]() { return createGraphicsPipeline(); });
+		createComputePipelineLayout();
+		// * a stored (or the default) workgroup size compiles right away, an
+		// * autotune run needs the particle buffers and comes further down
+		bool autotune = selectWorkgroupSize();
+		if (!autotune) {
+			requestComputePipeline();
+		}
 		createFramebuffers();
 		createCommandPool();
+		stagingRing.create(device, deviceAllocator, STAGING_RING_SIZE);
 		createShaderStorageBuffers();
 		createUniformBuffers();
 		createDescriptorPool();
 		createComputeDescriptorSets();
+		if (autotune) {
+			autotuneWorkgroupSize();
+			requestComputePipeline();
+		}
 		createCommandBuffers();
 		createComputeCommandBuffers();
 		createSyncObjects();
@@ -229,6 +283,7 @@ class ComputeShaderApplication {
 	void mainLoop() {
 		while (!glfwWindowShouldClose(window)) {
 			glfwPollEvents();
+			updatePipelines();
 			drawFrame();
 			// We want to animate the particle system using the last frames time
 			// to get smooth, frame-rate independent animation
@@ -240,6 +295,18 @@ class ComputeShaderApplication {
 		vkDeviceWaitIdle(device);
 	}
 
+	// reports once both pipelines finished compiling
+	void updatePipelines() {
+		if (pipelinesReported || pipelineCompiler.pendingCount() != 0) {
+			return;
+		}
+		std::cout << "[INFO] pipelines ready "
+				  << pipelineCompiler.batchMilliseconds()
+				  << " ms after they were requested" << std::endl;
+		pipelineCache.printStats(std::cout);
+		pipelinesReported = true;
+	}
+
 	void cleanupSwapChain() {
 		for (auto framebuffer : swapChainFramebuffers) {
 			vkDestroyFramebuffer(device, framebuffer, nullptr);
@@ -253,19 +320,23 @@ class ComputeShaderApplication {
 	}
 
 	void cleanup() {
+		std::cout << "[INFO] device memory at cleanup" << std::endl;
+		deviceAllocator.printReport(std::cout);
+
 		cleanupSwapChain();
 
-		vkDestroyPipeline(device, graphicsPipeline, nullptr);
+		pipelineCompiler.destroy();
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-
-		vkDestroyPipeline(device, computePipeline, nullptr);
 		vkDestroyPipelineLayout(device, computePipelineLayout, nullptr);
 
 		vkDestroyRenderPass(device, renderPass, nullptr);
 
+		pipelineCache.save();
+		pipelineCache.destroy();
+
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 			vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-			vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+			deviceAllocator.free(uniformBuffersMemory[i]);
 		}
 
 		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
@@ -275,9 +346,11 @@ class ComputeShaderApplication {
 
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 			vkDestroyBuffer(device, shaderStorageBuffers[i], nullptr);
-			vkFreeMemory(device, shaderStorageBuffersMemory[i], nullptr);
+			deviceAllocator.free(shaderStorageBuffersMemory[i]);
 		}
 
+		stagingRing.destroy();
+
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 			vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
 			vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
@@ -288,6 +361,8 @@ class ComputeShaderApplication {
 
 		vkDestroyCommandPool(device, commandPool, nullptr);
 
+		deviceAllocator.reportLeaks(std::cout);
+		deviceAllocator.destroy();
 		vkDestroyDevice(device, nullptr);
 
 		if (enableValidationLayers) {
@@ -638,7 +713,8 @@ class ComputeShaderApplication {
 		}
 	}
 
-	void createGraphicsPipeline() {
+	// * runs on a JobSystem worker, see PipelineCompiler
+	VkPipeline createGraphicsPipeline() {
 		auto vertShaderCode = readFile("../shaders/31_shader_compute_vert.spv");
 		auto fragShaderCode = readFile("../shaders/31_shader_compute_frag.spv");
 
@@ -767,53 +843,89 @@ class ComputeShaderApplication {
 		pipelineInfo.subpass = 0;
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
-									  nullptr,
-									  &graphicsPipeline) != VK_SUCCESS) {
+		VkPipeline pipeline;
+		if (pipelineCache.createGraphicsPipeline(pipelineInfo, &pipeline) !=
+			VK_SUCCESS) {
 			throw std::runtime_error("failed to create graphics pipeline!");
 		}
 
 		vkDestroyShaderModule(device, fragShaderModule, nullptr);
 		vkDestroyShaderModule(device, vertShaderModule, nullptr);
+		return pipeline;
 	}
 
-	void createComputePipeline() {
+	void createComputePipelineLayout() {
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &computeDescriptorSetLayout;
+
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+								   &computePipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to create compute pipeline layout!");
+		}
+	}
+
+	void requestComputePipeline() {
+		uint32_t size = workgroupSize;
+		computePipeline = pipelineCompiler.request(
+			[this, size]() { return createComputePipeline(size); });
+	}
+
+	// * runs on a JobSystem worker, see PipelineCompiler, and on the main
+	// * thread for every autotune candidate
+	VkPipeline createComputePipeline(uint32_t workgroupSize) {
 		auto computeShaderCode =
 			readFile("../shaders/31_shader_compute_comp.spv");
 
 		VkShaderModule computeShaderModule =
 			createShaderModule(computeShaderCode);
 
+		// * constant_id 0 is local_size_x, 1 bounds the last workgroup
+		struct ComputeSpecialization {
+			uint32_t workgroupSize;
+			uint32_t particleCount;
+		} specialization{workgroupSize, PARTICLE_COUNT};
+		std::array<VkSpecializationMapEntry, 2> specializationEntries{};
+		specializationEntries[0].constantID = 0;
+		specializationEntries[0].offset =
+			offsetof(ComputeSpecialization, workgroupSize);
+		specializationEntries[0].size = sizeof(uint32_t);
+		specializationEntries[1].constantID = 1;
+		specializationEntries[1].offset =
+			offsetof(ComputeSpecialization, particleCount);
+		specializationEntries[1].size = sizeof(uint32_t);
+
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount =
+			static_cast<uint32_t>(specializationEntries.size());
+		specializationInfo.pMapEntries = specializationEntries.data();
+		specializationInfo.dataSize = sizeof(specialization);
+		specializationInfo.pData = &specialization;
+
 		VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
 		computeShaderStageInfo.sType =
 			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
 		computeShaderStageInfo.module = computeShaderModule;
 		computeShaderStageInfo.pName = "main";
-
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType =
-			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 1;
-		pipelineLayoutInfo.pSetLayouts = &computeDescriptorSetLayout;
-
-		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
-								   &computePipelineLayout) != VK_SUCCESS) {
-			throw std::runtime_error(
-				"failed to create compute pipeline layout!");
-		}
+		computeShaderStageInfo.pSpecializationInfo = &specializationInfo;
 
 		VkComputePipelineCreateInfo pipelineInfo{};
 		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
 		pipelineInfo.layout = computePipelineLayout;
 		pipelineInfo.stage = computeShaderStageInfo;
 
-		if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
-									 nullptr, &computePipeline) != VK_SUCCESS) {
+		VkPipeline pipeline;
+		if (pipelineCache.createComputePipeline(pipelineInfo, &pipeline) !=
+			VK_SUCCESS) {
 			throw std::runtime_error("failed to create compute pipeline!");
 		}
 
 		vkDestroyShaderModule(device, computeShaderModule, nullptr);
+		return pipeline;
 	}
 
 	void createFramebuffers() {
@@ -875,23 +987,8 @@ class ComputeShaderApplication {
 
 		VkDeviceSize bufferSize = sizeof(Particle) * PARTICLE_COUNT;
 
-		// Create a staging buffer used to upload data to the gpu
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					 stagingBuffer, stagingBufferMemory);
-
-		void *data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, particles.data(), (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
-
 		shaderStorageBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 		shaderStorageBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-
-		// Copy initial particle data to all storage buffers
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 			createBuffer(bufferSize,
 						 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
@@ -899,12 +996,59 @@ class ComputeShaderApplication {
 							 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 						 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 						 shaderStorageBuffers[i],
-						 shaderStorageBuffersMemory[i]);
-			copyBuffer(stagingBuffer, shaderStorageBuffers[i], bufferSize);
+						 shaderStorageBuffersMemory[i],
+						 DeviceAllocationStrategy::Linear);
+		}
+
+		// Stream the initial particle data through the staging ring, each
+		// chunk is staged once and copied to all storage buffers. All copies
+		// go into one batch, submitted once and waited on with one fence
+		const char *source = reinterpret_cast<const char *>(particles.data());
+		UploadBatch uploads;
+		uploads.begin(device, commandPool);
+		stagingRing.setFlush([&]() {
+			uploads.submit(graphicsQueue, stagingRing.submitFence());
+			uploads.wait();
+			uploads.begin(device, commandPool);
+		});
+		stagingRing.stream(
+			bufferSize, sizeof(Particle),
+			[&](void *data, VkDeviceSize offset, VkDeviceSize bytes) {
+				memcpy(data, source + offset, (size_t)bytes);
+			},
+			[&](const StagingAllocation &staging, VkDeviceSize offset) {
+				for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+					copyBuffer(uploads.record(), staging.buffer,
+							   staging.offset, shaderStorageBuffers[i], offset,
+							   staging.size);
+				}
+			});
+
+		// one merged barrier makes the copies visible to the compute and
+		// vertex stages
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			VkBufferMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+									VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer = shaderStorageBuffers[i];
+			barrier.size = VK_WHOLE_SIZE;
+			uploads.bufferBarrier(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT,
+								  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+									  VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 		}
 
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		uploads.submit(graphicsQueue, stagingRing.submitFence());
+		uploads.wait();
+		uploads.destroy();
+		stagingRing.setFlush(nullptr);
+		std::cout << "[INFO] particle upload: " << uploads.operationCount()
+				  << " upload operations in " << uploads.submitCount()
+				  << " submits, " << uploads.waitMilliseconds()
+				  << " ms stalled" << std::endl;
 	}
 
 	void createUniformBuffers() {
@@ -918,10 +1062,9 @@ class ComputeShaderApplication {
 			createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 						 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-						 uniformBuffers[i], uniformBuffersMemory[i]);
-
-			vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0,
-						&uniformBuffersMapped[i]);
+						 uniformBuffers[i], uniformBuffersMemory[i],
+						 DeviceAllocationStrategy::Linear);
+			uniformBuffersMapped[i] = uniformBuffersMemory[i].mapped;
 		}
 	}
 
@@ -1018,7 +1161,9 @@ class ComputeShaderApplication {
 
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 					  VkMemoryPropertyFlags properties, VkBuffer &buffer,
-					  VkDeviceMemory &bufferMemory) {
+					  DeviceAllocation &bufferMemory,
+					  DeviceAllocationStrategy strategy =
+						  DeviceAllocationStrategy::General) {
 		VkBufferCreateInfo bufferInfo{};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferInfo.size = size;
@@ -1033,67 +1178,22 @@ class ComputeShaderApplication {
 		VkMemoryRequirements memRequirements;
 		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex =
-			findMemoryType(memRequirements.memoryTypeBits, properties);
-
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) !=
-			VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate buffer memory!");
-		}
+		bufferMemory = deviceAllocator.allocate(
+			memRequirements, properties, DeviceResourceKind::Buffer,
+			bufferMemoryCategory(usage), strategy);
 
-		vkBindBufferMemory(device, buffer, bufferMemory, 0);
+		vkBindBufferMemory(device, buffer, bufferMemory.memory,
+						   bufferMemory.offset);
 	}
 
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = commandPool;
-		allocInfo.commandBufferCount = 1;
-
-		VkCommandBuffer commandBuffer;
-		vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-		vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
+	void copyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer,
+					VkDeviceSize srcOffset, VkBuffer dstBuffer,
+					VkDeviceSize dstOffset, VkDeviceSize size) {
 		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = srcOffset;
+		copyRegion.dstOffset = dstOffset;
 		copyRegion.size = size;
 		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-		vkEndCommandBuffer(commandBuffer);
-
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-
-		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphicsQueue);
-
-		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-	}
-
-	uint32_t findMemoryType(uint32_t typeFilter,
-							VkMemoryPropertyFlags properties) {
-		VkPhysicalDeviceMemoryProperties memProperties;
-		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-			if ((typeFilter & (1 << i)) &&
-				(memProperties.memoryTypes[i].propertyFlags & properties) ==
-					properties) {
-				return i;
-			}
-		}
-
-		throw std::runtime_error("failed to find suitable memory type!");
 	}
 
 	void createCommandBuffers() {
@@ -1152,8 +1252,16 @@ class ComputeShaderApplication {
 		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
 							 VK_SUBPASS_CONTENTS_INLINE);
 
+		VkPipeline pipeline = pipelineCompiler.get(graphicsPipeline);
+		if (pipeline == VK_NULL_HANDLE) {
+			vkCmdEndRenderPass(commandBuffer);
+			if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to record command buffer!");
+			}
+			return;
+		}
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-						  graphicsPipeline);
+						  pipeline);
 
 		VkViewport viewport{};
 		viewport.x = 0.0f;
@@ -1191,22 +1299,142 @@ class ComputeShaderApplication {
 				"failed to begin recording compute command buffer!");
 		}
 
+		// * the empty submission still signals computeFinishedSemaphores,
+		// * particles stay where they are until the pipeline is ready
+		VkPipeline pipeline = pipelineCompiler.get(computePipeline);
+		if (pipeline != VK_NULL_HANDLE) {
+			dispatchParticles(commandBuffer, pipeline, workgroupSize,
+							  currentFrame);
+		}
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to record compute command buffer!");
+		}
+	}
+
+	void dispatchParticles(VkCommandBuffer commandBuffer, VkPipeline pipeline,
+						   uint32_t workgroupSize, uint32_t frame) {
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-						  computePipeline);
+						  pipeline);
 
 		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
 								computePipelineLayout, 0, 1,
-								&computeDescriptorSets[currentFrame], 0,
-								nullptr);
+								&computeDescriptorSets[frame], 0, nullptr);
 
-		vkCmdDispatch(commandBuffer, PARTICLE_COUNT / 256, 1, 1);
+		uint32_t groupCount =
+			(PARTICLE_COUNT + workgroupSize - 1) / workgroupSize;
+		vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+	}
 
-		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-			throw std::runtime_error(
-				"failed to record compute command buffer!");
+	// * picks the stored size for this device or the default, returns true
+	// * when the candidates should be benchmarked instead
+	bool selectWorkgroupSize() {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		workgroupTuner.create(WORKGROUP_TUNING_PATH, properties,
+							  "particles" + std::to_string(PARTICLE_COUNT));
+
+		uint32_t storedSize;
+		if (!FORCE_WORKGROUP_AUTOTUNE && workgroupTuner.load(storedSize)) {
+			workgroupSize = storedSize;
+			std::cout << "[INFO] workgroup size " << workgroupSize
+					  << " (tuned for this device)" << std::endl;
+			return false;
+		}
+
+		// * 256 is above the guaranteed minimum of 128 invocations
+		const VkPhysicalDeviceLimits &limits = properties.limits;
+		workgroupSize = std::min({DEFAULT_WORKGROUP_SIZE,
+								  limits.maxComputeWorkGroupSize[0],
+								  limits.maxComputeWorkGroupInvocations});
+		if (!ENABLE_WORKGROUP_AUTOTUNE) {
+			return false;
+		}
+
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+												 nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+												 families.data());
+		QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+		timestampValidBits =
+			families[indices.graphicsAndComputeFamily.value()]
+				.timestampValidBits;
+		if (timestampValidBits == 0) {
+			std::cout << "[INFO] workgroup size " << workgroupSize
+					  << ", no timestamps to autotune with" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// * benchmarks every candidate size on the compute queue, takes a moment
+	// * but only runs once per device and driver
+	void autotuneWorkgroupSize() {
+		std::cout << "[INFO] autotuning the particle workgroup size"
+				  << std::endl;
+
+		// * particles must not move while the benchmark runs the kernel
+		UniformBufferObject still{};
+		still.deltaTime = 0.0f;
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			memcpy(uniformBuffersMapped[i], &still, sizeof(still));
+		}
+
+		// * no power of two from the subgroup size fits the device limits,
+		// * keep the default selectWorkgroupSize picked
+		std::vector<uint32_t> sizes =
+			workgroupTuner.candidates(querySubgroupSize());
+		if (sizes.empty()) {
+			std::cout << "    no candidate sizes, keeping " << workgroupSize
+					  << std::endl;
+			return;
+		}
+
+		WorkgroupTuning best = workgroupTuner.tune(
+			device, computeQueue, commandPool, timestampValidBits, sizes,
+			[this](uint32_t size) { return createComputePipeline(size); },
+			[this](VkCommandBuffer commandBuffer, VkPipeline pipeline,
+				   uint32_t size) {
+				dispatchParticles(commandBuffer, pipeline, size, 0);
+			});
+		workgroupSize = best.size;
+		std::cout << "    picked " << workgroupSize << ", " << best.microseconds
+				  << " us per dispatch" << std::endl;
+		if (!workgroupTuner.save(best)) {
+			std::cout << "    could not write " << WORKGROUP_TUNING_PATH
+					  << std::endl;
 		}
 	}
 
+	// * VkPhysicalDeviceSubgroupProperties is core 1.1, this 1.0 instance
+	// * reaches it through VK_KHR_get_physical_device_properties2
+	uint32_t querySubgroupSize() {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		if (!physicalDeviceProperties2 ||
+			properties.apiVersion < VK_API_VERSION_1_1) {
+			return FALLBACK_SUBGROUP_SIZE;
+		}
+
+		auto getProperties2 =
+			reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+				vkGetInstanceProcAddr(instance,
+									  "vkGetPhysicalDeviceProperties2KHR"));
+		VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+		subgroupProperties.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+		VkPhysicalDeviceProperties2KHR properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+		properties2.pNext = &subgroupProperties;
+		getProperties2(physicalDevice, &properties2);
+		return subgroupProperties.subgroupSize != 0
+				   ? subgroupProperties.subgroupSize
+				   : FALLBACK_SUBGROUP_SIZE;
+	}
+
 	void createSyncObjects() {
 		imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 		renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
@@ -1521,6 +1749,22 @@ class ComputeShaderApplication {
 			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 		}
 
+		// * needed to query the subgroup size on a 1.0 instance
+		uint32_t extensionCount = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount,
+											   nullptr);
+		std::vector<VkExtensionProperties> available(extensionCount);
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount,
+											   available.data());
+		const char *properties2 =
+			VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+		for (const auto &extension : available) {
+			if (strcmp(extension.extensionName, properties2) == 0) {
+				extensions.push_back(properties2);
+				physicalDeviceProperties2 = true;
+			}
+		}
+
 		return extensions;
 	}
 
@@ -5,6 +5,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <future>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <vector>
@@ -31,6 +33,29 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tinyobj/tiny_obj_loader.h"
 
+#include "bindless_textures.hpp"
+#include "depth_pyramid.hpp"
+#include "descriptor_allocator.hpp"
+#include "frustum_culling.hpp"
+#include "gpu_culling.hpp"
+#include "instancing.hpp"
+#include "job_system.hpp"
+#include "mesh_builder.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlet.hpp"
+#include "obj_parser.hpp"
+#include "occlusion_queries.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_compiler.hpp"
+#include "secondary_recorder.hpp"
+#include "device_allocator.hpp"
+#include "staging_ring.hpp"
+#include "upload_batch.hpp"
+#include "vertex_layout.hpp"
+#include "vertex_quantization.hpp"
+
 const int MAX_FRAMES_IN_FLIGHT = 3;
 
 const uint32_t HEIGHT = 600;
@@ -39,6 +64,119 @@ const uint32_t WIDTH = 800;
 const std::string MODEL_PATH = "../media/models/viking_room.obj";
 const std::string TEXTURE_PATH = "../media/textures/viking_room.png";
 
+// the floor quad drawn while the model and texture are still loading
+const uint32_t PLACEHOLDER_INDEX_COUNT = 6;
+
+// * every upload is staged through one persistently mapped ring, larger
+// * assets stream through it in chunks of at most half its size
+const VkDeviceSize STAGING_RING_SIZE = 16 * 1024 * 1024;
+
+// per heap and category device memory usage, written when M is pressed
+const std::string MEMORY_REPORT_PATH = "memory_report.csv";
+
+// driver compiled pipelines, validated against the device and reused by the
+// next run
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+// * bump whenever Vertex or the mesh processing in loadModel changes, so
+// * caches written by an older build are rebuilt instead of misread
+const std::string MODEL_CACHE_PATH = MODEL_PATH + ".meshcache";
+const uint32_t MODEL_CACHE_FORMAT_VERSION = 6;
+
+// * OBJ files at least this large go through the parallel parser, smaller
+// * ones are not worth spinning up the workers and keep using tinyobj
+const uint64_t PARALLEL_OBJ_THRESHOLD = 16 * 1024 * 1024;
+
+// * reorder the loaded mesh for the post-transform cache and vertex fetch,
+// * the overdraw pass additionally sorts clusters front to back
+const bool OPTIMIZE_MODEL = true;
+const bool OPTIMIZE_MODEL_OVERDRAW = true;
+
+// * split the model into meshlets and only draw the ones inside the frustum
+// * (and, when back faces are culled, facing the camera) via indirect draws
+const bool ENABLE_MESHLET_CULLING = true;
+
+// * record the meshlet draws into secondary command buffers on the job
+// * system workers once at least 2 * PARALLEL_RECORD_MIN_DRAWS meshlets are
+// * visible, each worker gets a chunk of PARALLEL_RECORD_MIN_DRAWS draws or
+// * more. Visible neighbours then stay separate draws instead of merging.
+// * Static command buffers are recorded the same way and keep their
+// * secondaries until they are recorded again
+const bool PARALLEL_COMMAND_RECORDING = true;
+const uint32_t PARALLEL_RECORD_MIN_DRAWS = 16;
+
+// * keep one pre-recorded command buffer per swapchain image and frame in
+// * flight and only re-record it when what it draws changed, instead of
+// * recording every frame
+const bool STATIC_COMMAND_BUFFERS = true;
+// the model is open (viking_room's walls are seen from behind), so back faces
+// stay visible and meshlet cone culling is only used when this culls them
+const VkCullModeFlags MODEL_CULL_MODE = VK_CULL_MODE_NONE;
+
+// * simplify the model into a chain of LODs sharing its vertex buffer and
+// * draw the coarsest one whose error projects to at most this many pixels
+const bool ENABLE_MODEL_LODS = true;
+const float LOD_PIXEL_ERROR = 1.0f;
+// attribute differences are charged like this fraction of the model extent
+// per unit of normal / texture coordinate change
+const float LOD_NORMAL_WEIGHT = 0.02f;
+const float LOD_TEXCOORD_WEIGHT = 0.1f;
+
+// * copies of the model drawn by one instanced draw, spread over a field the
+// * size of the model and scaled down to fit (see instancing.hpp). With more
+// * than one the meshlet path is skipped, its culling tests a single copy
+const uint32_t INSTANCE_COUNT = 1;
+const InstanceDistribution INSTANCE_DISTRIBUTION = InstanceDistribution::Grid;
+
+// * once the model is loaded, draw it with each of these instance counts in
+// * turn at LOD 0 and print the average frame time of every step
+const bool INSTANCE_BENCHMARK = false;
+const std::vector<uint32_t> INSTANCE_BENCHMARK_COUNTS = {1,	   10,	  100,
+														 1000, 10000, 100000};
+const uint32_t INSTANCE_BENCHMARK_WARMUP_FRAMES = 60;
+const uint32_t INSTANCE_BENCHMARK_FRAMES = 300;
+
+// * frustum cull the instances in a compute pass that writes the indirect
+// * draws for the visible ones (see gpu_culling.hpp), instead of drawing
+// * every instance. Needs drawIndirectFirstInstance, the draw count comes
+// * from the GPU when VK_KHR_draw_indirect_count is there
+const bool GPU_INSTANCE_CULLING = true;
+// * on top of it, test the instances against a depth pyramid in two phases
+// * around a rebuild of the pyramid (see depth_pyramid.hpp and GpuCuller),
+// * the frame is then drawn in two render passes
+const bool OCCLUSION_CULLING = true;
+
+// * the cheaper path for a few heavy objects, used whenever the instances
+// * are not GPU culled and there are at most OCCLUSION_QUERY_MAX_OBJECTS:
+// * every instance's bounding box is tested with an occlusion query and
+// * the instance skipped while a query of an earlier frame found it hidden
+// * (see occlusion_queries.hpp), on the GPU with VK_EXT_conditional_rendering
+const bool OCCLUSION_QUERIES = true;
+const uint32_t OCCLUSION_QUERY_MAX_OBJECTS = 16;
+
+// * sample every texture from one global array (see bindless_textures.hpp)
+// * indexed by a per-draw material id, instead of a texture binding in the
+// * per-frame set. Needs VK_EXT_descriptor_indexing, the array holds at
+// * most this many textures
+const bool BINDLESS_TEXTURES = true;
+const uint32_t BINDLESS_TEXTURE_CAPACITY = 4096;
+
+// * where the model stands in the world, pushed with its draws (see
+// * DrawConstants). It stays put and the camera orbits it instead, so
+// * pre-recorded command buffers keep valid constants from frame to frame
+const glm::mat4 MODEL_TRANSFORM = glm::mat4(1.0f);
+
+// * time the CPU frustum culling (see frustum_culling.hpp) on this many
+// * random spheres at startup and print objects/ms of the scalar, SIMD and
+// * multithreaded paths, next to the GPU culling time in the FPS line
+const bool FRUSTUM_CULL_BENCHMARK = false;
+const size_t FRUSTUM_CULL_BENCHMARK_COUNT = 1000000;
+
+// point light of shader.vert, baked in as specialization constants
+const glm::vec3 LIGHT_POSITION = glm::vec3(0.0f, 0.0f, 10.0f);
+const glm::vec3 LIGHT_COLOR = glm::vec3(1.0f, 0.95f, 0.8f);
+const float LIGHT_INTENSITY = 50.0f;
+
 const std::vector<const char *> validationLayers = {
 	"VK_LAYER_KHRONOS_validation"};
 const std::vector<const char *> deviceExtensions = {"VK_KHR_swapchain"};
@@ -70,6 +208,7 @@ class HelloTriangleApplication {
 		window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
 		glfwSetWindowUserPointer(window, this);
 		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+		glfwSetKeyCallback(window, keyCallback);
 	}
 
 	static void framebufferResizeCallback(GLFWwindow *window, int width,
@@ -79,6 +218,21 @@ class HelloTriangleApplication {
 		app->framebufferResized = true;
 	}
 
+	// M prints the device memory report and exports it as CSV
+	static void keyCallback(GLFWwindow *window, int key, int /*scancode*/,
+							int action, int /*mods*/) {
+		auto app = reinterpret_cast<HelloTriangleApplication *>(
+			glfwGetWindowUserPointer(window));
+		if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+			std::cout << "[INFO] device memory" << std::endl;
+			app->deviceAllocator.printReport(std::cout);
+			if (app->deviceAllocator.exportReport(MEMORY_REPORT_PATH)) {
+				std::cout << "    written to " << MEMORY_REPORT_PATH
+						  << std::endl;
+			}
+		}
+	}
+
 	void initVulkan() {
 		std::cout << "[INFO] initVulkan - createInstance()" << std::endl;
 		createInstance();
@@ -95,6 +249,17 @@ class HelloTriangleApplication {
 		std::cout << "[INFO] initVulkan - createLogicalDevice()" << std::endl;
 		createLogicalDevice();
 
+		std::cout << "[INFO] initVulkan - createDeviceAllocator()"
+				  << std::endl;
+		deviceAllocator.create(device, physicalDevice);
+		if (memoryBudgetSupported) {
+			deviceAllocator.enableBudget(
+				physicalDevice,
+				reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+					vkGetInstanceProcAddr(
+						instance, "vkGetPhysicalDeviceMemoryProperties2KHR")));
+		}
+
 		std::cout << "[INFO] initVulkan - createSwapChain()" << std::endl;
 		createSwapChain();
 
@@ -108,52 +273,114 @@ class HelloTriangleApplication {
 				  << std::endl;
 		createDescriptorSetLayout();
 
-		std::cout << "[INFO] initVulkan - createGraphicsPipeline()"
+		std::cout << "[INFO] initVulkan - createPipelineCache()" << std::endl;
+		pipelineCache.create(device, physicalDevice, PIPELINE_CACHE_PATH);
+
+		std::cout << "[INFO] initVulkan - createPipelineLayout()" << std::endl;
+		createPipelineLayout();
+
+		// * compiled on the workers, frames only clear the screen until
+		// * recordCommandBuffer gets the pipeline from the compiler. Requested
+		// * before startAssetLoad so the loader does not hold up the workers
+		std::cout << "[INFO] initVulkan - requestGraphicsPipeline()"
 				  << std::endl;
-		createGraphicsPipeline();
+		pipelineCompiler.create(device, jobSystem);
+		graphicsPipeline = pipelineCompiler.request(
+			[this]() { return createGraphicsPipeline(); });
+
+		if (gpuCulling) {
+			std::cout << "[INFO] initVulkan - createGpuCuller()" << std::endl;
+			createGpuCuller();
+			cullPipeline = pipelineCompiler.request(
+				[this]() { return createCullPipeline(); });
+		}
+		if (occlusionCulling) {
+			depthReducePipeline = pipelineCompiler.request(
+				[this]() { return createDepthReducePipeline(); });
+		}
+		if (OCCLUSION_QUERIES) {
+			std::cout << "[INFO] initVulkan - createOcclusionQueries()"
+					  << std::endl;
+			createOcclusionQueries();
+			occlusionProxyPipeline = pipelineCompiler.request(
+				[this]() { return createOcclusionProxyPipeline(); });
+		}
 
 		std::cout << "[INFO] initVulkan - createCommandPool()" << std::endl;
 		createCommandPool();
 
+		// * one-off uploads below are recorded into a single command buffer
+		// * and submitted once after createPlaceholderAssets
+		UploadBatch uploads;
+		uploads.begin(device, commandPool);
+
 		std::cout << "[INFO] initVulkan - createDepthResources()" << std::endl;
-		createDepthResources();
+		createDepthResources(uploads);
+		if (gpuCulling) {
+			std::cout << "[INFO] initVulkan - createDepthPyramid()"
+					  << std::endl;
+			createDepthPyramid(uploads);
+		}
 
 		std::cout << "[INFO] initVulkan - createFrameBuffers()" << std::endl;
 		createFrameBuffers();
 
-		std::cout << "[INFO] initVulkan - createTextureImage()" << std::endl;
-		createTextureImage();
-
-		std::cout << "[INFO] initVulkan - createTextureImageView()"
-				  << std::endl;
-		createTextureImageView();
-
-		std::cout << "[INFO] initVulkan - loadModel()" << std::endl;
-		loadModel();
-
 		std::cout << "[INFO] initVulkan - createTextureSampler()" << std::endl;
 		createTextureSampler();
 
-		std::cout << "[INFO] initVulkan - createVertexBuffer()" << std::endl;
-		createVertexBuffer();
+		std::cout << "[INFO] initVulkan - createStagingRing()" << std::endl;
+		stagingRing.create(device, deviceAllocator, STAGING_RING_SIZE);
 
-		std::cout << "[INFO] initVulkan - createIndexBuffer()" << std::endl;
-		createIndexBuffer();
+		std::cout << "[INFO] initVulkan - createPlaceholderAssets()"
+				  << std::endl;
+		createPlaceholderAssets(uploads);
+
+		std::cout << "[INFO] initVulkan - createInstanceBuffer()" << std::endl;
+		writeInstances(uploads, INSTANCE_COUNT);
+		if (gpuCulling) {
+			gpuCuller.resetQueries(uploads.record());
+		}
+		if (OCCLUSION_QUERIES) {
+			occlusionQueries.resetQueries(uploads.record());
+		}
+
+		std::cout << "[INFO] initVulkan - submitUploads()" << std::endl;
+		submitUploads(uploads);
+		deviceAllocator.printReport(std::cout);
 
 		std::cout << "[INFO] initVulkan - createUniformBuffers()" << std::endl;
 		createUniformBuffers();
 
-		std::cout << "[INFO] initVulkan - createDescriptorPool()" << std::endl;
-		createDescriptorPool();
+		std::cout << "[INFO] initVulkan - createDescriptorAllocators()"
+				  << std::endl;
+		createDescriptorAllocators();
 
 		std::cout << "[INFO] initVulkan - createDescriptorSets()" << std::endl;
 		createDescriptorSets();
 
 		std::cout << "[INFO] initVulkan - createCommandBuffers()" << std::endl;
 		createCommandBuffers();
+		if (STATIC_COMMAND_BUFFERS) {
+			createStaticCommandBuffers();
+		} else {
+			secondaryRecorder.create(device, graphicsQueueFamily,
+									 jobSystem.threadCount(),
+									 MAX_FRAMES_IN_FLIGHT, false);
+		}
 
 		std::cout << "[INFO] initVulkan - createSyncObjects()" << std::endl;
 		createSyncObjects();
+
+		if (FRUSTUM_CULL_BENCHMARK) {
+			std::cout << "[INFO] initVulkan - benchmarkFrustumCulling()"
+					  << std::endl;
+			runFrustumCullBenchmark();
+		}
+
+		// * texture and model are decoded and uploaded in the background,
+		// * frames show the placeholder until updateAssetLoad swaps them in
+		std::cout << "[INFO] initVulkan - startAssetLoad()" << std::endl;
+		startAssetLoad();
 	}
 
 	struct QueueFamilyIndices {
@@ -163,6 +390,9 @@ class HelloTriangleApplication {
 		*/
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentFamily;
+		// a transfer-only family (DMA engine) when the device has one,
+		// otherwise the graphics family
+		std::optional<uint32_t> transferFamily;
 
 		bool isComplete() {
 			return graphicsFamily.has_value() && presentFamily.has_value();
@@ -175,56 +405,74 @@ class HelloTriangleApplication {
 		std::vector<VkPresentModeKHR> presentModes;
 	};
 
+	// * per view, written by updateUniformBuffer. Everything per object
+	// * comes with the draw instead, see DrawConstants
 	struct UniformBufferObject {
-		alignas(16) glm::mat4 model;
-		alignas(16) glm::mat4 view;
-		alignas(16) glm::mat4 proj;
+		// proj * view, combined on the host
+		alignas(16) glm::mat4 viewProj;
+		// dequantization of Vertex::pos, xyz only
+		alignas(16) glm::vec4 positionScale;
+		alignas(16) glm::vec4 positionOffset;
 	};
 
-	struct Vertex {
+	// the frame's transforms on the host, culling and LOD selection use them
+	struct FrameTransforms {
+		glm::mat4 model;
+		glm::mat4 view;
+		glm::mat4 proj;
+		glm::mat4 modelViewProj;
+		glm::vec4 positionScale;
+		glm::vec4 positionOffset;
+	};
+
+	// * per draw push constants, see pushDrawConstants. The vertex shader
+	// * applies model before the uniform buffer's viewProj and turns the
+	// * normals with normalMatrix (the columns of a std430 mat3), material
+	// * is the texture array slot of shader_bindless.frag. 116 of the 128
+	// * bytes every device supports
+	struct DrawConstants {
+		glm::mat4 model;
+		glm::vec4 normalMatrix[3];
+		uint32_t material;
+	};
+	static_assert(offsetof(DrawConstants, material) == 112,
+				  "shader_bindless.frag reads the material at offset 112");
+
+	// full precision vertex the mesh is built and optimized with, it is
+	// quantized into Vertex right before upload
+	struct MeshVertex {
 		glm::vec3 pos;
 		glm::vec3 normal;
-		glm::vec3 color;
 		glm::vec2 texCoord;
+	};
 
-		static VkVertexInputBindingDescription getBindingDescription() {
-			VkVertexInputBindingDescription bindingDescription{};
-			bindingDescription.binding = 0;
-			bindingDescription.stride = sizeof(Vertex);
-			bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	struct Vertex {
+		uint16_t pos[4];	  // unorm16 inside the mesh bounds, w unused
+		int16_t normal[2];	  // octahedral, snorm16
+		uint16_t texCoord[2]; // half float
 
-			return bindingDescription;
+		using Layout =
+			VertexLayout<VertexAttribute<0, VK_FORMAT_R16G16B16A16_UNORM>,
+						 VertexAttribute<1, VK_FORMAT_R16G16_SNORM>,
+						 VertexAttribute<2, VK_FORMAT_R16G16_SFLOAT>>;
+
+		static VkVertexInputBindingDescription getBindingDescription() {
+			return Layout::bindingDescription();
 		}
 
-		static std::array<VkVertexInputAttributeDescription, 4>
+		static std::array<VkVertexInputAttributeDescription,
+						  Layout::attributeCount>
 		getAttributeDescriptions() {
-			std::array<VkVertexInputAttributeDescription, 4>
-				attributeDescriptions{};
-
-			attributeDescriptions[0].binding = 0;
-			attributeDescriptions[0].location = 0;
-			attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-			attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-			attributeDescriptions[1].binding = 0;
-			attributeDescriptions[1].location = 1;
-			attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-			attributeDescriptions[1].offset = offsetof(Vertex, normal);
-
-			attributeDescriptions[2].binding = 0;
-			attributeDescriptions[2].location = 2;
-			attributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-			attributeDescriptions[2].offset = offsetof(Vertex, color);
-
-			attributeDescriptions[3].binding = 0;
-			attributeDescriptions[3].location = 3;
-			attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
-			attributeDescriptions[3].offset = offsetof(Vertex, texCoord);
-
-			return attributeDescriptions;
+			return Layout::attributeDescriptions();
 		}
 	};
 
+	static_assert(Vertex::Layout::stride == sizeof(Vertex),
+				  "Vertex does not match its layout");
+	static_assert(Vertex::Layout::offset(1) == offsetof(Vertex, normal) &&
+					  Vertex::Layout::offset(2) == offsetof(Vertex, texCoord),
+				  "Vertex does not match its layout");
+
 	bool checkValidationLayerSupport() {
 		uint32_t layerCount;
 		vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
@@ -264,6 +512,22 @@ class HelloTriangleApplication {
 			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 		}
 
+		// * needed to query VK_EXT_memory_budget on a 1.0 instance
+		uint32_t extensionCount = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount,
+											   nullptr);
+		std::vector<VkExtensionProperties> available(extensionCount);
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount,
+											   available.data());
+		const char *properties2 =
+			VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+		for (const auto &extension : available) {
+			if (strcmp(extension.extensionName, properties2) == 0) {
+				extensions.push_back(properties2);
+				physicalDeviceProperties2 = true;
+			}
+		}
+
 		return extensions;
 	};
 
@@ -469,6 +733,23 @@ class HelloTriangleApplication {
 		return requiredExtensions.empty();
 	}
 
+	bool deviceExtensionSupported(VkPhysicalDevice device, const char *name) {
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+											 nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+											 availableExtensions.data());
+
+		for (const auto &extension : availableExtensions) {
+			if (strcmp(extension.extensionName, name) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
 	void pickPhysicalDevice() {
 		/*
 			Acquire device count and check device suitability through
@@ -516,6 +797,12 @@ class HelloTriangleApplication {
 				// find at least one qfamily that suppports VK_QUEUE_GRAP_BIT
 				indices.graphicsFamily = i;
 			}
+			if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+				!(queueFamily.queueFlags &
+				  (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+				!indices.transferFamily.has_value()) {
+				indices.transferFamily = i;
+			}
 
 			// * check surface support
 			VkBool32 presentSupport = false;
@@ -525,12 +812,15 @@ class HelloTriangleApplication {
 				indices.presentFamily = i;
 			}
 
-			if (indices.isComplete()) {
+			if (indices.isComplete() && indices.transferFamily.has_value()) {
 				break;
 			}
 			i++;
 		}
 
+		if (!indices.transferFamily.has_value()) {
+			indices.transferFamily = indices.graphicsFamily;
+		}
 		return indices;
 	}
 
@@ -539,7 +829,8 @@ class HelloTriangleApplication {
 
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 		std::set<uint32_t> uniqueQueueFamilies = {
-			indices.graphicsFamily.value(), indices.presentFamily.value()};
+			indices.graphicsFamily.value(), indices.presentFamily.value(),
+			indices.transferFamily.value()};
 
 		float queuePriority = 1.0f;
 		for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -552,8 +843,28 @@ class HelloTriangleApplication {
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		// * lets the visible meshlets go out in a single indirect draw,
+		// * without it every draw command is issued separately
+		deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+		multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+		// * GPU culling draws every instance with its own command, which
+		// * selects the instance through firstInstance
+		deviceFeatures.drawIndirectFirstInstance =
+			supportedFeatures.drawIndirectFirstInstance;
+		gpuCulling = GPU_INSTANCE_CULLING &&
+					 supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+		// * the depth pyramid is built from the depth attachment
+		VkFormatProperties depthProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, findDepthFormat(),
+											&depthProperties);
+		occlusionCulling = OCCLUSION_CULLING && gpuCulling &&
+						   (depthProperties.optimalTilingFeatures &
+							VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
 
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -562,9 +873,67 @@ class HelloTriangleApplication {
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.pEnabledFeatures = &deviceFeatures;
 
+		// * optional: lets the memory report show the real budget
+		std::vector<const char *> extensions = deviceExtensions;
+		memoryBudgetSupported =
+			physicalDeviceProperties2 &&
+			deviceExtensionSupported(physicalDevice,
+									 VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		if (memoryBudgetSupported) {
+			extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+		// * optional: lets GPU culling pass its draw count to the draw
+		drawIndirectCountSupported =
+			gpuCulling &&
+			deviceExtensionSupported(physicalDevice,
+									 VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		if (drawIndirectCountSupported) {
+			extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
+		// * optional: lets the occlusion queries skip draws on the GPU
+		conditionalRenderingSupported =
+			OCCLUSION_QUERIES && conditionalRenderingFeatureSupported();
+		VkPhysicalDeviceConditionalRenderingFeaturesEXT
+			conditionalRenderingFeatures{};
+		conditionalRenderingFeatures.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+		if (conditionalRenderingSupported) {
+			extensions.push_back(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+			conditionalRenderingFeatures.conditionalRendering = VK_TRUE;
+			conditionalRenderingFeatures.pNext =
+				const_cast<void *>(createInfo.pNext);
+			createInfo.pNext = &conditionalRenderingFeatures;
+		}
+		// * optional: one call writes a whole descriptor set
+		descriptorUpdateTemplateSupported = deviceExtensionSupported(
+			physicalDevice, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+		if (descriptorUpdateTemplateSupported) {
+			extensions.push_back(
+				VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+		}
+		// * optional: the global texture array, only the features it uses
+		bindlessTextures = BINDLESS_TEXTURES && descriptorIndexingSupported();
+		VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures{};
+		descriptorIndexingFeatures.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+		if (bindlessTextures) {
+			extensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+			extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+			descriptorIndexingFeatures
+				.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+			descriptorIndexingFeatures
+				.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+			descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+			descriptorIndexingFeatures.descriptorBindingVariableDescriptorCount =
+				VK_TRUE;
+			descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+			descriptorIndexingFeatures.pNext =
+				const_cast<void *>(createInfo.pNext);
+			createInfo.pNext = &descriptorIndexingFeatures;
+		}
 		createInfo.enabledExtensionCount =
-			static_cast<uint32_t>(deviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+			static_cast<uint32_t>(extensions.size());
+		createInfo.ppEnabledExtensionNames = extensions.data();
 
 		if (enableValidationLayers) {
 			createInfo.enabledLayerCount =
@@ -584,6 +953,88 @@ class HelloTriangleApplication {
 						 &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily.value(), 0,
 						 &presentQueue);
+		vkGetDeviceQueue(device, indices.transferFamily.value(), 0,
+						 &transferQueue);
+		graphicsQueueFamily = indices.graphicsFamily.value();
+		transferQueueFamily = indices.transferFamily.value();
+		std::cout << "    transfer queue family " << transferQueueFamily
+				  << (transferQueueFamily == graphicsQueueFamily
+						  ? " (shared with graphics)"
+						  : " (dedicated)")
+				  << std::endl;
+	}
+
+	// * fills the feature structs chained to next, false when that needs
+	// * VK_KHR_get_physical_device_properties2 and the instance lacks it
+	bool getPhysicalDeviceFeatures2(void *next) {
+		if (!physicalDeviceProperties2) {
+			return false;
+		}
+		auto getFeatures2 =
+			reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+				vkGetInstanceProcAddr(instance,
+									  "vkGetPhysicalDeviceFeatures2KHR"));
+		if (getFeatures2 == nullptr) {
+			return false;
+		}
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = next;
+		getFeatures2(physicalDevice, &features);
+		return true;
+	}
+
+	// VK_EXT_conditional_rendering and its conditionalRendering feature
+	bool conditionalRenderingFeatureSupported() {
+		if (!deviceExtensionSupported(
+				physicalDevice, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME)) {
+			return false;
+		}
+		VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalRendering{};
+		conditionalRendering.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+		return getPhysicalDeviceFeatures2(&conditionalRendering) &&
+			   conditionalRendering.conditionalRendering == VK_TRUE;
+	}
+
+	// * VK_EXT_descriptor_indexing (and the VK_KHR_maintenance3 it needs)
+	// * with every feature BindlessTextures relies on
+	bool descriptorIndexingSupported() {
+		if (!deviceExtensionSupported(physicalDevice,
+									  VK_KHR_MAINTENANCE3_EXTENSION_NAME) ||
+			!deviceExtensionSupported(
+				physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+			return false;
+		}
+		VkPhysicalDeviceDescriptorIndexingFeatures indexing{};
+		indexing.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+		return getPhysicalDeviceFeatures2(&indexing) &&
+			   indexing.descriptorBindingSampledImageUpdateAfterBind &&
+			   indexing.descriptorBindingUpdateUnusedWhilePending &&
+			   indexing.descriptorBindingPartiallyBound &&
+			   indexing.descriptorBindingVariableDescriptorCount &&
+			   indexing.runtimeDescriptorArray;
+	}
+
+	// * BINDLESS_TEXTURE_CAPACITY within the update after bind limits, one
+	// * slot is left for every other sampled image of the fragment stage
+	uint32_t bindlessTextureCapacity() {
+		auto getProperties2 =
+			reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+				vkGetInstanceProcAddr(instance,
+									  "vkGetPhysicalDeviceProperties2KHR"));
+		VkPhysicalDeviceDescriptorIndexingProperties indexing{};
+		indexing.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &indexing;
+		getProperties2(physicalDevice, &properties);
+		return std::min(
+			{BINDLESS_TEXTURE_CAPACITY,
+			 indexing.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			 indexing.maxDescriptorSetUpdateAfterBindSampledImages});
 	}
 
 	void createSurface() {
@@ -811,23 +1262,61 @@ class HelloTriangleApplication {
 		std::array<VkDescriptorSetLayoutBinding, 2> bindings = {
 			uboLayoutBinding, samplerLayoutBinding};
 
+		// * bindless, the textures live in the global array of set 1
 		VkDescriptorSetLayoutCreateInfo layoutInfo{};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.bindingCount = bindlessTextures ? 1 : 2;
 		layoutInfo.pBindings = bindings.data();
 
 		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
 										&descriptorSetLayout) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create descriptor set layout!");
 		}
+
+		if (bindlessTextures) {
+			textureArray.create(device, bindlessTextureCapacity());
+			std::cout << "    bindless textures, " << textureArray.capacity()
+					  << " slots" << std::endl;
+		} else if (BINDLESS_TEXTURES) {
+			std::cout << "    one texture binding per set, "
+						 "VK_EXT_descriptor_indexing not supported"
+					  << std::endl;
+		}
+	}
+
+	void createPipelineLayout() {
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		// * bindless: the texture array as set 1
+		VkDescriptorSetLayout setLayouts[] = {descriptorSetLayout,
+											  textureArray.setLayout()};
+		// * DrawConstants, the transforms for the vertex and the material id
+		// * for the fragment shader
+		VkPushConstantRange drawRange{};
+		drawRange.stageFlags =
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		drawRange.size = sizeof(DrawConstants);
+		pipelineLayoutInfo.setLayoutCount = bindlessTextures ? 2 : 1;
+		pipelineLayoutInfo.pSetLayouts = setLayouts;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &drawRange;
+
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+								   &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
 	}
 
-	void createGraphicsPipeline() {
+	// * runs on a JobSystem worker, see PipelineCompiler
+	VkPipeline createGraphicsPipeline() {
 		auto vertShaderCode = readFile("../shaders/vert.spv");
-		auto fragShaderCode = readFile("../shaders/frag.spv");
+		auto fragShaderCode = readFile(bindlessTextures
+										   ? "../shaders/frag_bindless.spv"
+										   : "../shaders/frag.spv");
 
-		vertShaderModule = createShaderModule(vertShaderCode);
-		fragShaderModule = createShaderModule(fragShaderCode);
+		VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+		VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
 
 		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
 		vertShaderStageInfo.sType =
@@ -836,6 +1325,24 @@ class HelloTriangleApplication {
 		vertShaderStageInfo.module = vertShaderModule;
 		vertShaderStageInfo.pName = "main";
 
+		// * constant_id 0-2 light position, 3-5 light color, 6 intensity
+		std::array<float, 7> lightConstants = {
+			LIGHT_POSITION.x, LIGHT_POSITION.y, LIGHT_POSITION.z, LIGHT_COLOR.x,
+			LIGHT_COLOR.y, LIGHT_COLOR.z, LIGHT_INTENSITY};
+		std::array<VkSpecializationMapEntry, 7> lightEntries{};
+		for (uint32_t i = 0; i < lightEntries.size(); i++) {
+			lightEntries[i].constantID = i;
+			lightEntries[i].offset = i * sizeof(float);
+			lightEntries[i].size = sizeof(float);
+		}
+		VkSpecializationInfo vertSpecialization{};
+		vertSpecialization.mapEntryCount =
+			static_cast<uint32_t>(lightEntries.size());
+		vertSpecialization.pMapEntries = lightEntries.data();
+		vertSpecialization.dataSize = sizeof(lightConstants);
+		vertSpecialization.pData = lightConstants.data();
+		vertShaderStageInfo.pSpecializationInfo = &vertSpecialization;
+
 		VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
 		fragShaderStageInfo.sType =
 			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -857,17 +1364,28 @@ class HelloTriangleApplication {
 		dynamicState.pDynamicStates = dynamicStates.data();
 
 		// * VERTEX INPUT
-		// two descriptions for binding and attributes
-		auto bindingDescription = Vertex::getBindingDescription();
-		auto attributeDescriptions = Vertex::getAttributeDescriptions();
+		// binding 0 steps per vertex, binding 1 per instance (InstanceData)
+		std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = {
+			Vertex::getBindingDescription(),
+			InstanceData::Layout::bindingDescription(
+				1, VK_VERTEX_INPUT_RATE_INSTANCE)};
+		auto vertexAttributes = Vertex::getAttributeDescriptions();
+		auto instanceAttributes =
+			InstanceData::Layout::attributeDescriptions(1);
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions(
+			vertexAttributes.begin(), vertexAttributes.end());
+		attributeDescriptions.insert(attributeDescriptions.end(),
+									 instanceAttributes.begin(),
+									 instanceAttributes.end());
 
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType =
 			VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.vertexBindingDescriptionCount =
+			static_cast<uint32_t>(bindingDescriptions.size());
 		vertexInputInfo.vertexAttributeDescriptionCount =
 			static_cast<uint32_t>(attributeDescriptions.size());
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+		vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 		vertexInputInfo.pVertexAttributeDescriptions =
 			attributeDescriptions.data();
 
@@ -905,7 +1423,7 @@ class HelloTriangleApplication {
 		rasterizer.rasterizerDiscardEnable = VK_FALSE;
 		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
 		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_NONE;
+		rasterizer.cullMode = MODEL_CULL_MODE;
 		rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 		rasterizer.depthBiasEnable = VK_FALSE;
 		rasterizer.depthBiasConstantFactor = 0.0f; // Optional
@@ -961,19 +1479,6 @@ class HelloTriangleApplication {
 		colorBlending.blendConstants[2] = 0.0f; // Optional
 		colorBlending.blendConstants[3] = 0.0f; // Optional
 
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType =
-			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 1;
-		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-		pipelineLayoutInfo.pushConstantRangeCount = 0;
-		pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
-								   &pipelineLayout) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create pipeline layout!");
-		}
-
 		VkPipelineDepthStencilStateCreateInfo depthStencil{};
 		depthStencil.sType =
 			VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
@@ -1020,14 +1525,274 @@ class HelloTriangleApplication {
 		// additional depth stencil
 		pipelineInfo.pDepthStencilState = &depthStencil;
 
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
-									  nullptr,
-									  &graphicsPipeline) != VK_SUCCESS) {
+		VkPipeline pipeline;
+		if (pipelineCache.createGraphicsPipeline(pipelineInfo, &pipeline) !=
+			VK_SUCCESS) {
 			throw std::runtime_error("failed to create graphics pipeline!");
 		}
+
+		vkDestroyShaderModule(device, vertShaderModule, nullptr);
+		vkDestroyShaderModule(device, fragShaderModule, nullptr);
+		return pipeline;
+	}
+
+	void createGpuCuller() {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount =
+			nullptr;
+		if (drawIndirectCountSupported) {
+			drawIndexedIndirectCount =
+				reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+					vkGetDeviceProcAddr(device,
+										"vkCmdDrawIndexedIndirectCountKHR"));
+		}
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice,
+												 &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(
+			physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		gpuCuller.create(
+			device, deviceAllocator, MAX_FRAMES_IN_FLIGHT, properties.limits,
+			multiDrawIndirect, drawIndexedIndirectCount,
+			queueFamilies[graphicsQueueFamily].timestampValidBits);
+		std::cout << (gpuCuller.drawCountSupported()
+						  ? "    draw count written by the GPU"
+						  : "    fixed count indirect draws, "
+							"VK_KHR_draw_indirect_count not supported")
+				  << std::endl;
+		depthPyramid.create(device, deviceAllocator);
+		if (OCCLUSION_CULLING && !occlusionCulling) {
+			std::cout << "    no occlusion culling, the depth format cannot "
+						 "be sampled"
+					  << std::endl;
+		}
+	}
+
+	// * the culling shader binds the pyramid either way, without occlusion
+	// * culling it is a 1x1 stand-in that is never built
+	void createDepthPyramid(UploadBatch &uploads) {
+		if (occlusionCulling) {
+			VkImageAspectFlags aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+			if (hasStencilComponent(findDepthFormat())) {
+				aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+			}
+			depthPyramid.resize(uploads, swapChainExtent, depthImage,
+								depthImageView, aspect);
+		} else {
+			depthPyramid.resize(uploads, {1, 1}, VK_NULL_HANDLE,
+								VK_NULL_HANDLE, VK_IMAGE_ASPECT_DEPTH_BIT);
+		}
+		gpuCuller.setDepthPyramid(depthPyramid.view(), depthPyramid.sampler(),
+								  depthPyramid.width(),
+								  depthPyramid.height());
+	}
+
+	VkPipeline createDepthReducePipeline() {
+		auto reduceShaderCode = readFile("../shaders/depth_reduce_comp.spv");
+		VkShaderModule reduceShaderModule =
+			createShaderModule(reduceShaderCode);
+
+		VkPipelineShaderStageCreateInfo reduceShaderStageInfo{};
+		reduceShaderStageInfo.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		reduceShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		reduceShaderStageInfo.module = reduceShaderModule;
+		reduceShaderStageInfo.pName = "main";
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.layout = depthPyramid.pipelineLayout();
+		pipelineInfo.stage = reduceShaderStageInfo;
+
+		VkPipeline pipeline;
+		if (pipelineCache.createComputePipeline(pipelineInfo, &pipeline) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth reduce pipeline!");
+		}
+
+		vkDestroyShaderModule(device, reduceShaderModule, nullptr);
+		return pipeline;
+	}
+
+	void createOcclusionQueries() {
+		PFN_vkCmdBeginConditionalRenderingEXT beginConditionalRendering =
+			nullptr;
+		PFN_vkCmdEndConditionalRenderingEXT endConditionalRendering = nullptr;
+		if (conditionalRenderingSupported) {
+			beginConditionalRendering =
+				reinterpret_cast<PFN_vkCmdBeginConditionalRenderingEXT>(
+					vkGetDeviceProcAddr(device,
+										"vkCmdBeginConditionalRenderingEXT"));
+			endConditionalRendering =
+				reinterpret_cast<PFN_vkCmdEndConditionalRenderingEXT>(
+					vkGetDeviceProcAddr(device,
+										"vkCmdEndConditionalRenderingEXT"));
+		}
+		occlusionQueries.create(device, deviceAllocator, MAX_FRAMES_IN_FLIGHT,
+								OCCLUSION_QUERY_MAX_OBJECTS,
+								beginConditionalRendering,
+								endConditionalRendering);
+		std::cout << (occlusionQueries.conditionalRenderingSupported()
+						  ? "    hidden objects skipped by conditional "
+							"rendering"
+						  : "    hidden objects skipped on the host, "
+							"VK_EXT_conditional_rendering not supported")
+				  << std::endl;
+	}
+
+	// * the bounding boxes of the occlusion queries: depth tested against
+	// * what the frame drew, without a fragment shader and without writing
+	// * depth or color
+	VkPipeline createOcclusionProxyPipeline() {
+		auto proxyShaderCode = readFile("../shaders/occlusion_proxy_vert.spv");
+		VkShaderModule proxyShaderModule = createShaderModule(proxyShaderCode);
+
+		VkPipelineShaderStageCreateInfo proxyShaderStageInfo{};
+		proxyShaderStageInfo.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		proxyShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		proxyShaderStageInfo.module = proxyShaderModule;
+		proxyShaderStageInfo.pName = "main";
+
+		std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
+													 VK_DYNAMIC_STATE_SCISSOR};
+		VkPipelineDynamicStateCreateInfo dynamicState{};
+		dynamicState.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount =
+			static_cast<uint32_t>(dynamicStates.size());
+		dynamicState.pDynamicStates = dynamicStates.data();
+
+		// * only the instance transforms, the box corners come from
+		// * gl_VertexIndex and the tint is not needed
+		VkVertexInputBindingDescription bindingDescription =
+			InstanceData::Layout::bindingDescription(
+				1, VK_VERTEX_INPUT_RATE_INSTANCE);
+		auto instanceAttributes =
+			InstanceData::Layout::attributeDescriptions(1);
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+		vertexInputInfo.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+		vertexInputInfo.vertexAttributeDescriptionCount = 3;
+		vertexInputInfo.pVertexAttributeDescriptions =
+			instanceAttributes.data();
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+		inputAssembly.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		VkPipelineViewportStateCreateInfo viewportState{};
+		viewportState.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportState.viewportCount = 1;
+		viewportState.scissorCount = 1;
+
+		VkPipelineRasterizationStateCreateInfo rasterizer{};
+		rasterizer.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.cullMode = VK_CULL_MODE_NONE;
+		rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+		VkPipelineMultisampleStateCreateInfo multisampling{};
+		multisampling.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		colorBlendAttachment.colorWriteMask = 0;
+		VkPipelineColorBlendStateCreateInfo colorBlending{};
+		colorBlending.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlending.attachmentCount = 1;
+		colorBlending.pAttachments = &colorBlendAttachment;
+
+		// * the box surface facing the camera lies on or in front of the
+		// * object, LESS_OR_EQUAL keeps the object from hiding it
+		VkPipelineDepthStencilStateCreateInfo depthStencil{};
+		depthStencil.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthStencil.depthTestEnable = VK_TRUE;
+		depthStencil.depthWriteEnable = VK_FALSE;
+		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		depthStencil.maxDepthBounds = 1.0f;
+
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.stageCount = 1;
+		pipelineInfo.pStages = &proxyShaderStageInfo;
+		pipelineInfo.pVertexInputState = &vertexInputInfo;
+		pipelineInfo.pInputAssemblyState = &inputAssembly;
+		pipelineInfo.pViewportState = &viewportState;
+		pipelineInfo.pRasterizationState = &rasterizer;
+		pipelineInfo.pMultisampleState = &multisampling;
+		pipelineInfo.pDepthStencilState = &depthStencil;
+		pipelineInfo.pColorBlendState = &colorBlending;
+		pipelineInfo.pDynamicState = &dynamicState;
+		pipelineInfo.layout = pipelineLayout;
+		pipelineInfo.renderPass = renderPass;
+		pipelineInfo.subpass = 0;
+
+		VkPipeline pipeline;
+		if (pipelineCache.createGraphicsPipeline(pipelineInfo, &pipeline) !=
+			VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to create occlusion proxy pipeline!");
+		}
+
+		vkDestroyShaderModule(device, proxyShaderModule, nullptr);
+		return pipeline;
+	}
+
+	VkPipeline createCullPipeline() {
+		auto cullShaderCode = readFile("../shaders/instance_cull_comp.spv");
+		VkShaderModule cullShaderModule = createShaderModule(cullShaderCode);
+
+		VkPipelineShaderStageCreateInfo cullShaderStageInfo{};
+		cullShaderStageInfo.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		cullShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		cullShaderStageInfo.module = cullShaderModule;
+		cullShaderStageInfo.pName = "main";
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.layout = gpuCuller.pipelineLayout();
+		pipelineInfo.stage = cullShaderStageInfo;
+
+		VkPipeline pipeline;
+		if (pipelineCache.createComputePipeline(pipelineInfo, &pipeline) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create cull pipeline!");
+		}
+
+		vkDestroyShaderModule(device, cullShaderModule, nullptr);
+		return pipeline;
 	}
 
+	// * with occlusion culling the frame is split at the depth pyramid
+	// * build: the early pass keeps color and depth, the late one loads
+	// * them and presents. Framebuffers stay compatible with all three
+	enum class RenderPassStage { Whole, Early, Late };
+
 	void createRenderPass() {
+		renderPass = buildRenderPass(RenderPassStage::Whole);
+		if (occlusionCulling) {
+			earlyRenderPass = buildRenderPass(RenderPassStage::Early);
+			lateRenderPass = buildRenderPass(RenderPassStage::Late);
+		}
+	}
+
+	VkRenderPass buildRenderPass(RenderPassStage stage) {
+		bool late = stage == RenderPassStage::Late;
 		/*
 			Tell vulkan about the framebuffer attachments to use while
 		   rendering, including how many color and depth buffers there will be.
@@ -1039,8 +1804,9 @@ class HelloTriangleApplication {
 		VkAttachmentDescription colorAttachment{};
 		colorAttachment.format = swapChainImageFormat;
 		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT; // single color buffer
+		// clear values to a constant at start, the late pass keeps them
 		colorAttachment.loadOp =
-			VK_ATTACHMENT_LOAD_OP_CLEAR; // clear values to a constant at start
+			late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
 		colorAttachment.storeOp =
 			VK_ATTACHMENT_STORE_OP_STORE; // rendered contents stored in memory
 										  // and can be read later
@@ -1049,9 +1815,13 @@ class HelloTriangleApplication {
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		colorAttachment.initialLayout =
+			late ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+				 : VK_IMAGE_LAYOUT_UNDEFINED;
 		colorAttachment.finalLayout =
-			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // layout can change
+			stage == RenderPassStage::Early
+				? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+				: VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // layout can change
 
 		// * subpasses and attachment references
 		VkAttachmentReference colorAttachmentRef{};
@@ -1061,11 +1831,17 @@ class HelloTriangleApplication {
 		VkAttachmentDescription depthAttachment{};
 		depthAttachment.format = findDepthFormat();
 		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.loadOp =
+			late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		// * the depth pyramid and the late pass read the early pass depth
+		depthAttachment.storeOp = stage == RenderPassStage::Early
+									  ? VK_ATTACHMENT_STORE_OP_STORE
+									  : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.initialLayout =
+			late ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+				 : VK_IMAGE_LAYOUT_UNDEFINED;
 		depthAttachment.finalLayout =
 			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
@@ -1092,6 +1868,13 @@ class HelloTriangleApplication {
 			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
 								   VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		if (late) {
+			// * the loads read what the early pass wrote
+			dependency.srcAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependency.dstAccessMask |=
+				VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		}
 
 		std::array<VkAttachmentDescription, 2> attachments = {colorAttachment,
 															  depthAttachment};
@@ -1109,10 +1892,12 @@ class HelloTriangleApplication {
 		renderPassInfo.pDependencies = &dependency;
 
 		// create renderpass
-		if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) !=
+		VkRenderPass pass;
+		if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &pass) !=
 			VK_SUCCESS) {
 			throw std::runtime_error("failed to create render pass!");
 		}
+		return pass;
 	}
 
 	void createFrameBuffers() {
@@ -1157,20 +1942,32 @@ class HelloTriangleApplication {
 			VK_SUCCESS) {
 			throw std::runtime_error("failed to create command pool!");
 		}
+
+		// only used by the asset loader thread
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily.value();
+		if (vkCreateCommandPool(device, &poolInfo, nullptr,
+								&transferCommandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create transfer command pool!");
+		}
 	}
 
-	void createDepthResources() {
+	void createDepthResources(UploadBatch &uploads) {
 		VkFormat depthFormat = findDepthFormat();
 
+		// * the depth pyramid samples it
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		if (occlusionCulling) {
+			usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+		}
 		createImage(swapChainExtent.width, swapChainExtent.height, 1,
-					depthFormat, VK_IMAGE_TILING_OPTIMAL,
-					VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+					depthFormat, VK_IMAGE_TILING_OPTIMAL, usage,
 					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage,
 					depthImageMemory);
 		depthImageView =
 			createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-		transitionImageLayout(depthImage, depthFormat,
+		transitionImageLayout(uploads, depthImage, depthFormat,
 							  VK_IMAGE_LAYOUT_UNDEFINED,
 							  VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 	}
@@ -1224,22 +2021,119 @@ class HelloTriangleApplication {
 		}
 	}
 
-	void recordCommandBuffer(VkCommandBuffer commandBuffer,
-							 uint32_t imageIndex) {
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = 0;
-		beginInfo.pInheritanceInfo = nullptr;
-
-		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-			throw std::runtime_error(
-				"failed to begin recording command buffer!");
+	// * frame picks the per-frame descriptor set and indirect buffer, a
+	// * static command buffer is recorded for a frame other than currentFrame
+	// * one command buffer per swapchain image and frame in flight, all
+	// * recorded right away. Called again by recreateSwapChain since they
+	// * reference the framebuffers
+	void createStaticCommandBuffers() {
+		if (!staticCommandBuffers.empty()) {
+			vkFreeCommandBuffers(
+				device, commandPool,
+				static_cast<uint32_t>(staticCommandBuffers.size()),
+				staticCommandBuffers.data());
 		}
+		staticCommandBuffers.resize(swapChainImages.size() *
+									MAX_FRAMES_IN_FLIGHT);
+		staticRecordings.assign(staticCommandBuffers.size(),
+								StaticRecording{});
 
-		// * define multiple clear values
-		std::array<VkClearValue, 2> clearValues{};
-		clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-		clearValues[1].depthStencil = {1.0f, 0};
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount =
+			static_cast<uint32_t>(staticCommandBuffers.size());
+		if (vkAllocateCommandBuffers(device, &allocInfo,
+									 staticCommandBuffers.data()) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create command buffers!");
+		}
+		// * every pre-recorded buffer keeps the secondaries its meshlet
+		// * draws were recorded into on the workers
+		secondaryRecorder.destroy();
+		secondaryRecorder.create(
+			device, graphicsQueueFamily, jobSystem.threadCount(),
+			static_cast<uint32_t>(staticCommandBuffers.size()), true);
+
+		for (uint32_t image = 0; image < swapChainImages.size(); image++) {
+			for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+				recordStaticCommandBuffer(image, frame);
+			}
+		}
+	}
+
+	void recordStaticCommandBuffer(uint32_t imageIndex, uint32_t frame) {
+		size_t slot = imageIndex * MAX_FRAMES_IN_FLIGHT + frame;
+		// * the pool resets it implicitly on begin
+		recordCommandBuffer(staticCommandBuffers[slot], imageIndex, frame);
+
+		StaticRecording &recording = staticRecordings[slot];
+		recording.recorded = true;
+		recording.pipeline = pipelineCompiler.get(graphicsPipeline);
+		recording.model = frameTransforms.model;
+		recording.assetState = assetState;
+		recording.modelLod = modelLod;
+		recording.meshletDrawCount = meshletDrawCount;
+		recording.parallel = parallelMeshletRecording(visibleMeshlets);
+		recording.instanceBuffer = instanceBuffer;
+		recording.instanceCount = instanceCount;
+		recording.cullPipeline = cullPipelineHandle();
+		recording.depthReducePipeline = depthReducePipelineHandle();
+		recording.occlusionProxyPipeline = occlusionProxyPipelineHandle();
+		recording.queryVisibility = hostQueryVisibility(frame);
+		staticRecordCount++;
+	}
+
+	// * what a recorded command buffer depends on besides the framebuffer,
+	// * the uniform buffer and the indirect command contents may change
+	// * freely underneath it
+	bool staticRecordingStale(size_t slot) {
+		const StaticRecording &recording = staticRecordings[slot];
+		return !recording.recorded ||
+			   recording.pipeline != pipelineCompiler.get(graphicsPipeline) ||
+			   recording.model != frameTransforms.model ||
+			   recording.assetState != assetState ||
+			   recording.modelLod != modelLod ||
+			   recording.meshletDrawCount != meshletDrawCount ||
+			   recording.parallel != parallelMeshletRecording(visibleMeshlets) ||
+			   recording.instanceBuffer != instanceBuffer ||
+			   recording.instanceCount != instanceCount ||
+			   recording.cullPipeline != cullPipelineHandle() ||
+			   recording.depthReducePipeline != depthReducePipelineHandle() ||
+			   recording.occlusionProxyPipeline !=
+				   occlusionProxyPipelineHandle() ||
+			   recording.queryVisibility !=
+				   hostQueryVisibility(slot % MAX_FRAMES_IN_FLIGHT);
+	}
+
+	// * the pre-recorded buffer for imageIndex and currentFrame, only
+	// * re-recorded when the scene or pipeline changed. Its last
+	// * submission used the in-flight fence drawFrame already waited on
+	VkCommandBuffer staticCommandBuffer(uint32_t imageIndex) {
+		size_t slot = imageIndex * MAX_FRAMES_IN_FLIGHT + currentFrame;
+		if (staticRecordingStale(slot)) {
+			recordStaticCommandBuffer(imageIndex, currentFrame);
+		}
+		return staticCommandBuffers[slot];
+	}
+
+	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+							 uint32_t frame) {
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = 0;
+		beginInfo.pInheritanceInfo = nullptr;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to begin recording command buffer!");
+		}
+
+		// * define multiple clear values
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+		clearValues[1].depthStencil = {1.0f, 0};
 
 		VkRenderPassBeginInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -1252,11 +2146,111 @@ class HelloTriangleApplication {
 		renderPassInfo.clearValueCount =
 			static_cast<uint32_t>(clearValues.size());
 		renderPassInfo.pClearValues = clearValues.data();
+
+		// * still compiling, the frame is just the clear
+		VkPipeline pipeline = pipelineCompiler.get(graphicsPipeline);
+		bool assetsReady = assetState == AssetState::Ready;
+		bool meshletDraws = useMeshletDraws();
+		// * long meshlet draw lists are recorded into secondaries on the
+		// * workers, the primary only executes them. They belong to the
+		// * frame in flight, or to the pre-recorded buffer and are kept
+		// * with it (see parallelMeshletRecording)
+		// * every other draw goes through the GPU culling pass once its
+		// * pipeline is ready, recorded in front of the render pass
+		VkPipeline cull = cullPipelineHandle();
+		bool gpuCulled = cull != VK_NULL_HANDLE &&
+						 pipeline != VK_NULL_HANDLE && !meshletDraws;
+		// * and with occlusion culling split around the depth pyramid build
+		VkPipeline reduce = depthReducePipelineHandle();
+		bool occlusion = gpuCulled && reduce != VK_NULL_HANDLE;
+		if (gpuCulled) {
+			gpuCuller.record(commandBuffer, frame, cull, occlusion);
+		}
+		if (occlusion) {
+			renderPassInfo.renderPass = earlyRenderPass;
+		}
+		bool parallel = pipeline != VK_NULL_HANDLE && meshletDraws &&
+						parallelMeshletRecording(visibleMeshlets);
+		// * a few objects drawn otherwise go through the occlusion queries
+		VkPipeline proxy = occlusionProxyPipelineHandle();
+		bool queried = proxy != VK_NULL_HANDLE && pipeline != VK_NULL_HANDLE &&
+					   assetsReady && !gpuCulled && !parallel &&
+					   instanceCount <= occlusionQueries.capacity();
+		if (queried) {
+			occlusionQueries.recordBegin(commandBuffer, frame);
+		}
 		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-							 VK_SUBPASS_CONTENTS_INLINE);
+							 parallel
+								 ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+								 : VK_SUBPASS_CONTENTS_INLINE);
+
+		if (parallel) {
+			const std::vector<VkCommandBuffer> &secondaries =
+				secondaryRecorder.record(
+					jobSystem,
+					STATIC_COMMAND_BUFFERS
+						? imageIndex * MAX_FRAMES_IN_FLIGHT + frame
+						: frame,
+					renderPass, 0,
+					swapChainFramebuffers[imageIndex], meshletDrawCount,
+					PARALLEL_RECORD_MIN_DRAWS,
+					[&](VkCommandBuffer secondary, uint32_t first,
+						uint32_t end) {
+						bindDrawState(secondary, pipeline, true, frame);
+						drawMeshlets(secondary, frame, first, end);
+					});
+			vkCmdExecuteCommands(commandBuffer,
+								 static_cast<uint32_t>(secondaries.size()),
+								 secondaries.data());
+		} else if (pipeline != VK_NULL_HANDLE) {
+			bindDrawState(commandBuffer, pipeline, assetsReady, frame);
+			if (gpuCulled) {
+				gpuCuller.draw(commandBuffer, frame);
+			} else if (queried) {
+				drawQueriedObjects(commandBuffer, frame, meshletDraws);
+				vkCmdBindPipeline(commandBuffer,
+								  VK_PIPELINE_BIND_POINT_GRAPHICS, proxy);
+				occlusionQueries.drawProxies(commandBuffer, frame,
+											 instanceCount);
+			} else if (!assetsReady) {
+				vkCmdDrawIndexed(commandBuffer, PLACEHOLDER_INDEX_COUNT,
+								 instanceCount, 0, 0, 0);
+			} else if (!meshletDraws) {
+				const MeshLod &lod = modelLods[modelLod];
+				vkCmdDrawIndexed(commandBuffer, lod.indexCount, instanceCount,
+								 lod.indexOffset, 0, 0);
+			} else {
+				drawMeshlets(commandBuffer, frame, 0, meshletDrawCount);
+			}
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+		if (occlusion) {
+			depthPyramid.record(commandBuffer, reduce);
+			gpuCuller.recordLate(commandBuffer, frame, cull);
+
+			renderPassInfo.renderPass = lateRenderPass;
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+								 VK_SUBPASS_CONTENTS_INLINE);
+			bindDrawState(commandBuffer, pipeline, assetsReady, frame);
+			gpuCuller.drawLate(commandBuffer, frame);
+			vkCmdEndRenderPass(commandBuffer);
+		}
+		if (gpuCulled) {
+			gpuCuller.recordReadback(commandBuffer, frame);
+		}
 
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
+	}
+
+	// * everything a draw needs, recorded again into every secondary since
+	// * those inherit no state from the primary
+	void bindDrawState(VkCommandBuffer commandBuffer, VkPipeline pipeline,
+					   bool assetsReady, uint32_t frame) {
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-						  graphicsPipeline);
+						  pipeline);
 
 		VkViewport viewport{};
 		viewport.x = 0.0f;
@@ -1272,25 +2266,163 @@ class HelloTriangleApplication {
 		scissor.extent = swapChainExtent;
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		// vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-		VkBuffer vertexBuffers[] = {vertexBuffer};
-		VkDeviceSize offsets[] = {0};
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0,
-							 VK_INDEX_TYPE_UINT32);
+		VkBuffer vertexBuffers[] = {
+			assetsReady ? vertexBuffer : placeholderVertexBuffer,
+			instanceBuffer};
+		VkDeviceSize offsets[] = {0, 0};
+		vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+		if (assetsReady) {
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+		} else {
+			vkCmdBindIndexBuffer(commandBuffer, placeholderIndexBuffer, 0,
+								 VK_INDEX_TYPE_UINT16);
+		}
 
-		// vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1,
-		// 0, 		  0);
+		// * bindless, the texture array is bound with the frame's set and
+		// * the draws only push their material id along with their transform
+		VkDescriptorSet frameSet = transientDescriptorSets[frame];
+		if (STATIC_COMMAND_BUFFERS) {
+			frameSet = assetsReady ? descriptorSets[frame]
+								   : placeholderDescriptorSets[frame];
+		}
+		VkDescriptorSet sets[] = {frameSet, textureArray.set()};
 		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-								pipelineLayout, 0, 1,
-								&descriptorSets[currentFrame], 0, nullptr);
-		vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()),
-						 1, 0, 0, 0);
+								pipelineLayout, 0, bindlessTextures ? 2 : 1,
+								sets, 0, nullptr);
+		pushDrawConstants(commandBuffer, frameTransforms.model,
+						  assetsReady ? modelMaterial : placeholderMaterial);
+	}
 
-		vkCmdEndRenderPass(commandBuffer);
+	// * the transform and texture array slot (bindless only) of the
+	// * following draws. Drawing another object only pushes its constants,
+	// * no descriptor set is written or rebound. The material is left out
+	// * without bindless textures, nothing reads it then
+	void pushDrawConstants(VkCommandBuffer commandBuffer,
+						   const glm::mat4 &model, uint32_t material) {
+		DrawConstants constants{};
+		constants.model = model;
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+		for (int c = 0; c < 3; c++) {
+			constants.normalMatrix[c] = glm::vec4(normalMatrix[c], 0.0f);
+		}
+		constants.material = material;
+		uint32_t size = offsetof(DrawConstants, material);
+		if (bindlessTextures) {
+			size += sizeof(uint32_t);
+		}
+		vkCmdPushConstants(
+			commandBuffer, pipelineLayout,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, size,
+			&constants);
+	}
 
-		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-			throw std::runtime_error("failed to record command buffer!");
+	// * every instance with its own draw, left out while an occlusion
+	// * query of an earlier frame found it hidden. The meshlet draws are a
+	// * single instance
+	void drawQueriedObjects(VkCommandBuffer commandBuffer, uint32_t frame,
+							bool meshletDraws) {
+		const MeshLod &lod = modelLods[modelLod];
+		for (uint32_t object = 0; object < instanceCount; object++) {
+			if (!occlusionQueries.visible(frame, object)) {
+				continue;
+			}
+			occlusionQueries.beginConditional(commandBuffer, frame, object);
+			if (meshletDraws) {
+				drawMeshlets(commandBuffer, frame, 0, meshletDrawCount);
+			} else {
+				vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1,
+								 lod.indexOffset, 0, object);
+			}
+			occlusionQueries.endConditional(commandBuffer);
+		}
+	}
+
+	// occlusion query box pipeline once compiled, VK_NULL_HANDLE until then
+	VkPipeline occlusionProxyPipelineHandle() {
+		return OCCLUSION_QUERIES ? pipelineCompiler.get(occlusionProxyPipeline)
+								 : VK_NULL_HANDLE;
+	}
+
+	// * what the host path of the occlusion queries leaves out of frame's
+	// * recording, empty with conditional rendering
+	std::vector<uint8_t> hostQueryVisibility(uint32_t frame) const {
+		if (!OCCLUSION_QUERIES ||
+			occlusionQueries.conditionalRenderingSupported()) {
+			return {};
+		}
+		return occlusionQueries.visibility(frame);
+	}
+
+	// culling pipeline once compiled, VK_NULL_HANDLE until then
+	VkPipeline cullPipelineHandle() {
+		return gpuCulling ? pipelineCompiler.get(cullPipeline) : VK_NULL_HANDLE;
+	}
+
+	// depth pyramid pipeline once compiled, VK_NULL_HANDLE until then
+	VkPipeline depthReducePipelineHandle() {
+		return occlusionCulling ? pipelineCompiler.get(depthReducePipeline)
+								: VK_NULL_HANDLE;
+	}
+
+	// * frustum and index range of the frame's GPU culling pass. The planes
+	// * come from the MVP matrix, so they live in the space the instance
+	// * transforms map into, and the mesh sphere bounds its quantization box
+	void updateCullParams(uint32_t frame) {
+		GpuCullParams &params = gpuCuller.params(frame);
+		glm::mat4 modelViewProj = frameTransforms.modelViewProj;
+		extractFrustumPlanes(&modelViewProj[0][0], params.planes);
+		glm::mat4 modelView = frameTransforms.view * frameTransforms.model;
+		std::copy(&modelView[0][0], &modelView[0][0] + 16, params.modelView);
+		params.projection[0] = frameTransforms.proj[0][0];
+		params.projection[1] = frameTransforms.proj[1][1];
+		params.projection[2] = frameTransforms.proj[2][2];
+		params.projection[3] = frameTransforms.proj[3][2];
+
+		glm::vec3 boxSize = glm::vec3(frameTransforms.positionScale);
+		glm::vec3 center =
+			glm::vec3(frameTransforms.positionOffset) + 0.5f * boxSize;
+		params.sphere[0] = center.x;
+		params.sphere[1] = center.y;
+		params.sphere[2] = center.z;
+		params.sphere[3] = 0.5f * glm::length(boxSize);
+
+		if (assetState == AssetState::Ready) {
+			params.indexCount = modelLods[modelLod].indexCount;
+			params.firstIndex = modelLods[modelLod].indexOffset;
+		} else {
+			params.indexCount = PLACEHOLDER_INDEX_COUNT;
+			params.firstIndex = 0;
+		}
+	}
+
+	// * meshlets only cover LOD 0 and their culling only knows a single
+	// * copy of the model, instanced frames draw the LOD index range instead
+	bool useMeshletDraws() const {
+		return assetState == AssetState::Ready && !meshlets.empty() &&
+			   modelLod == 0 && instanceCount == 1;
+	}
+
+	// * whether the draws of this many visible meshlets are recorded on the
+	// * workers, cullMeshlets keeps them one draw per meshlet then
+	bool parallelMeshletRecording(uint32_t visible) const {
+		return PARALLEL_COMMAND_RECORDING &&
+			   visible >= 2 * PARALLEL_RECORD_MIN_DRAWS;
+	}
+
+	// draws [first, end) of the frame's meshlet indirect commands
+	void drawMeshlets(VkCommandBuffer commandBuffer, uint32_t frame,
+					  uint32_t first, uint32_t end) {
+		const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		if (multiDrawIndirect) {
+			vkCmdDrawIndexedIndirect(
+				commandBuffer, meshletDrawBuffers[frame],
+				VkDeviceSize(first) * stride, end - first, stride);
+		} else {
+			for (uint32_t i = first; i < end; i++) {
+				vkCmdDrawIndexedIndirect(commandBuffer,
+										 meshletDrawBuffers[frame],
+										 VkDeviceSize(i) * stride, 1, stride);
+			}
 		}
 	}
 
@@ -1316,21 +2448,11 @@ class HelloTriangleApplication {
 				throw std::runtime_error("failed to create semophores!");
 			}
 		}
-	}
 
-	uint32_t findMemoryType(uint32_t typeFilter,
-							VkMemoryPropertyFlags properties) {
-		VkPhysicalDeviceMemoryProperties memProperties;
-		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-			if ((typeFilter & (1 << i)) &&
-				(memProperties.memoryTypes[i].propertyFlags & properties) ==
-					properties) {
-				return i;
-			}
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+							  &assetTransferSemaphore) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create asset upload sync!");
 		}
-		throw std::runtime_error("failed to find suitable memory type!");
 	}
 
 	void createUniformBuffers() {
@@ -1344,106 +2466,381 @@ class HelloTriangleApplication {
 			createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 						 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-						 uniformBuffers[i], uniformBuffersMemory[i]);
+						 uniformBuffers[i], uniformBuffersMemory[i],
+						 DeviceAllocationStrategy::Linear);
+			uniformBuffersMapped[i] = uniformBuffersMemory[i].mapped;
+		}
+	}
+
+	void createMeshletDrawBuffers() {
+		if (meshlets.empty()) {
+			return;
+		}
+
+		// * one host visible command buffer per frame in flight, cullMeshlets
+		// * rewrites the current frame's one after its fence was waited on
+		VkDeviceSize bufferSize =
+			sizeof(VkDrawIndexedIndirectCommand) * meshlets.size();
+
+		meshletDrawBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+		meshletDrawBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+		meshletDrawBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
-			vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0,
-						&uniformBuffersMapped[i]);
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			createBuffer(bufferSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+						 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+						 meshletDrawBuffers[i], meshletDrawBuffersMemory[i],
+						 DeviceAllocationStrategy::Linear);
+			meshletDrawBuffersMapped[i] = meshletDrawBuffersMemory[i].mapped;
 		}
 	}
 
-	void createDescriptorPool() {
-		// VkDescriptorPoolSize poolSize{};
-		// poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		// poolSize.descriptorCount =
-		// static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	// * lays out count instances around the model bounds, or the placeholder
+	// * quad's ([-0.5, 0.5]^2) while the model is loading, and records their
+	// * upload. The device local buffer only grows, the caller makes sure no
+	// * frame in flight still reads it
+	void writeInstances(UploadBatch &uploads, uint32_t count) {
+		VkDeviceSize bufferSize = sizeof(InstanceData) * count;
+		if (count > instanceCapacity) {
+			if (instanceBuffer != VK_NULL_HANDLE) {
+				vkDestroyBuffer(device, instanceBuffer, nullptr);
+				deviceAllocator.free(instanceBufferMemory);
+			}
+			// * the culling pass reads the transforms as a storage buffer
+			createBuffer(bufferSize,
+						 VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+							 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+							 (gpuCulling ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+										 : 0),
+						 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instanceBuffer,
+						 instanceBufferMemory);
+			instanceCapacity = count;
+		}
 
-		std::array<VkDescriptorPoolSize, 2> poolSizes{};
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount =
-			static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount =
-			static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+		float center[3] = {0.0f, 0.0f, 0.0f};
+		float size = 1.0f;
+		if (assetState == AssetState::Ready) {
+			glm::vec3 modelCenter = positionOffset + 0.5f * positionScale;
+			center[0] = modelCenter.x;
+			center[1] = modelCenter.y;
+			center[2] = modelCenter.z;
+			size = std::max(positionScale.x, positionScale.y);
+		}
+		std::vector<InstanceData> instances =
+			generateInstances(count, INSTANCE_DISTRIBUTION, center, size);
+		const char *source = reinterpret_cast<const char *>(instances.data());
+
+		stagingRing.stream(
+			bufferSize, sizeof(InstanceData),
+			[&](void *data, VkDeviceSize offset, VkDeviceSize bytes) {
+				memcpy(data, source + offset, (size_t)bytes);
+			},
+			[&](const StagingAllocation &staging, VkDeviceSize offset) {
+				copyBuffer(uploads.record(), staging.buffer, staging.offset,
+						   instanceBuffer, offset, staging.size);
+			});
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask =
+			VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = instanceBuffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		uploads.bufferBarrier(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							  VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+								  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		instanceCount = count;
+		if (gpuCulling) {
+			gpuCuller.setObjects(instanceBuffer, count);
+		}
+	}
 
-		VkDescriptorPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	// * rewrites the instances between frames: waits for every frame in
+	// * flight, then uploads and waits again. Only used once the assets are
+	// * ready, the loader thread is done with the staging ring by then
+	void updateInstances(uint32_t count) {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			vkDeviceWaitIdle(device);
+		}
+		UploadBatch uploads;
+		uploads.begin(device, commandPool);
+		writeInstances(uploads, count);
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			uploads.submit(graphicsQueue, stagingRing.submitFence());
+		}
+		uploads.wait();
+		uploads.destroy();
+	}
+
+	// * INSTANCE_BENCHMARK, called after every frame with its time. Starts
+	// * once the model and pipeline are ready and restores INSTANCE_COUNT
+	// * when every step was measured
+	void updateInstanceBenchmark(double frameMilliseconds) {
+		if (!instanceBenchmark.started()) {
+			if (assetState != AssetState::Ready ||
+				!pipelineCompiler.isReady(graphicsPipeline)) {
+				return;
+			}
+			std::cout << "[INFO] instance benchmark started" << std::endl;
+			instanceBenchmark.start(INSTANCE_BENCHMARK_COUNTS,
+									INSTANCE_BENCHMARK_WARMUP_FRAMES,
+									INSTANCE_BENCHMARK_FRAMES,
+									modelLods[0].indexCount / 3);
+		} else if (!instanceBenchmark.running() ||
+				   !instanceBenchmark.addFrame(frameMilliseconds)) {
+			return;
+		}
 
-		if (vkCreateDescriptorPool(device, &poolInfo, nullptr,
-								   &descriptorPool) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create descriptor pool!");
+		if (instanceBenchmark.running()) {
+			updateInstances(instanceBenchmark.instanceCount());
+		} else {
+			std::cout << "[INFO] instance benchmark, LOD 0, "
+					  << modelLods[0].indexCount / 3
+					  << " triangles per instance" << std::endl;
+			instanceBenchmark.printResults(std::cout);
+			updateInstances(INSTANCE_COUNT);
 		}
 	}
 
-	void createDescriptorSets() {
-		std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT,
-												   descriptorSetLayout);
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = descriptorPool;
-		allocInfo.descriptorSetCount =
-			static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-		allocInfo.pSetLayouts = layouts.data();
+	// frustum / cone test every meshlet and write the draws for the visible
+	// ones, returns the number of draw commands
+	uint32_t cullMeshlets(uint32_t currentImage) {
+		glm::mat4 modelView = frameTransforms.view * frameTransforms.model;
+		glm::mat4 modelViewProj = frameTransforms.modelViewProj;
+
+		// * both tests run in model space: the planes come straight out of
+		// * the MVP matrix and the camera is moved into the model instead
+		float planes[6][4];
+		extractFrustumPlanes(&modelViewProj[0][0], planes);
+		glm::vec4 camera = glm::inverse(modelView) * glm::vec4(0, 0, 0, 1);
+		float cameraPosition[3] = {camera.x, camera.y, camera.z};
+		bool coneCulling = (MODEL_CULL_MODE & VK_CULL_MODE_BACK_BIT) != 0;
+
+		auto *commands = static_cast<VkDrawIndexedIndirectCommand *>(
+			meshletDrawBuffersMapped[currentImage]);
+		uint32_t drawCount = 0;
+		uint32_t visible = 0;
+		uint32_t nextIndex = std::numeric_limits<uint32_t>::max();
+
+		cullSpheresParallel(jobSystem, meshletBounds, planes,
+							meshletVisibility.data());
+		for (size_t i = 0; i < meshlets.size(); i++) {
+			if (meshletVisibility[i] && coneCulling &&
+				meshletBackfacing(meshlets[i], cameraPosition)) {
+				meshletVisibility[i] = 0;
+			}
+			visible += meshletVisibility[i] ? 1 : 0;
+		}
+		// * draws recorded on the workers are split by count, merged ones
+		// * would leave too few of them to spread
+		bool merge = !parallelMeshletRecording(visible);
+
+		for (size_t i = 0; i < meshlets.size(); i++) {
+			const Meshlet &meshlet = meshlets[i];
+			if (!meshletVisibility[i]) {
+				continue;
+			}
 
-		descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-		if (vkAllocateDescriptorSets(device, &allocInfo,
-									 descriptorSets.data()) != VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate descriptor sets!");
+			// meshlets are contiguous in the index buffer, so visible
+			// neighbours collapse into one draw
+			if (merge && meshlet.indexOffset == nextIndex) {
+				commands[drawCount - 1].indexCount += meshlet.indexCount;
+			} else {
+				VkDrawIndexedIndirectCommand &command = commands[drawCount++];
+				command.indexCount = meshlet.indexCount;
+				command.instanceCount = 1;
+				command.firstIndex = meshlet.indexOffset;
+				command.vertexOffset = 0;
+				command.firstInstance = 0;
+			}
+			nextIndex = meshlet.indexOffset + meshlet.indexCount;
 		}
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-			VkDescriptorBufferInfo bufferInfo{};
-			bufferInfo.buffer = uniformBuffers[i];
-			bufferInfo.offset = 0;
-			bufferInfo.range = sizeof(UniformBufferObject);
-
-			VkDescriptorImageInfo imageInfo{};
-			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfo.imageView = textureImageView;
-			imageInfo.sampler = textureSampler;
-
-			std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-
-			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[0].dstSet = descriptorSets[i];
-			descriptorWrites[0].dstBinding = 0;
-			descriptorWrites[0].dstArrayElement = 0;
-			descriptorWrites[0].descriptorType =
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptorWrites[0].descriptorCount = 1;
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[1].dstSet = descriptorSets[i];
-			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorType =
+		visibleMeshlets = visible;
+		return drawCount;
+	}
+
+	// * frustum planes of updateUniformBuffer's camera in world space, spheres
+	// * spread over a box twice the camera distance so a part is visible
+	void runFrustumCullBenchmark() {
+		glm::mat4 view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f),
+									 glm::vec3(0.0f, 0.0f, 0.0f),
+									 glm::vec3(0.0f, 0.0f, 1.0f));
+		glm::mat4 proj = glm::perspective(
+			glm::radians(45.0f),
+			swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
+		proj[1][1] *= -1;
+		glm::mat4 viewProj = proj * view;
+
+		float planes[6][4];
+		extractFrustumPlanes(&viewProj[0][0], planes);
+		benchmarkFrustumCulling(jobSystem, planes,
+								FRUSTUM_CULL_BENCHMARK_COUNT, 4.0f, std::cout);
+	}
+
+	// coarsest LOD whose error, projected at the nearest point of the model
+	// bounds, stays within LOD_PIXEL_ERROR
+	uint32_t selectModelLod() const {
+		glm::mat4 modelView = frameTransforms.view * frameTransforms.model;
+
+		// * the quantization box is the model bounds, the error grows with
+		// * the largest scale the model view matrix applies
+		glm::vec3 center = positionOffset + 0.5f * positionScale;
+		float radius = 0.5f * glm::length(positionScale);
+		// * instances share one LOD, picked for the nearest point of the
+		// * field they cover and drawn at their reduced scale
+		float errorScale = 1.0f;
+		if (instanceCount > 1) {
+			errorScale = instanceScale(instanceCount);
+			radius += 0.5f * std::sqrt(2.0f) *
+					  std::max(positionScale.x, positionScale.y);
+		}
+		float scale = std::max({glm::length(glm::vec3(modelView[0])),
+								glm::length(glm::vec3(modelView[1])),
+								glm::length(glm::vec3(modelView[2]))});
+		glm::vec4 viewCenter = modelView * glm::vec4(center, 1.0f);
+		float distance = std::max(-viewCenter.z - radius * scale, 1e-3f);
+
+		// proj[1][1] is cot(fovy / 2), negated for the Vulkan y flip
+		float pixelsPerUnit = std::fabs(frameTransforms.proj[1][1]) * scale *
+							  0.5f * swapChainExtent.height / distance;
+
+		uint32_t lod = 0;
+		while (lod + 1 < modelLods.size() &&
+			   modelLods[lod + 1].error * errorScale * pixelsPerUnit <=
+				   LOD_PIXEL_ERROR) {
+			lod++;
+		}
+		return lod;
+	}
+
+	// * sets come from growing pools instead of one pool sized for exactly
+	// * the sets created here (see descriptor_allocator.hpp). Static command
+	// * buffers keep referencing the persistent sets, command buffers
+	// * recorded every frame take a transient set of their frame instead
+	void createDescriptorAllocators() {
+		std::vector<DescriptorPoolRatio> ratios = {
+			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}};
+		// * the placeholder and the model set of every frame fit the first
+		descriptorAllocator.create(
+			device, ratios, static_cast<uint32_t>(2 * MAX_FRAMES_IN_FLIGHT));
+		frameDescriptorAllocators.resize(MAX_FRAMES_IN_FLIGHT);
+		transientDescriptorSets.assign(MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+		for (DescriptorAllocator &allocator : frameDescriptorAllocators) {
+			allocator.create(device, ratios, 16);
+		}
+
+		// * bindless, the per frame set holds only the uniform buffer
+		std::vector<VkDescriptorUpdateTemplateEntry> entries(
+			bindlessTextures ? 1 : 2);
+		entries[0].dstBinding = 0;
+		entries[0].descriptorCount = 1;
+		entries[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		entries[0].offset = offsetof(FrameDescriptors, uniforms);
+		entries[0].stride = sizeof(VkDescriptorBufferInfo);
+		if (!bindlessTextures) {
+			entries[1].dstBinding = 1;
+			entries[1].descriptorCount = 1;
+			entries[1].descriptorType =
 				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].descriptorCount = 1;
-			descriptorWrites[1].pImageInfo = &imageInfo;
+			entries[1].offset = offsetof(FrameDescriptors, texture);
+			entries[1].stride = sizeof(VkDescriptorImageInfo);
+		}
 
-			vkUpdateDescriptorSets(
-				device, static_cast<uint32_t>(descriptorWrites.size()),
-				descriptorWrites.data(), 0, nullptr);
+		PFN_vkCreateDescriptorUpdateTemplateKHR createTemplate = nullptr;
+		PFN_vkDestroyDescriptorUpdateTemplateKHR destroyTemplate = nullptr;
+		PFN_vkUpdateDescriptorSetWithTemplateKHR updateWithTemplate = nullptr;
+		if (descriptorUpdateTemplateSupported) {
+			createTemplate =
+				reinterpret_cast<PFN_vkCreateDescriptorUpdateTemplateKHR>(
+					vkGetDeviceProcAddr(device,
+										"vkCreateDescriptorUpdateTemplateKHR"));
+			destroyTemplate =
+				reinterpret_cast<PFN_vkDestroyDescriptorUpdateTemplateKHR>(
+					vkGetDeviceProcAddr(
+						device, "vkDestroyDescriptorUpdateTemplateKHR"));
+			updateWithTemplate =
+				reinterpret_cast<PFN_vkUpdateDescriptorSetWithTemplateKHR>(
+					vkGetDeviceProcAddr(
+						device, "vkUpdateDescriptorSetWithTemplateKHR"));
 		}
+		frameDescriptorTemplate.create(device, descriptorSetLayout, entries,
+									   createTemplate, destroyTemplate,
+									   updateWithTemplate);
+		std::cout << "    "
+				  << (STATIC_COMMAND_BUFFERS ? "persistent" : "transient")
+				  << " frame sets, "
+				  << (frameDescriptorTemplate.usesTemplate()
+						  ? "written with an update template"
+						  : "written with vkUpdateDescriptorSets")
+				  << std::endl;
 	}
 
-	void createIndexBuffer() {
-		VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+	void createDescriptorSets() {
+		// * placeholder and model sets per frame, the latter are written
+		// * once the asset upload finished while the former are in use.
+		// * Transient sets are written for the state of each frame instead
+		if (STATIC_COMMAND_BUFFERS) {
+			for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+				descriptorSets.push_back(
+					descriptorAllocator.allocate(descriptorSetLayout));
+				placeholderDescriptorSets.push_back(
+					descriptorAllocator.allocate(descriptorSetLayout));
+			}
+			writeDescriptorSets(placeholderDescriptorSets,
+								placeholderTextureImageView);
+		}
+		if (bindlessTextures) {
+			placeholderMaterial =
+				textureArray.add(placeholderTextureImageView, textureSampler);
+		}
+	}
+
+	void writeDescriptorSets(const std::vector<VkDescriptorSet> &sets,
+							 VkImageView imageView) {
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			writeFrameDescriptors(sets[i], i, imageView);
+		}
+	}
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					 stagingBuffer, stagingBufferMemory);
+	// * frame's uniform buffer and, without bindless textures, imageView
+	void writeFrameDescriptors(VkDescriptorSet set, uint32_t frame,
+							   VkImageView imageView) {
+		FrameDescriptors descriptors{};
+		descriptors.uniforms.buffer = uniformBuffers[frame];
+		descriptors.uniforms.offset = 0;
+		descriptors.uniforms.range = sizeof(UniformBufferObject);
+		descriptors.texture.imageLayout =
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		descriptors.texture.imageView = imageView;
+		descriptors.texture.sampler = textureSampler;
+		frameDescriptorTemplate.update(set, &descriptors);
+	}
+
+	// * once the frame's fence signaled, before its command buffer is
+	// * recorded: the sets of its last submission are released all at once
+	// * and the frame gets a fresh one for the current asset state
+	void allocateTransientDescriptorSet(uint32_t frame) {
+		DescriptorAllocator &allocator = frameDescriptorAllocators[frame];
+		allocator.reset();
+		transientDescriptorSets[frame] =
+			allocator.allocate(descriptorSetLayout);
+		writeFrameDescriptors(transientDescriptorSets[frame], frame,
+							  assetState == AssetState::Ready
+								  ? textureImageView
+								  : placeholderTextureImageView);
+	}
 
-		void *data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, indices.data(), (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
+	void createIndexBuffer() {
+		VkDeviceSize bufferSize = indexSize() * indexCount;
 
 		createBuffer(bufferSize,
 					 VK_BUFFER_USAGE_TRANSFER_DST_BIT |
@@ -1451,26 +2848,37 @@ class HelloTriangleApplication {
 					 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer,
 					 indexBufferMemory);
 
-		copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+		const char *cached =
+			meshCache.isOpen()
+				? static_cast<const char *>(
+					  meshCache.section(MESH_SECTION_INDICES))
+				: nullptr;
+		stagingRing.stream(
+			bufferSize, indexSize(),
+			[&](void *data, VkDeviceSize offset, VkDeviceSize bytes) {
+				if (cached != nullptr) {
+					memcpy(data, cached + offset, (size_t)bytes);
+				} else if (indexType == VK_INDEX_TYPE_UINT16) {
+					// narrow straight into the staging memory
+					packIndicesUint16(indices.data() + offset / 2, bytes / 2,
+									  static_cast<uint16_t *>(data));
+				} else {
+					memcpy(data, indices.data() + offset / 4, (size_t)bytes);
+				}
+			},
+			[&](const StagingAllocation &staging, VkDeviceSize offset) {
+				copyBuffer(assetTransferCommands, staging.buffer,
+						   staging.offset, indexBuffer, offset, staging.size);
+			});
+	}
 
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+	VkDeviceSize indexSize() const {
+		return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+												 : sizeof(uint32_t);
 	}
 
 	void createVertexBuffer() {
-		VkDeviceSize bufferSize = sizeof(Vertex) * vertices.size();
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					 stagingBuffer, stagingBufferMemory);
-
-		void *data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, vertices.data(), (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
+		VkDeviceSize bufferSize = sizeof(Vertex) * vertexCount;
 
 		createBuffer(bufferSize,
 					 VK_BUFFER_USAGE_TRANSFER_DST_BIT |
@@ -1478,15 +2886,25 @@ class HelloTriangleApplication {
 					 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer,
 					 vertexBufferMemory);
 
-		copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		const char *source = static_cast<const char *>(
+			meshCache.isOpen() ? meshCache.section(MESH_SECTION_VERTICES)
+							   : static_cast<const void *>(vertices.data()));
+		stagingRing.stream(
+			bufferSize, sizeof(Vertex),
+			[&](void *data, VkDeviceSize offset, VkDeviceSize bytes) {
+				memcpy(data, source + offset, (size_t)bytes);
+			},
+			[&](const StagingAllocation &staging, VkDeviceSize offset) {
+				copyBuffer(assetTransferCommands, staging.buffer,
+						   staging.offset, vertexBuffer, offset, staging.size);
+			});
 	}
 
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 					  VkMemoryPropertyFlags properties, VkBuffer &buffer,
-					  VkDeviceMemory &bufferMemory) {
+					  DeviceAllocation &bufferMemory,
+					  DeviceAllocationStrategy strategy =
+						  DeviceAllocationStrategy::General) {
 		// * set buffer information
 		VkBufferCreateInfo bufferInfo{};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1503,28 +2921,22 @@ class HelloTriangleApplication {
 		VkMemoryRequirements memRequirements;
 		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex =
-			findMemoryType(memRequirements.memoryTypeBits, properties);
-
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) !=
-			VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate buffer memory!");
-		}
+		bufferMemory = deviceAllocator.allocate(
+			memRequirements, properties, DeviceResourceKind::Buffer,
+			bufferMemoryCategory(usage), strategy);
 
-		vkBindBufferMemory(device, buffer, bufferMemory, 0);
+		vkBindBufferMemory(device, buffer, bufferMemory.memory,
+						   bufferMemory.offset);
 	}
 
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
+	void copyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer,
+					VkDeviceSize srcOffset, VkBuffer dstBuffer,
+					VkDeviceSize dstOffset, VkDeviceSize size) {
 		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = srcOffset;
+		copyRegion.dstOffset = dstOffset;
 		copyRegion.size = size;
 		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-		endSingleTimeCommands(commandBuffer);
 	}
 
 	void updateUniformBuffer(uint32_t currentImage) {
@@ -1536,19 +2948,36 @@ class HelloTriangleApplication {
 						 .count();
 		float speedRatio = 0.25f;
 
-		UniformBufferObject ubo{};
-		ubo.model = glm::rotate(glm::mat4(1.0f),
-								speedRatio * time * glm::radians(90.0f),
-								glm::vec3(0.0f, 0.0f, 1.0f));
-
-		ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f),
-							   glm::vec3(0.0f, 0.0f, 0.0f),
-							   glm::vec3(0.0f, 0.0f, 1.0f));
-		ubo.proj = glm::perspective(
+		// * the camera orbits the model around z, the same picture as the
+		// * model turning in front of it, but only the per-view data changes
+		FrameTransforms &frame = frameTransforms;
+		frame.model = MODEL_TRANSFORM;
+
+		frame.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f),
+								 glm::vec3(0.0f, 0.0f, 0.0f),
+								 glm::vec3(0.0f, 0.0f, 1.0f)) *
+					 glm::rotate(glm::mat4(1.0f),
+								 speedRatio * time * glm::radians(90.0f),
+								 glm::vec3(0.0f, 0.0f, 1.0f));
+		frame.proj = glm::perspective(
 			glm::radians(45.0f),
 			swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
-		ubo.proj[1][1] *= -1;
+		frame.proj[1][1] *= -1;
+		frame.modelViewProj = frame.proj * frame.view * frame.model;
+
+		if (assetState == AssetState::Ready) {
+			frame.positionScale = glm::vec4(positionScale, 0.0f);
+			frame.positionOffset = glm::vec4(positionOffset, 0.0f);
+		} else {
+			// the placeholder quad covers [-0.5, 0.5]^2 on the floor
+			frame.positionScale = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+			frame.positionOffset = glm::vec4(-0.5f, -0.5f, 0.0f, 0.0f);
+		}
 
+		UniformBufferObject ubo{};
+		ubo.viewProj = frame.proj * frame.view;
+		ubo.positionScale = frame.positionScale;
+		ubo.positionOffset = frame.positionOffset;
 		memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
 	}
 
@@ -1560,13 +2989,34 @@ class HelloTriangleApplication {
 			glfwWaitEvents();
 		}
 
-		vkDeviceWaitIdle(device);
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			vkDeviceWaitIdle(device);
+		}
 
 		cleanupSwapChain();
 
 		createSwapChain();
 		createImageViews();
+
+		// * the depth attachment (and its pyramid) follow the new extent
+		UploadBatch uploads;
+		uploads.begin(device, commandPool);
+		createDepthResources(uploads);
+		if (gpuCulling) {
+			createDepthPyramid(uploads);
+		}
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			uploads.submit(graphicsQueue);
+		}
+		uploads.wait();
+		uploads.destroy();
+
 		createFrameBuffers();
+		if (STATIC_COMMAND_BUFFERS) {
+			createStaticCommandBuffers();
+		}
 	}
 
 	void createTextureImage() {
@@ -1582,19 +3032,8 @@ class HelloTriangleApplication {
 			throw std::runtime_error("failed to load texture image!");
 		}
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					 stagingBuffer, stagingBufferMemory);
-
-		void *data;
-		vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
-		vkUnmapMemory(device, stagingBufferMemory);
-
-		stbi_image_free(pixels);
+		textureWidth = texWidth;
+		textureHeight = texHeight;
 
 		createImage(texWidth, texHeight, mipLevels, VK_FORMAT_R8G8B8A8_SRGB,
 					VK_IMAGE_TILING_OPTIMAL,
@@ -1607,28 +3046,46 @@ class HelloTriangleApplication {
 		// copy staging buffer to texture image (2 steps).
 		// 1. transition into DST_OPTIMAL
 		// 2. Execute buffer copy
-		transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-							  VK_IMAGE_LAYOUT_UNDEFINED,
-							  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-
-		copyBufferToImage(stagingBuffer, textureImage,
-						  static_cast<uint32_t>(texWidth),
-						  static_cast<uint32_t>(texHeight));
-
-		// transition for shader access
-		// transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-		// 					  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		// 					  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		// 					  mipLevels);
-
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = textureImage;
+		barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0,
+									1};
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(assetTransferCommands,
+							 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+							 nullptr, 1, &barrier);
+
+		// stream whole rows, each chunk lands in its own band of the image
+		VkDeviceSize rowPitch = static_cast<VkDeviceSize>(texWidth) * 4;
+		stagingRing.stream(
+			imageSize, rowPitch,
+			[&](void *data, VkDeviceSize offset, VkDeviceSize bytes) {
+				memcpy(data, pixels + offset, (size_t)bytes);
+			},
+			[&](const StagingAllocation &staging, VkDeviceSize offset) {
+				uint32_t rows = static_cast<uint32_t>(staging.size / rowPitch);
+				copyBufferToImage(assetTransferCommands, staging.buffer,
+								  staging.offset, textureImage,
+								  static_cast<uint32_t>(texWidth), rows,
+								  static_cast<int32_t>(offset / rowPitch));
+			});
+		stbi_image_free(pixels);
 
-		generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth,
-						texHeight, mipLevels);
+		// * the mip chain is blitted by submitAssetUpload, blits need a
+		// * graphics queue and this may be recorded for a transfer-only one
 	}
 
-	void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth,
+	// * the barrier releasing level i - 1 to the fragment shader is merged
+	// * with the one preparing level i as the next blit source
+	void generateMipmaps(UploadBatch &uploads, VkImage image,
+						 VkFormat imageFormat, int32_t texWidth,
 						 int32_t texHeight, uint32_t mipLevels) {
 
 		// Check if image format supports linear blitting
@@ -1642,8 +3099,6 @@ class HelloTriangleApplication {
 				"texture image format does not support linear blitting!");
 		}
 
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		barrier.image = image;
@@ -1664,9 +3119,8 @@ class HelloTriangleApplication {
 			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-								 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
-								 0, nullptr, 1, &barrier);
+			uploads.imageBarrier(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT,
+								 VK_PIPELINE_STAGE_TRANSFER_BIT);
 
 			VkImageBlit blit{};
 			blit.srcOffsets[0] = {0, 0, 0};
@@ -1683,7 +3137,7 @@ class HelloTriangleApplication {
 			blit.dstSubresource.baseArrayLayer = 0;
 			blit.dstSubresource.layerCount = 1;
 
-			vkCmdBlitImage(commandBuffer, image,
+			vkCmdBlitImage(uploads.record(), image,
 						   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
 						   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
 						   VK_FILTER_LINEAR);
@@ -1693,9 +3147,8 @@ class HelloTriangleApplication {
 			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-								 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
-								 nullptr, 0, nullptr, 1, &barrier);
+			uploads.imageBarrier(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT,
+								 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 
 			if (mipWidth > 1)
 				mipWidth /= 2;
@@ -1711,46 +3164,704 @@ class HelloTriangleApplication {
 		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
+		uploads.imageBarrier(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+
+	void createPlaceholderAssets(UploadBatch &uploads) {
+		// * a floor quad with a flat grey texture, small enough to upload
+		// * synchronously before the first frame
+		uint16_t one = floatToHalf(1.0f);
+		const Vertex quad[4] = {{{0, 0, 0, 0}, {0, 0}, {0, 0}},
+								{{65535, 0, 0, 0}, {0, 0}, {one, 0}},
+								{{65535, 65535, 0, 0}, {0, 0}, {one, one}},
+								{{0, 65535, 0, 0}, {0, 0}, {0, one}}};
+		const uint16_t quadIndices[PLACEHOLDER_INDEX_COUNT] = {0, 1, 2,
+															   2, 3, 0};
+		const uint8_t pixel[4] = {128, 128, 128, 255};
+
+		// texel, vertices and indices share one staging allocation
+		VkDeviceSize vertexBytes = sizeof(quad);
+		VkDeviceSize indexBytes = sizeof(quadIndices);
+		StagingAllocation staging =
+			stagingRing.allocate(sizeof(pixel) + vertexBytes + indexBytes);
+		char *bytes = static_cast<char *>(staging.data);
+		memcpy(bytes, pixel, sizeof(pixel));
+		memcpy(bytes + sizeof(pixel), quad, vertexBytes);
+		memcpy(bytes + sizeof(pixel) + vertexBytes, quadIndices, indexBytes);
+
+		createBuffer(vertexBytes,
+					 VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+						 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+					 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					 placeholderVertexBuffer, placeholderVertexBufferMemory,
+					 DeviceAllocationStrategy::Linear);
+		createBuffer(indexBytes,
+					 VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+						 VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+					 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					 placeholderIndexBuffer, placeholderIndexBufferMemory,
+					 DeviceAllocationStrategy::Linear);
+		createImage(1, 1, 1, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
+					VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+						VK_IMAGE_USAGE_SAMPLED_BIT,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					placeholderTextureImage, placeholderTextureImageMemory,
+					DeviceAllocationStrategy::Linear);
+
+		transitionImageLayout(uploads, placeholderTextureImage,
+							  VK_FORMAT_R8G8B8A8_SRGB,
+							  VK_IMAGE_LAYOUT_UNDEFINED,
+							  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		copyBufferToImage(uploads.record(), staging.buffer, staging.offset,
+						  placeholderTextureImage, 1, 1);
+		copyBuffer(uploads.record(), staging.buffer,
+				   staging.offset + sizeof(pixel), placeholderVertexBuffer, 0,
+				   vertexBytes);
+		copyBuffer(uploads.record(), staging.buffer,
+				   staging.offset + sizeof(pixel) + vertexBytes,
+				   placeholderIndexBuffer, 0, indexBytes);
+		transitionImageLayout(uploads, placeholderTextureImage,
+							  VK_FORMAT_R8G8B8A8_SRGB,
+							  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+							  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		placeholderTextureImageView =
+			createImageView(placeholderTextureImage, VK_FORMAT_R8G8B8A8_SRGB);
+	}
+
+	void startAssetLoad() {
+		assetLoadStart = std::chrono::high_resolution_clock::now();
+		assetState = AssetState::Loading;
+		// * on its own thread, not a job system worker: the OBJ parser and
+		// * the mesh processing wait on jobs they submit, which could take
+		// * the only worker (or the ones the pipeline compiles need)
+		assetLoad =
+			std::async(std::launch::async, [this]() { loadAssets(); });
+	}
+
+	// * runs on the loader thread: decodes the texture, loads the model and
+	// * records the copies for the transfer queue. Until assetLoad is ready
+	// * only this thread touches the model and texture members
+	void loadAssets() {
+		// * whenever the staging ring fills up, the copies recorded so far
+		// * are submitted so their regions drain while loading continues
+		beginAssetTransfer();
+		stagingRing.setFlush([this]() {
+			submitAssetTransfer(VK_NULL_HANDLE);
+			beginAssetTransfer();
+		});
+
+		std::cout << "[INFO] loadAssets - createTextureImage()" << std::endl;
+		createTextureImage();
+
+		std::cout << "[INFO] loadAssets - loadModel()" << std::endl;
+		loadModel();
+
+		std::cout << "[INFO] loadAssets - createVertexBuffer()" << std::endl;
+		createVertexBuffer();
+
+		std::cout << "[INFO] loadAssets - createIndexBuffer()" << std::endl;
+		createIndexBuffer();
+
+		recordAssetOwnership(assetTransferCommands, false);
+		submitAssetTransfer(assetTransferSemaphore);
+		stagingRing.setFlush(nullptr);
+		std::cout << "    " << assetTransferSubmits
+				  << " transfer submissions through a "
+				  << STAGING_RING_SIZE / (1024 * 1024) << " MiB staging ring ("
+				  << stagingRing.stallCount() << " stalls)" << std::endl;
+	}
+
+	void beginAssetTransfer() {
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = transferCommandPool;
+		allocInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(device, &allocInfo,
+									 &assetTransferCommands) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate asset commands!");
+		}
+		assetSubmittedCommands.push_back(assetTransferCommands);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(assetTransferCommands, &beginInfo);
+	}
+
+	// submits the current transfer commands from the loader thread, the
+	// last submission signals the semaphore the graphics side waits on
+	void submitAssetTransfer(VkSemaphore signalSemaphore) {
+		if (vkEndCommandBuffer(assetTransferCommands) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record asset upload commands!");
+		}
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &assetTransferCommands;
+		submitInfo.signalSemaphoreCount =
+			signalSemaphore != VK_NULL_HANDLE ? 1 : 0;
+		submitInfo.pSignalSemaphores = &signalSemaphore;
+
+		std::lock_guard<std::mutex> lock(queueMutex);
+		if (vkQueueSubmit(transferQueue, 1, &submitInfo,
+						  stagingRing.submitFence()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit asset upload!");
+		}
+		assetTransferSubmits++;
+	}
+
+	// * queue family ownership transfer of the uploaded resources: the
+	// * release half goes at the end of the transfer queue's commands, the
+	// * acquire half at the start of the graphics queue's. With a shared
+	// * family only the acquire side remains, as a plain barrier
+	void recordAssetOwnership(VkCommandBuffer commandBuffer, bool acquire) {
+		bool transferOwnership = transferQueueFamily != graphicsQueueFamily;
+		if (!acquire && !transferOwnership) {
+			return;
+		}
+
+		uint32_t srcFamily =
+			transferOwnership ? transferQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+		uint32_t dstFamily =
+			transferOwnership ? graphicsQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+		// an acquire's source access is ignored, its release already made
+		// the transfer writes available
+		VkAccessFlags srcAccess = acquire && transferOwnership
+									  ? 0
+									  : VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		std::array<VkBufferMemoryBarrier, 2> bufferBarriers{};
+		VkBuffer buffers[2] = {vertexBuffer, indexBuffer};
+		VkAccessFlags bufferAccess[2] = {VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+										 VK_ACCESS_INDEX_READ_BIT};
+		for (size_t i = 0; i < bufferBarriers.size(); i++) {
+			bufferBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferBarriers[i].srcAccessMask = srcAccess;
+			bufferBarriers[i].dstAccessMask = acquire ? bufferAccess[i] : 0;
+			bufferBarriers[i].srcQueueFamilyIndex = srcFamily;
+			bufferBarriers[i].dstQueueFamilyIndex = dstFamily;
+			bufferBarriers[i].buffer = buffers[i];
+			bufferBarriers[i].offset = 0;
+			bufferBarriers[i].size = VK_WHOLE_SIZE;
+		}
+
+		// the image stays in TRANSFER_DST for the mip blits
+		VkImageMemoryBarrier imageBarrier{};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarrier.srcQueueFamilyIndex = srcFamily;
+		imageBarrier.dstQueueFamilyIndex = dstFamily;
+		imageBarrier.image = textureImage;
+		imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0,
+										 mipLevels, 0, 1};
+		imageBarrier.srcAccessMask = srcAccess;
+		imageBarrier.dstAccessMask =
+			acquire ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+					: 0;
+
+		VkPipelineStageFlags dstStage =
+			acquire ? VK_PIPELINE_STAGE_TRANSFER_BIT |
+						  VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
+					: VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
 		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-							 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
-							 nullptr, 0, nullptr, 1, &barrier);
+							 dstStage, 0, 0, nullptr,
+							 static_cast<uint32_t>(bufferBarriers.size()),
+							 bufferBarriers.data(), transferOwnership ? 1 : 0,
+							 &imageBarrier);
+	}
+
+	void submitAssetUpload() {
+		// * the copies were submitted by the loader, the graphics side
+		// * acquires the resources and blits the mip chain in one batch that
+		// * updateAssetLoad polls
+		assetUploads.begin(device, commandPool);
+		recordAssetOwnership(assetUploads.record(), true);
+		generateMipmaps(assetUploads, textureImage, VK_FORMAT_R8G8B8A8_SRGB,
+						textureWidth, textureHeight, mipLevels);
+
+		std::lock_guard<std::mutex> lock(queueMutex);
+		assetUploads.submit(graphicsQueue, VK_NULL_HANDLE,
+							assetTransferSemaphore,
+							VK_PIPELINE_STAGE_TRANSFER_BIT);
+	}
+
+	// called once per frame, never blocks on the loader or the GPU
+	void updateAssetLoad() {
+		if (assetState == AssetState::Loading &&
+			assetLoad.wait_for(std::chrono::seconds(0)) ==
+				std::future_status::ready) {
+			// rethrows whatever the loader failed with
+			assetLoad.get();
+			submitAssetUpload();
+			assetState = AssetState::Uploading;
+		}
+
+		if (assetState == AssetState::Uploading && assetUploads.isComplete()) {
+			finishAssetLoad();
+			assetState = AssetState::Ready;
+			// * laid out around the placeholder so far, a single instance is
+			// * the identity either way
+			if (instanceCount > 1) {
+				updateInstances(instanceCount);
+			}
+		}
+	}
+
+	// reports once every requested pipeline finished compiling, also
+	// surfaces a failed compile, called once per frame
+	void updatePipelines() {
+		if (pipelinesReported || pipelineCompiler.pendingCount() != 0) {
+			return;
+		}
+		std::cout << "[INFO] pipelines ready "
+				  << pipelineCompiler.batchMilliseconds()
+				  << " ms after they were requested" << std::endl;
+		pipelineCache.printStats(std::cout);
+		pipelinesReported = true;
+	}
+
+	void finishAssetLoad() {
+		// the graphics submission waited for the last transfer one, which
+		// in turn comes after all earlier ones on the transfer queue
+		vkFreeCommandBuffers(
+			device, transferCommandPool,
+			static_cast<uint32_t>(assetSubmittedCommands.size()),
+			assetSubmittedCommands.data());
+		assetSubmittedCommands.clear();
+		assetUploads.wait();
+
+		createTextureImageView();
+		if (STATIC_COMMAND_BUFFERS) {
+			writeDescriptorSets(descriptorSets, textureImageView);
+		}
+		if (bindlessTextures) {
+			modelMaterial = textureArray.add(textureImageView, textureSampler);
+		}
+		createMeshletDrawBuffers();
 
-		endSingleTimeCommands(commandBuffer);
+		// * cullMeshlets tests the spheres as structure of arrays
+		meshletBounds.clear();
+		meshletBounds.reserve(meshlets.size());
+		for (const Meshlet &meshlet : meshlets) {
+			meshletBounds.push_back(meshlet.center, meshlet.radius);
+		}
+		meshletVisibility.assign(meshlets.size(), 0);
+
+		double readyMillis =
+			std::chrono::duration<double, std::milli>(
+				std::chrono::high_resolution_clock::now() - assetLoadStart)
+				.count();
+		std::cout << "[INFO] assets ready " << readyMillis
+				  << " ms after loading started, " << placeholderFrames
+				  << " placeholder frames drawn" << std::endl;
+		std::cout << "[INFO] device memory with assets loaded" << std::endl;
+		deviceAllocator.printReport(std::cout);
 	}
 
 	void loadModel() {
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		MeshSourceInfo source;
+		if (!queryMeshSource(MODEL_PATH, source)) {
+			throw std::runtime_error("failed to open model file!");
+		}
+
+		if (loadModelFromCache(source)) {
+			double loadMillis =
+				std::chrono::duration<double, std::milli>(
+					std::chrono::high_resolution_clock::now() - startTime)
+					.count();
+			const MeshCacheHeader &header = meshCache.header();
+			std::cout << "    mesh cache hit: " << indexCount << " indices, "
+					  << vertexCount << " vertices in " << loadMillis
+					  << " ms (saved ~" << header.buildMillis - loadMillis
+					  << " ms of OBJ processing)" << std::endl;
+			return;
+		}
+
+		loadObjModel(source);
+		if (OPTIMIZE_MODEL) {
+			optimizeModel();
+		}
+		if (ENABLE_MESHLET_CULLING) {
+			buildModelMeshlets();
+		}
+		buildModelLods();
+		quantizeModel();
+
+		double buildMillis =
+			std::chrono::duration<double, std::milli>(
+				std::chrono::high_resolution_clock::now() - startTime)
+				.count();
+		std::cout << "    OBJ processed in " << buildMillis << " ms"
+				  << std::endl;
+
+		writeModelCache(source, buildMillis);
+	}
+
+	bool loadModelFromCache(const MeshSourceInfo &source) {
+		if (!meshCache.open(MODEL_CACHE_PATH, source,
+							MODEL_CACHE_FORMAT_VERSION)) {
+			return false;
+		}
+
+		const MeshCacheHeader &header = meshCache.header();
+		uint64_t vertexBytes = 0, indexBytes = 0;
+		const void *vertexBlob =
+			meshCache.section(MESH_SECTION_VERTICES, &vertexBytes);
+		const void *indexBlob =
+			meshCache.section(MESH_SECTION_INDICES, &indexBytes);
+		uint64_t quantizationBytes = 0;
+		const float *quantization = static_cast<const float *>(
+			meshCache.section(MESH_SECTION_QUANTIZATION, &quantizationBytes));
+
+		uint64_t meshletBytes = 0;
+		const void *meshletBlob =
+			meshCache.section(MESH_SECTION_MESHLETS, &meshletBytes);
+		uint64_t lodBytes = 0;
+		const MeshLod *lodBlob = static_cast<const MeshLod *>(
+			meshCache.section(MESH_SECTION_LODS, &lodBytes));
+
+		if (lodBlob == nullptr || lodBytes == 0 ||
+			lodBytes % sizeof(MeshLod) != 0 ||
+			((ENABLE_MESHLET_CULLING &&
+			 (meshletBlob == nullptr || meshletBytes % sizeof(Meshlet) != 0))) ||
+			quantization == nullptr ||
+			quantizationBytes != 6 * sizeof(float) ||
+			header.vertexStride != sizeof(Vertex) || vertexBlob == nullptr ||
+			indexBlob == nullptr ||
+			vertexBytes != uint64_t(header.vertexCount) * sizeof(Vertex) ||
+			indexBytes != uint64_t(header.indexCount) * header.indexSize ||
+			(header.indexSize != 2 && header.indexSize != 4)) {
+			meshCache.close();
+			return false;
+		}
+
+		// * every range the draws will use must lie inside the index blob
+		// * and cover whole triangles, a truncated or corrupt cache is
+		// * rejected here and the OBJ parsed again
+		auto validRange = [&](uint32_t offset, uint32_t count) {
+			return count % 3 == 0 && offset % 3 == 0 &&
+				   uint64_t(offset) + count <= header.indexCount;
+		};
+		const Meshlet *cachedMeshlets =
+			static_cast<const Meshlet *>(meshletBlob);
+		size_t meshletCount =
+			ENABLE_MESHLET_CULLING ? meshletBytes / sizeof(Meshlet) : 0;
+		bool valid = true;
+		for (size_t i = 0; valid && i < meshletCount; i++) {
+			valid = validRange(cachedMeshlets[i].indexOffset,
+							   cachedMeshlets[i].indexCount);
+		}
+		for (size_t i = 0; valid && i < lodBytes / sizeof(MeshLod); i++) {
+			valid = validRange(lodBlob[i].indexOffset, lodBlob[i].indexCount);
+		}
+		if (!valid) {
+			meshCache.close();
+			return false;
+		}
+
+		// * vertices/indices stay empty, the buffers are filled straight from
+		// * the mapping in createVertexBuffer/createIndexBuffer
+		vertexCount = header.vertexCount;
+		indexCount = header.indexCount;
+		positionScale = glm::vec3(quantization[0], quantization[1],
+								  quantization[2]);
+		positionOffset = glm::vec3(quantization[3], quantization[4],
+								   quantization[5]);
+		indexType = header.indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16
+														 : VK_INDEX_TYPE_UINT32;
+		meshlets.assign(cachedMeshlets, cachedMeshlets + meshletCount);
+		// the chain is always cached, ENABLE_MODEL_LODS only limits its use
+		modelLods.assign(lodBlob, lodBlob + (ENABLE_MODEL_LODS
+												 ? lodBytes / sizeof(MeshLod)
+												 : 1));
+		return true;
+	}
+
+	void writeModelCache(const MeshSourceInfo &source, double buildMillis) {
+		MeshCacheHeader header{};
+		header.formatVersion = MODEL_CACHE_FORMAT_VERSION;
+		header.sourceSize = source.size;
+		header.sourceMtime = source.mtime;
+		header.sourceHash = source.hash;
+		header.buildMillis = buildMillis;
+		header.vertexStride = sizeof(Vertex);
+		header.vertexCount = vertexCount;
+		header.indexCount = indexCount;
+		header.indexSize = static_cast<uint32_t>(indexSize());
+
+		// the index blob is stored in its final GPU format
+		std::vector<uint16_t> packedIndices;
+		const void *indexBlob = indices.data();
+		if (indexType == VK_INDEX_TYPE_UINT16) {
+			packedIndices.resize(indices.size());
+			packIndicesUint16(indices.data(), indices.size(),
+							  packedIndices.data());
+			indexBlob = packedIndices.data();
+		}
+
+		MeshCacheWriter writer;
+		writer.addSection(MESH_SECTION_VERTICES, vertices.data(),
+						  sizeof(Vertex) * vertices.size());
+		writer.addSection(MESH_SECTION_INDICES, indexBlob,
+						  indexSize() * indices.size());
+		const float quantization[6] = {
+			positionScale.x,  positionScale.y,	positionScale.z,
+			positionOffset.x, positionOffset.y, positionOffset.z};
+		writer.addSection(MESH_SECTION_QUANTIZATION, quantization,
+						  sizeof(quantization));
+		if (!meshlets.empty()) {
+			writer.addSection(MESH_SECTION_MESHLETS, meshlets.data(),
+							  sizeof(Meshlet) * meshlets.size());
+		}
+		writer.addSection(MESH_SECTION_LODS, modelLods.data(),
+						  sizeof(MeshLod) * modelLods.size());
+
+		if (!writer.write(MODEL_CACHE_PATH, header)) {
+			std::cerr << "    failed to write mesh cache " << MODEL_CACHE_PATH
+					  << std::endl;
+		}
+	}
+
+	void loadObjModel(const MeshSourceInfo &source) {
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		std::string warn, err;
 
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-							  MODEL_PATH.c_str())) {
+		if (source.size >= PARALLEL_OBJ_THRESHOLD) {
+			ObjParseStats stats;
+			if (!loadObjParallel(jobSystem, attrib, shapes, MODEL_PATH, err,
+								 stats)) {
+				throw std::runtime_error(err);
+			}
+			std::cout << "    parsed " << stats.bytes / (1024.0 * 1024.0)
+					  << " MB in " << stats.millis << " ms ("
+					  << stats.megabytesPerSecond() << " MB/s, "
+					  << stats.threads << " threads, " << stats.chunks
+					  << " chunks)" << std::endl;
+		} else if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
+									 MODEL_PATH.c_str())) {
 			throw std::runtime_error(err);
 		}
 
+		size_t cornerCount = 0;
+		for (const auto &shape : shapes) {
+			cornerCount += shape.mesh.indices.size();
+		}
+
+		// * deduplicate identical vertices so the index buffer actually
+		// * references shared vertices instead of one vertex per corner
+		MeshBuilder<MeshVertex> builder(cornerCount);
+
 		for (const auto &shape : shapes) {
 			for (const auto &index : shape.mesh.indices) {
-				Vertex vertex{};
+				MeshVertex vertex{};
 
 				vertex.pos = {attrib.vertices[3 * index.vertex_index + 0],
 							  attrib.vertices[3 * index.vertex_index + 1],
 							  attrib.vertices[3 * index.vertex_index + 2]};
 
-				vertex.normal = {attrib.normals[3 * index.normal_index + 0],
-								 attrib.normals[3 * index.normal_index + 1],
-								 attrib.normals[3 * index.normal_index + 2]};
+				if (index.normal_index >= 0) {
+					vertex.normal = {
+						attrib.normals[3 * index.normal_index + 0],
+						attrib.normals[3 * index.normal_index + 1],
+						attrib.normals[3 * index.normal_index + 2]};
+				}
+
+				if (index.texcoord_index >= 0) {
+					vertex.texCoord = {
+						attrib.texcoords[2 * index.texcoord_index + 0],
+						1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+				}
+
+				builder.addVertex(vertex);
+			}
+		}
 
-				vertex.texCoord = {
-					attrib.texcoords[2 * index.texcoord_index + 0],
-					1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+		indexType = builder.fitsUint16() ? VK_INDEX_TYPE_UINT16
+										 : VK_INDEX_TYPE_UINT32;
+		meshVertices = std::move(builder.vertices);
+		indices = std::move(builder.indices);
+		vertexCount = static_cast<uint32_t>(meshVertices.size());
+		indexCount = static_cast<uint32_t>(indices.size());
+
+		std::cout << "    " << indices.size() << " indices, "
+				  << meshVertices.size() << " unique vertices ("
+				  << (meshVertices.empty()
+						  ? 0.0
+						  : double(indices.size()) / meshVertices.size())
+				  << "x reuse), "
+				  << (indexType == VK_INDEX_TYPE_UINT16 ? "16" : "32")
+				  << "-bit indices" << std::endl;
+	}
+
+	void optimizeModel() {
+		if (indices.empty()) {
+			return;
+		}
 
-				vertex.color = {1.0f, 1.0f, 1.0f};
+		VertexCacheStats before = analyzeVertexCache(
+			indices.data(), indices.size(), meshVertices.size());
 
-				vertices.push_back(vertex);
-				indices.push_back(indices.size());
+		std::vector<uint32_t> clusterStarts;
+		optimizeVertexCache(indices.data(), indices.size(), meshVertices.size(),
+							VERTEX_CACHE_SIZE, &clusterStarts);
+		if (OPTIMIZE_MODEL_OVERDRAW) {
+			optimizeOverdraw(indices.data(), indices.size(),
+							 &meshVertices[0].pos.x, sizeof(MeshVertex),
+							 meshVertices.size(), clusterStarts);
+		}
+		optimizeVertexFetch(meshVertices, indices.data(), indices.size());
+		vertexCount = static_cast<uint32_t>(meshVertices.size());
+
+		VertexCacheStats after = analyzeVertexCache(
+			indices.data(), indices.size(), meshVertices.size());
+		std::cout << "    vertex cache (" << VERTEX_CACHE_SIZE
+				  << " entry FIFO): ACMR " << before.acmr << " -> " << after.acmr
+				  << ", ATVR " << before.atvr << " -> " << after.atvr << " ("
+				  << clusterStarts.size() << " clusters)" << std::endl;
+	}
+
+	void buildModelMeshlets() {
+		if (indices.empty()) {
+			return;
+		}
+
+		MeshletMesh meshletMesh =
+			buildMeshlets(indices.data(), indices.size(),
+						  &meshVertices[0].pos.x, sizeof(MeshVertex),
+						  meshVertices.size());
+		meshlets = std::move(meshletMesh.meshlets);
+		indices = std::move(meshletMesh.indices);
+		if (OPTIMIZE_MODEL) {
+			// triangles moved, restore first use order for vertex fetch
+			optimizeVertexFetch(meshVertices, indices.data(), indices.size());
+		}
+
+		VertexCacheStats stats = analyzeVertexCache(
+			indices.data(), indices.size(), meshVertices.size());
+		std::cout << "    " << meshlets.size() << " meshlets (max "
+				  << MESHLET_MAX_VERTICES << " vertices / "
+				  << MESHLET_MAX_TRIANGLES << " triangles), "
+				  << double(indices.size() / 3) / meshlets.size()
+				  << " triangles per meshlet, ACMR " << stats.acmr
+				  << std::endl;
+	}
+
+	void buildModelLods() {
+		if (!ENABLE_MODEL_LODS || indices.empty()) {
+			modelLods = {{0, static_cast<uint32_t>(indices.size()), 0.0f, 0}};
+			return;
+		}
+
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+		for (const auto &vertex : meshVertices) {
+			boundsMin = glm::min(boundsMin, vertex.pos);
+			boundsMax = glm::max(boundsMax, vertex.pos);
+		}
+		float extent = glm::length(boundsMax - boundsMin);
+
+		// * normal and texCoord follow each other in MeshVertex, so they are
+		// * handed over as five consecutive attribute floats
+		static_assert(offsetof(MeshVertex, texCoord) ==
+						  offsetof(MeshVertex, normal) + 3 * sizeof(float),
+					  "MeshVertex attributes must be consecutive");
+		float normalWeight = LOD_NORMAL_WEIGHT * extent;
+		float texCoordWeight = LOD_TEXCOORD_WEIGHT * extent;
+		const float attributeWeights[5] = {
+			normalWeight * normalWeight,	 normalWeight * normalWeight,
+			normalWeight * normalWeight,	 texCoordWeight * texCoordWeight,
+			texCoordWeight * texCoordWeight};
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		modelLods = buildLodChain(indices, &meshVertices[0].pos.x,
+								  sizeof(MeshVertex), meshVertices.size(),
+								  &meshVertices[0].normal.x, sizeof(MeshVertex),
+								  5, attributeWeights);
+		indexCount = static_cast<uint32_t>(indices.size());
+		double millis = std::chrono::duration<double, std::milli>(
+							std::chrono::high_resolution_clock::now() - startTime)
+							.count();
+
+		// * the triangles every level actually reached, with the share of the
+		// * level above it: simplification aims for half but stops early
+		// * where borders and seam corners are locked
+		std::cout << "    " << modelLods.size() << " LODs in " << millis
+				  << " ms:";
+		for (size_t i = 0; i < modelLods.size(); i++) {
+			std::cout << " " << modelLods[i].indexCount / 3;
+			if (i > 0) {
+				std::cout << " (" << 100ull * modelLods[i].indexCount /
+										 modelLods[i - 1].indexCount
+						  << "%, " << modelLods[i].error << ")";
 			}
 		}
+		std::cout << " triangles (of previous, error)" << std::endl;
+	}
+
+	void quantizeModel() {
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+		for (const auto &vertex : meshVertices) {
+			boundsMin = glm::min(boundsMin, vertex.pos);
+			boundsMax = glm::max(boundsMax, vertex.pos);
+		}
+		if (meshVertices.empty()) {
+			boundsMin = boundsMax = glm::vec3(0.0f);
+		}
+
+		// * positions become unorm16 inside the bounding box, the shader maps
+		// * them back with pos * positionScale + positionOffset
+		positionOffset = boundsMin;
+		positionScale = boundsMax - boundsMin;
+		glm::vec3 invScale;
+		for (int k = 0; k < 3; k++) {
+			invScale[k] = positionScale[k] > 0.0f ? 1.0f / positionScale[k]
+												  : 0.0f;
+		}
+
+		vertices.resize(meshVertices.size());
+		for (size_t i = 0; i < meshVertices.size(); i++) {
+			const MeshVertex &source = meshVertices[i];
+			Vertex &vertex = vertices[i];
+
+			glm::vec3 normalized = (source.pos - positionOffset) * invScale;
+			for (int k = 0; k < 3; k++) {
+				vertex.pos[k] = quantizeUnorm16(normalized[k]);
+			}
+			vertex.pos[3] = 0;
+			encodeOctahedral(&source.normal.x, vertex.normal);
+			vertex.texCoord[0] = floatToHalf(source.texCoord.x);
+			vertex.texCoord[1] = floatToHalf(source.texCoord.y);
+		}
+
+		std::cout << "    quantized " << vertices.size() << " vertices: "
+				  << sizeof(MeshVertex) << " -> " << sizeof(Vertex)
+				  << " bytes per vertex, "
+				  << sizeof(Vertex) * vertices.size() / 1024 << " KiB"
+				  << std::endl;
+
+		// * the meshlet bounds were computed at full precision, grow them by
+		// * the largest position error quantization introduced
+		float quantizationError =
+			0.5f / 65535.0f *
+			std::sqrt(positionScale.x * positionScale.x +
+					  positionScale.y * positionScale.y +
+					  positionScale.z * positionScale.z);
+		for (Meshlet &meshlet : meshlets) {
+			meshlet.radius += quantizationError;
+		}
+
+		meshVertices.clear();
+		meshVertices.shrink_to_fit();
 	}
 
 	void createTextureSampler() {
@@ -1814,7 +3925,9 @@ class HelloTriangleApplication {
 	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
 					 VkFormat format, VkImageTiling tiling,
 					 VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-					 VkImage &image, VkDeviceMemory &imageMemory) {
+					 VkImage &image, DeviceAllocation &imageMemory,
+					 DeviceAllocationStrategy strategy =
+						 DeviceAllocationStrategy::General) {
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1837,58 +3950,50 @@ class HelloTriangleApplication {
 		VkMemoryRequirements memRequirements;
 		vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex =
-			findMemoryType(memRequirements.memoryTypeBits, properties);
-
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) !=
-			VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate image memory!");
-		}
-
-		vkBindImageMemory(device, image, imageMemory, 0);
-	}
-
-	VkCommandBuffer beginSingleTimeCommands() {
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = commandPool;
-		allocInfo.commandBufferCount = 1;
-
-		VkCommandBuffer commandBuffer;
-		vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		// linear images follow the same granularity rules as buffers
+		imageMemory = deviceAllocator.allocate(
+			memRequirements, properties,
+			tiling == VK_IMAGE_TILING_OPTIMAL ? DeviceResourceKind::Image
+											  : DeviceResourceKind::Buffer,
+			imageMemoryCategory(usage), strategy);
 
-		return commandBuffer;
+		vkBindImageMemory(device, image, imageMemory.memory,
+						  imageMemory.offset);
 	}
 
-	void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-		vkEndCommandBuffer(commandBuffer);
-
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-
-		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphicsQueue);
-
-		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+	// * the placeholder staging memory comes from the ring, so the batch
+	// * signals a ring fence. The stall saved is measured once against the
+	// * single time submits the batch replaced, see measureSingleSubmits
+	void submitUploads(UploadBatch &uploads) {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			uploads.submit(graphicsQueue, stagingRing.submitFence());
+		}
+		uploads.wait();
+		double baselineMillis;
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			baselineMillis = uploads.measureSingleSubmits(
+				graphicsQueue, uploads.operationCount());
+		}
+		double saved = baselineMillis * (uploads.operationCount() -
+										 uploads.submitCount()) /
+					   std::max(1u, uploads.operationCount());
+		std::cout << "    " << uploads.operationCount()
+				  << " upload operations in " << uploads.submitCount()
+				  << " submit with " << uploads.barrierCount()
+				  << " merged barriers, " << uploads.waitMilliseconds()
+				  << " ms stalled" << std::endl;
+		std::cout << "    one submit + vkQueueWaitIdle per operation: "
+				  << baselineMillis << " ms of round trips, saved ~" << saved
+				  << " ms" << std::endl;
+		uploads.destroy();
 	}
 
-	void transitionImageLayout(VkImage image, VkFormat format,
-							   VkImageLayout oldLayout, VkImageLayout newLayout,
+	void transitionImageLayout(UploadBatch &uploads, VkImage image,
+							   VkFormat format, VkImageLayout oldLayout,
+							   VkImageLayout newLayout,
 							   uint32_t mipLevels = 1) {
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		barrier.oldLayout = oldLayout;
@@ -1945,18 +4050,15 @@ class HelloTriangleApplication {
 			throw std::invalid_argument("unsupported layout transition!");
 		}
 
-		vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0,
-							 nullptr, 0, nullptr, 1, &barrier);
-
-		endSingleTimeCommands(commandBuffer);
+		uploads.imageBarrier(barrier, sourceStage, destinationStage);
 	}
 
-	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
-						   uint32_t height) {
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
+	void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer,
+						   VkDeviceSize bufferOffset, VkImage image,
+						   uint32_t width, uint32_t height,
+						   int32_t firstRow = 0) {
 		VkBufferImageCopy region{};
-		region.bufferOffset = 0;
+		region.bufferOffset = bufferOffset;
 		region.bufferRowLength = 0;
 		region.bufferImageHeight = 0;
 
@@ -1965,32 +4067,82 @@ class HelloTriangleApplication {
 		region.imageSubresource.baseArrayLayer = 0;
 		region.imageSubresource.layerCount = 1;
 
-		region.imageOffset = {0, 0, 0};
+		region.imageOffset = {0, firstRow, 0};
 		region.imageExtent = {width, height, 1};
 
 		vkCmdCopyBufferToImage(commandBuffer, buffer, image,
 							   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
 							   &region);
-
-		endSingleTimeCommands(commandBuffer);
 	}
 
 	void mainLoop() {
 
 		double lastTime = glfwGetTime();
 		int frames = 0;
+		auto frameStart = std::chrono::high_resolution_clock::now();
 
 		while (!glfwWindowShouldClose(window)) {
 			glfwPollEvents();
 			drawFrame();
 
+			if (INSTANCE_BENCHMARK) {
+				updateInstanceBenchmark(
+					std::chrono::duration<double, std::milli>(
+						std::chrono::high_resolution_clock::now() - frameStart)
+						.count());
+				frameStart = std::chrono::high_resolution_clock::now();
+			}
+
 			double currentTime = glfwGetTime();
 			frames++;
 			if (currentTime - lastTime >= 1.0) { // one second passed
 				double fps = frames / (currentTime - lastTime);
 
 				// Option A: print to terminal
-				std::cout << "FPS: " << fps << std::endl;
+				std::cout << "FPS: " << fps;
+				if (assetState != AssetState::Ready) {
+					std::cout << " (loading assets)";
+				} else {
+					std::cout << " (LOD " << modelLod << ", "
+							  << modelLods[modelLod].indexCount / 3
+							  << " triangles)";
+				}
+				if (instanceCount > 1 && gpuCulling) {
+					double cullMillis =
+						gpuCuller.cullMilliseconds(currentFrame);
+					std::cout << " (" << visibleInstances << "/"
+							  << instanceCount << " instances drawn";
+					if (occlusionCulling) {
+						std::cout << ", " << occludedInstances
+								  << " occluded, "
+								  << instanceCount - visibleInstances -
+										 occludedInstances
+								  << " outside the frustum";
+					}
+					if (cullMillis > 0.0) {
+						std::cout << ", culled at "
+								  << instanceCount / cullMillis
+								  << " objects/ms";
+					}
+					std::cout << ")";
+				} else if (instanceCount > 1) {
+					std::cout << " (" << instanceCount << " instances)";
+				}
+				if (useMeshletDraws()) {
+					std::cout << " (" << visibleMeshlets << "/"
+							  << meshlets.size() << " meshlets, "
+							  << meshletDrawCount << " draws)";
+				}
+				if (STATIC_COMMAND_BUFFERS) {
+					std::cout << " (" << staticRecordCount
+							  << " command buffers recorded)";
+					staticRecordCount = 0;
+				}
+				std::cout << std::endl;
+				secondaryRecorder.printStats(std::cout);
+				if (OCCLUSION_QUERIES) {
+					occlusionQueries.printStats(std::cout);
+				}
 
 				// Option B: show in window title
 				std::string title =
@@ -2002,7 +4154,10 @@ class HelloTriangleApplication {
 			}
 		}
 
-		vkDeviceWaitIdle(device);
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			vkDeviceWaitIdle(device);
+		}
 	}
 
 	void drawFrame() {
@@ -2026,12 +4181,38 @@ class HelloTriangleApplication {
 
 		// only reset fence if we are submitting work
 		vkResetFences(device, 1, &inFlightFences[currentFrame]);
+		if (gpuCulling) {
+			// * the frame's previous submission finished
+			visibleInstances = gpuCuller.visibleCount(currentFrame);
+			occludedInstances = gpuCuller.occludedCount(currentFrame);
+		}
+		if (OCCLUSION_QUERIES) {
+			occlusionQueries.readResults(currentFrame, instanceCount);
+		}
 
-		// recording the command buffer
-		vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-		recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
-
+		updateAssetLoad();
+		updatePipelines();
 		updateUniformBuffer(currentFrame);
+		if (assetState == AssetState::Ready) {
+			// * the benchmark measures the full mesh
+			modelLod = instanceBenchmark.running() ? 0 : selectModelLod();
+			if (useMeshletDraws()) {
+				meshletDrawCount = cullMeshlets(currentFrame);
+			}
+		}
+		if (gpuCulling) {
+			updateCullParams(currentFrame);
+		}
+
+		// recording the command buffer
+		VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+		if (STATIC_COMMAND_BUFFERS) {
+			commandBuffer = staticCommandBuffer(imageIndex);
+		} else {
+			allocateTransientDescriptorSet(currentFrame);
+			vkResetCommandBuffer(commandBuffer, 0);
+			recordCommandBuffer(commandBuffer, imageIndex, currentFrame);
+		}
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -2045,15 +4226,24 @@ class HelloTriangleApplication {
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+		submitInfo.pCommandBuffers = &commandBuffer;
 
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
+		std::unique_lock<std::mutex> queueLock(queueMutex);
 		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo,
 						  inFlightFences[currentFrame]) != VK_SUCCESS) {
 			throw std::runtime_error("failed to submit draw command buffer!");
 		}
+		if (assetState != AssetState::Ready && placeholderFrames++ == 0) {
+			double firstFrameMillis =
+				std::chrono::duration<double, std::milli>(
+					std::chrono::high_resolution_clock::now() - assetLoadStart)
+					.count();
+			std::cout << "[INFO] first frame submitted " << firstFrameMillis
+					  << " ms after loading started" << std::endl;
+		}
 
 		// presentation
 		VkPresentInfoKHR presentInfo{};
@@ -2068,6 +4258,7 @@ class HelloTriangleApplication {
 		presentInfo.pResults = nullptr;
 
 		result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		queueLock.unlock();
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
 			framebufferResized) {
@@ -2083,6 +4274,7 @@ class HelloTriangleApplication {
 	void cleanupSwapChain() {
 		vkDestroyImageView(device, depthImageView, nullptr);
 		vkDestroyImage(device, depthImage, nullptr);
+		deviceAllocator.free(depthImageMemory);
 
 		for (auto framebuffer : swapChainFramebuffers) {
 			vkDestroyFramebuffer(device, framebuffer, nullptr);
@@ -2098,28 +4290,78 @@ class HelloTriangleApplication {
 	void cleanup() {
 		std::cout << "[INFO] cleanup()" << std::endl;
 
+		// the loader may still be running when the window is closed early
+		if (assetLoad.valid()) {
+			assetLoad.wait();
+		}
+
+		std::cout << "[INFO] device memory at cleanup" << std::endl;
+		deviceAllocator.printReport(std::cout);
+
 		cleanupSwapChain();
 
-		vkDestroyPipeline(device, graphicsPipeline, nullptr);
+		pipelineCompiler.destroy();
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyRenderPass(device, renderPass, nullptr);
+		if (occlusionCulling) {
+			vkDestroyRenderPass(device, earlyRenderPass, nullptr);
+			vkDestroyRenderPass(device, lateRenderPass, nullptr);
+		}
+
+		if (pipelineCache.save()) {
+			std::cout << "[INFO] pipeline cache written to "
+					  << PIPELINE_CACHE_PATH << std::endl;
+		}
+		pipelineCache.destroy();
 
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 			vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-			vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+			deviceAllocator.free(uniformBuffersMemory[i]);
+		}
+
+		for (size_t i = 0; i < meshletDrawBuffers.size(); i++) {
+			vkDestroyBuffer(device, meshletDrawBuffers[i], nullptr);
+			deviceAllocator.free(meshletDrawBuffersMemory[i]);
 		}
 
 		vkDestroySampler(device, textureSampler, nullptr);
 		vkDestroyImageView(device, textureImageView, nullptr);
 		vkDestroyImage(device, textureImage, nullptr);
-		vkFreeMemory(device, textureImageMemory, nullptr);
-		vkFreeMemory(device, depthImageMemory, nullptr);
-		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+		deviceAllocator.free(textureImageMemory);
+		frameDescriptorTemplate.destroy();
+		descriptorAllocator.destroy();
+		for (DescriptorAllocator &allocator : frameDescriptorAllocators) {
+			allocator.destroy();
+		}
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+		if (bindlessTextures) {
+			textureArray.destroy();
+		}
+		vkDestroyBuffer(device, instanceBuffer, nullptr);
+		deviceAllocator.free(instanceBufferMemory);
+		if (gpuCulling) {
+			gpuCuller.destroy();
+			depthPyramid.destroy();
+		}
+		if (OCCLUSION_QUERIES) {
+			occlusionQueries.destroy();
+		}
 		vkDestroyBuffer(device, indexBuffer, nullptr);
 		vkDestroyBuffer(device, vertexBuffer, nullptr);
-		vkFreeMemory(device, indexBufferMemory, nullptr);
-		vkFreeMemory(device, vertexBufferMemory, nullptr);
+		deviceAllocator.free(indexBufferMemory);
+		deviceAllocator.free(vertexBufferMemory);
+		meshCache.close();
+
+		stagingRing.destroy();
+		vkDestroyImageView(device, placeholderTextureImageView, nullptr);
+		vkDestroyImage(device, placeholderTextureImage, nullptr);
+		deviceAllocator.free(placeholderTextureImageMemory);
+		vkDestroyBuffer(device, placeholderIndexBuffer, nullptr);
+		deviceAllocator.free(placeholderIndexBufferMemory);
+		vkDestroyBuffer(device, placeholderVertexBuffer, nullptr);
+		deviceAllocator.free(placeholderVertexBufferMemory);
+		vkDestroySemaphore(device, assetTransferSemaphore, nullptr);
+		assetUploads.destroy();
 
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 			vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
@@ -2128,8 +4370,11 @@ class HelloTriangleApplication {
 		}
 
 		vkDestroyCommandPool(device, commandPool, nullptr);
-		vkDestroyShaderModule(device, vertShaderModule, nullptr);
-		vkDestroyShaderModule(device, fragShaderModule, nullptr);
+		secondaryRecorder.destroy();
+		vkDestroyCommandPool(device, transferCommandPool, nullptr);
+		// anything listed here was created but never destroyed above
+		deviceAllocator.reportLeaks(std::cout);
+		deviceAllocator.destroy();
 		vkDestroyDevice(device, nullptr);
 
 		if (enableValidationLayers) {
@@ -2151,43 +4396,155 @@ class HelloTriangleApplication {
 	VkDebugUtilsMessengerEXT debugMessenger;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	VkDevice device;
-	VkQueue graphicsQueue, presentQueue;
+	DeviceAllocator deviceAllocator;
+	VkQueue graphicsQueue, presentQueue, transferQueue;
+	uint32_t graphicsQueueFamily = 0, transferQueueFamily = 0;
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swapChain;
 	std::vector<VkImage> swapChainImages;
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
 	std::vector<VkImageView> swapChainImageViews;
-	VkShaderModule vertShaderModule, fragShaderModule;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkPipelineLayout pipelineLayout;
 	VkRenderPass renderPass;
-	VkPipeline graphicsPipeline;
+	VkRenderPass earlyRenderPass = VK_NULL_HANDLE;
+	VkRenderPass lateRenderPass = VK_NULL_HANDLE;
+	PipelineRequest graphicsPipeline;
+	PipelineCache pipelineCache;
+	PipelineCompiler pipelineCompiler;
+	bool pipelinesReported = false;
 	std::vector<VkFramebuffer> swapChainFramebuffers;
 	VkCommandPool commandPool;
+	VkCommandPool transferCommandPool;
 	std::vector<VkCommandBuffer> commandBuffers;
 	std::vector<VkSemaphore> imageAvailableSemaphores, renderFinishedSemaphores;
 	std::vector<VkFence> inFlightFences;
 	uint32_t currentFrame = 0;
+
+	// transforms of the frame being recorded, used for culling
+	FrameTransforms frameTransforms{};
+
+	bool multiDrawIndirect = false;
+	bool physicalDeviceProperties2 = false;
+	bool memoryBudgetSupported = false;
+	std::vector<VkBuffer> meshletDrawBuffers;
+	std::vector<DeviceAllocation> meshletDrawBuffersMemory;
+	std::vector<void *> meshletDrawBuffersMapped;
+	uint32_t meshletDrawCount = 0;
+	uint32_t visibleMeshlets = 0;
+	BoundingSpheres meshletBounds;
+	std::vector<uint8_t> meshletVisibility;
 	bool framebufferResized = false;
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
-	VkDescriptorPool descriptorPool;
+
+	// * background asset loading, see startAssetLoad. Model and texture
+	// * members are written by the loader thread until assetLoad is ready
+	// * and only drawn once assetState reaches Ready
+	enum class AssetState { Loading, Uploading, Ready };
+	AssetState assetState = AssetState::Loading;
+	std::future<void> assetLoad;
+	std::chrono::high_resolution_clock::time_point assetLoadStart;
+	uint32_t placeholderFrames = 0;
+	VkCommandBuffer assetTransferCommands = VK_NULL_HANDLE;
+	VkSemaphore assetTransferSemaphore = VK_NULL_HANDLE;
+	UploadBatch assetUploads;
+	std::vector<VkCommandBuffer> assetSubmittedCommands;
+
+	// * STATIC_COMMAND_BUFFERS, [imageIndex * MAX_FRAMES_IN_FLIGHT + frame]
+	struct StaticRecording {
+		bool recorded = false;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		// pushed with the draws
+		glm::mat4 model = glm::mat4(1.0f);
+		AssetState assetState = AssetState::Loading;
+		uint32_t modelLod = 0;
+		uint32_t meshletDrawCount = 0;
+		// meshlet draws recorded into secondaries on the workers
+		bool parallel = false;
+		VkBuffer instanceBuffer = VK_NULL_HANDLE;
+		uint32_t instanceCount = 0;
+		VkPipeline cullPipeline = VK_NULL_HANDLE;
+		VkPipeline depthReducePipeline = VK_NULL_HANDLE;
+		VkPipeline occlusionProxyPipeline = VK_NULL_HANDLE;
+		std::vector<uint8_t> queryVisibility;
+	};
+	std::vector<VkCommandBuffer> staticCommandBuffers;
+	std::vector<StaticRecording> staticRecordings;
+	uint32_t staticRecordCount = 0;
+	uint32_t assetTransferSubmits = 0;
+	StagingRing stagingRing;
+	// * the transfer queue may be the graphics queue, and the loader submits
+	// * from its own thread, so every queue access goes through this
+	std::mutex queueMutex;
+
+	VkBuffer placeholderVertexBuffer = VK_NULL_HANDLE;
+	DeviceAllocation placeholderVertexBufferMemory;
+	VkBuffer placeholderIndexBuffer = VK_NULL_HANDLE;
+	DeviceAllocation placeholderIndexBufferMemory;
+	VkImage placeholderTextureImage = VK_NULL_HANDLE;
+	DeviceAllocation placeholderTextureImageMemory;
+	VkImageView placeholderTextureImageView = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> placeholderDescriptorSets;
+	uint32_t placeholderMaterial = 0;
+
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	DeviceAllocation vertexBufferMemory;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	DeviceAllocation indexBufferMemory;
+	DescriptorAllocator descriptorAllocator;
+	// * !STATIC_COMMAND_BUFFERS, reset every frame
+	std::vector<DescriptorAllocator> frameDescriptorAllocators;
+	std::vector<VkDescriptorSet> transientDescriptorSets;
+	// the descriptor infos of one per frame set, see frameDescriptorTemplate
+	struct FrameDescriptors {
+		VkDescriptorBufferInfo uniforms;
+		VkDescriptorImageInfo texture;
+	};
+	DescriptorUpdateTemplate frameDescriptorTemplate;
+	bool descriptorUpdateTemplateSupported = false;
 	std::vector<VkDescriptorSet> descriptorSets;
 
-	uint32_t mipLevels;
-	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
-	VkImageView textureImageView;
+	// * per instance vertex buffer (binding 1), instanceCapacity instances
+	// * of room, the first instanceCount drawn
+	VkBuffer instanceBuffer = VK_NULL_HANDLE;
+	DeviceAllocation instanceBufferMemory;
+	uint32_t instanceCapacity = 0;
+	uint32_t instanceCount = 0;
+	InstanceBenchmark instanceBenchmark;
+
+	// * GPU_INSTANCE_CULLING, when the device supports it
+	bool gpuCulling = false;
+	bool drawIndirectCountSupported = false;
+	GpuCuller gpuCuller;
+	PipelineRequest cullPipeline = 0;
+	uint32_t visibleInstances = 0;
+	bool occlusionCulling = false;
+	DepthPyramid depthPyramid;
+	PipelineRequest depthReducePipeline = 0;
+	uint32_t occludedInstances = 0;
+
+	// * OCCLUSION_QUERIES, conditional rendering when the device supports it
+	bool conditionalRenderingSupported = false;
+
+	// * BINDLESS_TEXTURES, when the device supports descriptor indexing
+	bool bindlessTextures = false;
+	BindlessTextures textureArray;
+	uint32_t modelMaterial = 0;
+	OcclusionQueries occlusionQueries;
+	PipelineRequest occlusionProxyPipeline = 0;
+
+	uint32_t mipLevels = 1;
+	int textureWidth = 0, textureHeight = 0;
+	VkImage textureImage = VK_NULL_HANDLE;
+	DeviceAllocation textureImageMemory;
+	VkImageView textureImageView = VK_NULL_HANDLE;
 	VkSampler textureSampler;
 	VkImage depthImage;
-	VkDeviceMemory depthImageMemory;
+	DeviceAllocation depthImageMemory;
 	VkImageView depthImageView;
 
 	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
+	std::vector<DeviceAllocation> uniformBuffersMemory;
 	std::vector<void *> uniformBuffersMapped;
 
 	// const std::vector<Vertex> vertices = {
@@ -2204,8 +4561,21 @@ class HelloTriangleApplication {
 	// const std::vector<uint16_t> indices = {0, 1, 2, 2, 3, 0, 4, 5, 6, 6, 7,
 	// 4};
 
+	std::vector<MeshVertex> meshVertices;
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
+	glm::vec3 positionScale = glm::vec3(1.0f);
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	std::vector<Meshlet> meshlets;
+	std::vector<MeshLod> modelLods;
+	uint32_t modelLod = 0;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	MeshCache meshCache;
+
+	JobSystem jobSystem;
+	SecondaryRecorder secondaryRecorder;
 };
 
 int main() {
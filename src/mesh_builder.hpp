@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+/*
+	Builds an indexed mesh out of a stream of (possibly repeated) vertices.
+
+	Every vertex pushed through addVertex() is looked up in an open-addressing
+	hash table (linear probing, power-of-two capacity) keyed on the raw bytes
+	of the vertex, so identical (position, normal, texcoord, color) tuples are
+	stored once and referenced through the index buffer instead.
+
+	VertexT must be trivially copyable and tightly packed (no padding bytes),
+	since both hashing and comparison work on its object representation.
+*/
+template <typename VertexT> class MeshBuilder {
+	static_assert(std::is_trivially_copyable<VertexT>::value,
+				  "MeshBuilder needs a trivially copyable vertex type");
+
+  public:
+	static constexpr uint32_t EMPTY_SLOT = std::numeric_limits<uint32_t>::max();
+
+	explicit MeshBuilder(size_t expectedIndexCount) {
+		// * the unique vertex count is bounded by the index count, reserve
+		// * for the worst case so nothing reallocates while building
+		vertices.reserve(expectedIndexCount);
+		indices.reserve(expectedIndexCount);
+
+		// keep the load factor at or below 0.5
+		size_t capacity = 16;
+		while (capacity < expectedIndexCount * 2) {
+			capacity <<= 1;
+		}
+		slots.assign(capacity, EMPTY_SLOT);
+		mask = capacity - 1;
+	}
+
+	void addVertex(const VertexT &vertex) {
+		if ((vertices.size() + 1) * 2 > slots.size()) {
+			grow();
+		}
+
+		size_t slot = hashVertex(vertex) & mask;
+		while (true) {
+			uint32_t candidate = slots[slot];
+			if (candidate == EMPTY_SLOT) {
+				uint32_t index = static_cast<uint32_t>(vertices.size());
+				slots[slot] = index;
+				vertices.push_back(vertex);
+				indices.push_back(index);
+				return;
+			}
+			if (std::memcmp(&vertices[candidate], &vertex, sizeof(VertexT)) ==
+				0) {
+				indices.push_back(candidate);
+				return;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	// 16-bit indices are enough as long as every vertex id fits in uint16_t
+	bool fitsUint16() const {
+		return vertices.size() <=
+			   static_cast<size_t>(std::numeric_limits<uint16_t>::max()) + 1;
+	}
+
+	std::vector<VertexT> vertices;
+	std::vector<uint32_t> indices;
+
+  private:
+	static uint64_t hashVertex(const VertexT &vertex) {
+		// * FNV-1a over 32-bit words followed by a murmur3 finalizer, the
+		// * vertex attributes are all 32-bit floats so word granularity is
+		// * enough and much faster than hashing byte by byte
+		static_assert(sizeof(VertexT) % sizeof(uint32_t) == 0,
+					  "vertex size must be a multiple of 4 bytes");
+
+		uint32_t words[sizeof(VertexT) / sizeof(uint32_t)];
+		std::memcpy(words, &vertex, sizeof(VertexT));
+
+		uint64_t hash = 14695981039346656037ull;
+		for (uint32_t word : words) {
+			hash ^= word;
+			hash *= 1099511628211ull;
+		}
+
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdull;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53ull;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	void grow() {
+		slots.assign(slots.size() * 2, EMPTY_SLOT);
+		mask = slots.size() - 1;
+
+		for (uint32_t i = 0; i < vertices.size(); i++) {
+			size_t slot = hashVertex(vertices[i]) & mask;
+			while (slots[slot] != EMPTY_SLOT) {
+				slot = (slot + 1) & mask;
+			}
+			slots[slot] = i;
+		}
+	}
+
+	std::vector<uint32_t> slots;
+	size_t mask = 0;
+};
+
+// narrow a 32-bit index list into 16-bit storage (e.g. a mapped staging
+// buffer), only valid when MeshBuilder::fitsUint16() holds
+inline void packIndicesUint16(const uint32_t *src, size_t count,
+							  uint16_t *dst) {
+	for (size_t i = 0; i < count; i++) {
+		dst[i] = static_cast<uint16_t>(src[i]);
+	}
+}
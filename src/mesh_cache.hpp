@@ -0,0 +1,324 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+	Versioned binary cache for processed meshes.
+
+	Layout (every blob starts on a 16-byte boundary):
+		MeshCacheHeader
+		section 0 blob
+		section 1 blob
+		...
+
+	The header records the size, mtime and a content hash of the source file
+	the mesh was built from, so a cache is only used while the source is
+	unchanged. Sections are identified by a four character tag which keeps
+	the format open for additional per-mesh data.
+
+	On POSIX systems the file is mmap'd and section pointers point straight
+	into the mapping; elsewhere it is read into memory once.
+*/
+
+constexpr uint32_t meshCacheTag(char a, char b, char c, char d) {
+	return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 |
+		   uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+const uint32_t MESH_CACHE_MAGIC = meshCacheTag('M', 'S', 'H', 'C');
+const uint32_t MESH_CACHE_VERSION = 1;
+const uint32_t MESH_CACHE_MAX_SECTIONS = 16;
+const uint32_t MESH_CACHE_ALIGNMENT = 16;
+
+const uint32_t MESH_SECTION_VERTICES = meshCacheTag('V', 'T', 'X', ' ');
+const uint32_t MESH_SECTION_INDICES = meshCacheTag('I', 'D', 'X', ' ');
+// float scale[3], offset[3] mapping quantized positions back to model space
+const uint32_t MESH_SECTION_QUANTIZATION = meshCacheTag('Q', 'N', 'T', ' ');
+// Meshlet array, index ranges refer to the INDICES section
+const uint32_t MESH_SECTION_MESHLETS = meshCacheTag('M', 'L', 'E', 'T');
+// MeshLod array, LOD 0 first, index ranges refer to the INDICES section
+const uint32_t MESH_SECTION_LODS = meshCacheTag('L', 'O', 'D', 'S');
+
+struct MeshCacheSection {
+	uint32_t tag;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	// bumped by the application whenever its vertex layout or processing
+	// changes, so stale caches of an older build are rejected
+	uint32_t formatVersion;
+	uint32_t sectionCount;
+
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+	uint64_t sourceHash;
+
+	// time it took to produce the cached data from the source, used to
+	// report how much a cache hit saved
+	double buildMillis;
+
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexSize;
+
+	MeshCacheSection sections[MESH_CACHE_MAX_SECTIONS];
+};
+
+struct MeshSourceInfo {
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	uint64_t hash = 0;
+};
+
+inline bool queryMeshSource(const std::string &path, MeshSourceInfo &info) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+	info.size = static_cast<uint64_t>(st.st_size);
+	info.mtime = static_cast<int64_t>(st.st_mtime);
+
+	// * hash the head, middle and tail of the source instead of all of it,
+	// * size + mtime already catch ordinary edits and a full hash would cost
+	// * a noticeable fraction of the parse we are trying to skip
+	const uint64_t blockSize = 64 * 1024;
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	uint64_t hash = 14695981039346656037ull ^ info.size;
+	std::vector<char> block(blockSize);
+	uint64_t offsets[3] = {0, info.size / 2, info.size > blockSize
+												 ? info.size - blockSize
+												 : 0};
+	for (uint64_t offset : offsets) {
+		file.seekg(static_cast<std::streamoff>(offset));
+		file.read(block.data(), static_cast<std::streamsize>(blockSize));
+		std::streamsize count = file.gcount();
+		file.clear();
+		for (std::streamsize i = 0; i < count; i++) {
+			hash ^= static_cast<uint8_t>(block[i]);
+			hash *= 1099511628211ull;
+		}
+	}
+	info.hash = hash;
+	return true;
+}
+
+class MeshCache {
+  public:
+	MeshCache() = default;
+	MeshCache(const MeshCache &) = delete;
+	MeshCache &operator=(const MeshCache &) = delete;
+	~MeshCache() { close(); }
+
+	// map the cache and validate it against the source, returns false (and
+	// leaves nothing mapped) when the cache is missing or stale
+	bool open(const std::string &cachePath, const MeshSourceInfo &source,
+			  uint32_t formatVersion) {
+		close();
+
+		if (!map(cachePath)) {
+			return false;
+		}
+
+		if (size < sizeof(MeshCacheHeader)) {
+			close();
+			return false;
+		}
+
+		const MeshCacheHeader &h = header();
+		bool valid = h.magic == MESH_CACHE_MAGIC &&
+					 h.version == MESH_CACHE_VERSION &&
+					 h.formatVersion == formatVersion &&
+					 h.sectionCount <= MESH_CACHE_MAX_SECTIONS &&
+					 h.sourceSize == source.size &&
+					 h.sourceMtime == source.mtime &&
+					 h.sourceHash == source.hash;
+
+		for (uint32_t i = 0; valid && i < h.sectionCount; i++) {
+			const MeshCacheSection &section = h.sections[i];
+			valid = section.offset % MESH_CACHE_ALIGNMENT == 0 &&
+					section.offset <= size &&
+					section.size <= size - section.offset;
+		}
+
+		if (!valid) {
+			close();
+		}
+		return valid;
+	}
+
+	void close() {
+#ifndef _WIN32
+		if (data != nullptr) {
+			munmap(const_cast<uint8_t *>(data), size);
+		}
+#endif
+		data = nullptr;
+		size = 0;
+		fallback.clear();
+		fallback.shrink_to_fit();
+	}
+
+	bool isOpen() const { return data != nullptr; }
+
+	const MeshCacheHeader &header() const {
+		return *reinterpret_cast<const MeshCacheHeader *>(data);
+	}
+
+	// pointer into the mapping for the given section, nullptr if absent
+	const void *section(uint32_t tag, uint64_t *sectionSize = nullptr) const {
+		const MeshCacheHeader &h = header();
+		for (uint32_t i = 0; i < h.sectionCount; i++) {
+			if (h.sections[i].tag == tag) {
+				if (sectionSize != nullptr) {
+					*sectionSize = h.sections[i].size;
+				}
+				return data + h.sections[i].offset;
+			}
+		}
+		return nullptr;
+	}
+
+  private:
+	bool map(const std::string &path) {
+#ifndef _WIN32
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+		void *mapping = mmap(nullptr, static_cast<size_t>(st.st_size),
+							 PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapping == MAP_FAILED) {
+			return false;
+		}
+		data = static_cast<const uint8_t *>(mapping);
+		size = static_cast<size_t>(st.st_size);
+		return true;
+#else
+		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+		size_t fileSize = static_cast<size_t>(file.tellg());
+		// uint64_t storage keeps the blobs 16-byte aligned in practice
+		fallback.resize((fileSize + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+		file.seekg(0);
+		file.read(reinterpret_cast<char *>(fallback.data()), fileSize);
+		data = reinterpret_cast<const uint8_t *>(fallback.data());
+		size = fileSize;
+		return fileSize > 0;
+#endif
+	}
+
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	std::vector<uint64_t> fallback;
+};
+
+class MeshCacheWriter {
+  public:
+	// * the header has room for MESH_CACHE_MAX_SECTIONS, one more is a bug
+	// * in the caller rather than something to drop silently
+	void addSection(uint32_t tag, const void *bytes, uint64_t byteSize) {
+		if (pending.size() == MESH_CACHE_MAX_SECTIONS) {
+			throw std::runtime_error("too many mesh cache sections!");
+		}
+		pending.push_back({tag, bytes, byteSize});
+	}
+
+	// write to a temporary file and rename it into place so a crash or a
+	// concurrent reader never observes a half written cache
+	bool write(const std::string &cachePath, MeshCacheHeader header) const {
+		header.magic = MESH_CACHE_MAGIC;
+		header.version = MESH_CACHE_VERSION;
+		header.sectionCount = static_cast<uint32_t>(pending.size());
+
+		uint64_t offset = alignUp(sizeof(MeshCacheHeader));
+		for (size_t i = 0; i < pending.size(); i++) {
+			header.sections[i].tag = pending[i].tag;
+			header.sections[i].reserved = 0;
+			header.sections[i].offset = offset;
+			header.sections[i].size = pending[i].size;
+			offset = alignUp(offset + pending[i].size);
+		}
+
+		std::string tmpPath = cachePath + ".tmp";
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		const char zeros[MESH_CACHE_ALIGNMENT] = {};
+		uint64_t written = 0;
+		auto writeBytes = [&](const void *bytes, uint64_t count) {
+			file.write(static_cast<const char *>(bytes),
+					   static_cast<std::streamsize>(count));
+			written += count;
+		};
+		auto pad = [&]() {
+			writeBytes(zeros, alignUp(written) - written);
+		};
+
+		writeBytes(&header, sizeof(header));
+		pad();
+		for (const auto &section : pending) {
+			writeBytes(section.bytes, section.size);
+			pad();
+		}
+
+		file.close();
+		if (!file) {
+			std::remove(tmpPath.c_str());
+			return false;
+		}
+#ifdef _WIN32
+		// rename() does not replace an existing file on Windows
+		std::remove(cachePath.c_str());
+#endif
+		return std::rename(tmpPath.c_str(), cachePath.c_str()) == 0;
+	}
+
+  private:
+	struct PendingSection {
+		uint32_t tag;
+		const void *bytes;
+		uint64_t size;
+	};
+
+	static uint64_t alignUp(uint64_t value) {
+		return (value + MESH_CACHE_ALIGNMENT - 1) &
+			   ~uint64_t(MESH_CACHE_ALIGNMENT - 1);
+	}
+
+	std::vector<PendingSection> pending;
+};
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+/*
+	Index / vertex reordering passes run on a freshly built indexed mesh.
+
+	optimizeVertexCache  reorders triangles for post-transform cache reuse
+						 (Tipsify, Sander et al. 2007), linear time
+	optimizeOverdraw     reorders the clusters Tipsify produced so that
+						 outward facing ones are drawn first, as long as the
+						 cache efficiency stays within a threshold
+	optimizeVertexFetch  reorders vertices by first use in the index buffer
+						 so vertex fetch walks memory mostly linearly
+
+	analyzeVertexCache simulates a FIFO cache to report ACMR (transformed
+	vertices per triangle, 0.5 is the ideal for large regular meshes) and
+	ATVR (transformed vertices per unique vertex, 1.0 is ideal).
+*/
+
+const uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats {
+	double acmr = 0.0;
+	double atvr = 0.0;
+};
+
+inline VertexCacheStats analyzeVertexCache(const uint32_t *indices,
+										   size_t indexCount,
+										   size_t vertexCount,
+										   uint32_t cacheSize = VERTEX_CACHE_SIZE) {
+	// * FIFO cache: a vertex is a hit while fewer than cacheSize misses
+	// * happened since it was last inserted
+	std::vector<uint64_t> insertedAt(vertexCount, 0);
+	uint64_t misses = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		uint32_t v = indices[i];
+		if (insertedAt[v] == 0 || misses - insertedAt[v] >= cacheSize) {
+			misses++;
+			insertedAt[v] = misses;
+		}
+	}
+
+	size_t usedVertices = 0;
+	for (uint64_t inserted : insertedAt) {
+		usedVertices += inserted != 0;
+	}
+
+	VertexCacheStats stats;
+	stats.acmr = indexCount == 0 ? 0.0 : double(misses) / (indexCount / 3);
+	stats.atvr = usedVertices == 0 ? 0.0 : double(misses) / usedVertices;
+	return stats;
+}
+
+// reorder triangles in place, when clusterStarts is given it receives the
+// first triangle of every cluster (Tipsify restarts from a dead end there)
+inline void optimizeVertexCache(uint32_t *indices, size_t indexCount,
+								size_t vertexCount,
+								uint32_t cacheSize = VERTEX_CACHE_SIZE,
+								std::vector<uint32_t> *clusterStarts = nullptr) {
+	size_t triangleCount = indexCount / 3;
+	if (clusterStarts != nullptr) {
+		clusterStarts->clear();
+	}
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// vertex -> triangle adjacency in CSR form
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; i++) {
+		liveTriangles[indices[i]]++;
+	}
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+	std::vector<uint32_t> adjacency(indexCount);
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(),
+								   adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < indexCount; i++) {
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> result;
+	result.reserve(indexCount);
+
+	uint32_t time = cacheSize + 1;
+	uint32_t cursor = 0;
+	const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+	auto skipDeadEnd = [&]() -> uint32_t {
+		while (!deadEnd.empty()) {
+			uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0) {
+				return v;
+			}
+		}
+		while (cursor < vertexCount) {
+			if (liveTriangles[cursor] > 0) {
+				return cursor;
+			}
+			cursor++;
+		}
+		return NONE;
+	};
+
+	uint32_t fanning = skipDeadEnd();
+	bool newCluster = true;
+	while (fanning != NONE) {
+		candidates.clear();
+
+		for (uint32_t a = adjacencyOffsets[fanning];
+			 a < adjacencyOffsets[fanning + 1]; a++) {
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle]) {
+				continue;
+			}
+			if (newCluster && clusterStarts != nullptr) {
+				clusterStarts->push_back(
+					static_cast<uint32_t>(result.size() / 3));
+			}
+			newCluster = false;
+
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = indices[3 * triangle + k];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize) {
+					cacheTime[v] = time++;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		// * prefer the candidate that stays in the cache the longest while
+		// * still having live triangles, fall back to the dead-end stack
+		uint32_t best = NONE;
+		int bestPriority = -1;
+		for (uint32_t v : candidates) {
+			if (liveTriangles[v] == 0) {
+				continue;
+			}
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+				priority = static_cast<int>(time - cacheTime[v]);
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				best = v;
+			}
+		}
+		if (best == NONE) {
+			best = skipDeadEnd();
+			newCluster = true;
+		}
+		fanning = best;
+	}
+
+	std::memcpy(indices, result.data(), result.size() * sizeof(uint32_t));
+}
+
+// reorder Tipsify clusters front to back by their view independent
+// occlusion potential, keeps the old order if ACMR would grow by more than
+// `threshold` (e.g. 1.05 allows 5% more vertex transforms)
+inline void optimizeOverdraw(uint32_t *indices, size_t indexCount,
+							 const float *positions, size_t positionStride,
+							 size_t vertexCount,
+							 const std::vector<uint32_t> &clusterStarts,
+							 float threshold = 1.05f,
+							 uint32_t cacheSize = VERTEX_CACHE_SIZE) {
+	size_t triangleCount = indexCount / 3;
+	if (clusterStarts.size() < 2) {
+		return;
+	}
+
+	auto position = [&](uint32_t v) {
+		return reinterpret_cast<const float *>(
+			reinterpret_cast<const char *>(positions) + v * positionStride);
+	};
+
+	float meshCenter[3] = {0.0f, 0.0f, 0.0f};
+	for (size_t i = 0; i < indexCount; i++) {
+		const float *p = position(indices[i]);
+		for (int k = 0; k < 3; k++) {
+			meshCenter[k] += p[k];
+		}
+	}
+	for (float &c : meshCenter) {
+		c /= float(indexCount);
+	}
+
+	struct Cluster {
+		uint32_t begin;
+		uint32_t end;
+		float sortKey;
+	};
+	std::vector<Cluster> clusters;
+	clusters.reserve(clusterStarts.size());
+
+	for (size_t c = 0; c < clusterStarts.size(); c++) {
+		uint32_t begin = clusterStarts[c];
+		uint32_t end = c + 1 < clusterStarts.size()
+						   ? clusterStarts[c + 1]
+						   : static_cast<uint32_t>(triangleCount);
+
+		// * area weighted centroid and normal of the cluster, a cluster far
+		// * out along its own normal is likely to occlude the rest
+		float center[3] = {0.0f, 0.0f, 0.0f};
+		float normal[3] = {0.0f, 0.0f, 0.0f};
+		float area = 0.0f;
+		for (uint32_t t = begin; t < end; t++) {
+			const float *a = position(indices[3 * t + 0]);
+			const float *b = position(indices[3 * t + 1]);
+			const float *d = position(indices[3 * t + 2]);
+			float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+			float e2[3] = {d[0] - a[0], d[1] - a[1], d[2] - a[2]};
+			float n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+						  e1[2] * e2[0] - e1[0] * e2[2],
+						  e1[0] * e2[1] - e1[1] * e2[0]};
+			float doubleArea =
+				std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int k = 0; k < 3; k++) {
+				center[k] += (a[k] + b[k] + d[k]) / 3.0f * doubleArea;
+				normal[k] += n[k];
+			}
+			area += doubleArea;
+		}
+
+		float sortKey = 0.0f;
+		if (area > 0.0f) {
+			float length = std::sqrt(normal[0] * normal[0] +
+									 normal[1] * normal[1] +
+									 normal[2] * normal[2]);
+			if (length > 0.0f) {
+				for (int k = 0; k < 3; k++) {
+					sortKey += (center[k] / area - meshCenter[k]) * normal[k] /
+							   length;
+				}
+			}
+		}
+		clusters.push_back({begin, end, sortKey});
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(),
+					 [](const Cluster &a, const Cluster &b) {
+						 return a.sortKey > b.sortKey;
+					 });
+
+	std::vector<uint32_t> result;
+	result.reserve(indexCount);
+	for (const Cluster &cluster : clusters) {
+		result.insert(result.end(), indices + 3 * cluster.begin,
+					  indices + 3 * cluster.end);
+	}
+
+	double before =
+		analyzeVertexCache(indices, indexCount, vertexCount, cacheSize).acmr;
+	double after =
+		analyzeVertexCache(result.data(), indexCount, vertexCount, cacheSize)
+			.acmr;
+	if (after <= before * threshold) {
+		std::memcpy(indices, result.data(), indexCount * sizeof(uint32_t));
+	}
+}
+
+// reorder vertices by first use and rewrite indices to match, unreferenced
+// vertices are dropped, returns the new vertex count
+template <typename VertexT>
+size_t optimizeVertexFetch(std::vector<VertexT> &vertices, uint32_t *indices,
+						   size_t indexCount) {
+	static_assert(std::is_trivially_copyable<VertexT>::value,
+				  "optimizeVertexFetch needs a trivially copyable vertex type");
+
+	const uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> remap(vertices.size(), UNUSED);
+	std::vector<VertexT> reordered;
+	reordered.reserve(vertices.size());
+
+	for (size_t i = 0; i < indexCount; i++) {
+		uint32_t &target = remap[indices[i]];
+		if (target == UNUSED) {
+			target = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = target;
+	}
+
+	vertices = std::move(reordered);
+	return vertices.size();
+}
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_set>
+#include <vector>
+
+#include "mesh_optimizer.hpp"
+
+/*
+	Edge collapse simplification driven by quadric error metrics (Garland &
+	Heckbert 1997), used to build the LOD chain of a mesh.
+
+	Collapses only ever move a vertex onto one of its neighbours, so every
+	level keeps referencing the original vertex buffer and all levels can
+	share it. Work happens in passes: the cheapest collapse of every vertex
+	is gathered, sorted, and applied greedily as long as it touches nothing
+	another collapse of the same pass changed and flips no triangle.
+
+	Vertices on open borders and on non-manifold edges are locked so the
+	silhouette survives. Several vertices sharing one position are wedges
+	of an attribute seam (UV or normal split): where two wedges meet the
+	vertex only collapses along the seam, both wedges at once onto the
+	two wedges of the neighbour, so the seam moves as one line and stays
+	a discontinuity. Points where three or more wedges meet are locked.
+	Attributes additionally add sum(weight * delta^2) to the cost of a
+	collapse, with the weights turning attribute differences into model
+	space units.
+
+	buildLodChain appends successively coarser levels to an index buffer,
+	every level halving the previous one until simplification stalls.
+*/
+
+// LOD 0 and up to six simplified levels
+const uint32_t MESH_LOD_MAX_COUNT = 7;
+const uint32_t MESH_LOD_MIN_TRIANGLES = 64;
+
+struct MeshLod {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	// * model space distance estimate from the source mesh: the root of the
+	// * largest area weighted mean squared plane distance a collapse of
+	// * this level introduced, plus the errors of the levels before. Not a
+	// * bound on the true deviation, but grows with it and is what the
+	// * screen-space LOD selection scales
+	float error;
+	uint32_t padding;
+};
+
+struct MeshQuadric {
+	// upper triangle of the symmetric 4x4 error matrix
+	double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+	double a11 = 0, a12 = 0, a13 = 0;
+	double a22 = 0, a23 = 0;
+	double a33 = 0;
+	double weight = 0;
+
+	void addPlane(double a, double b, double c, double d, double w) {
+		a00 += w * a * a, a01 += w * a * b, a02 += w * a * c, a03 += w * a * d;
+		a11 += w * b * b, a12 += w * b * c, a13 += w * b * d;
+		a22 += w * c * c, a23 += w * c * d;
+		a33 += w * d * d;
+		weight += w;
+	}
+
+	void add(const MeshQuadric &o) {
+		a00 += o.a00, a01 += o.a01, a02 += o.a02, a03 += o.a03;
+		a11 += o.a11, a12 += o.a12, a13 += o.a13;
+		a22 += o.a22, a23 += o.a23;
+		a33 += o.a33;
+		weight += o.weight;
+	}
+
+	// weighted sum of squared plane distances of (x, y, z)
+	double evaluate(double x, double y, double z) const {
+		return x * (a00 * x + 2 * (a01 * y + a02 * z + a03)) +
+			   y * (a11 * y + 2 * (a12 * z + a13)) + z * (a22 * z + 2 * a23) +
+			   a33;
+	}
+};
+
+// * simplify towards targetIndexCount with no collapse whose geometric error
+// * (see MeshLod::error) exceeds maxError, resultError receives the largest
+// * of the collapses made
+inline std::vector<uint32_t>
+simplifyMesh(const uint32_t *indices, size_t indexCount,
+			 const float *positions, size_t positionStride, size_t vertexCount,
+			 size_t targetIndexCount, float maxError,
+			 const float *attributes = nullptr, size_t attributeStride = 0,
+			 uint32_t attributeCount = 0,
+			 const float *attributeWeights = nullptr,
+			 float *resultError = nullptr) {
+	std::vector<uint32_t> result(indices, indices + indexCount);
+	if (resultError != nullptr) {
+		*resultError = 0.0f;
+	}
+	if (indexCount <= targetIndexCount || vertexCount == 0) {
+		return result;
+	}
+
+	auto position = [&](uint32_t v) {
+		return reinterpret_cast<const float *>(
+			reinterpret_cast<const char *>(positions) + v * positionStride);
+	};
+	auto attribute = [&](uint32_t v) {
+		return reinterpret_cast<const float *>(
+			reinterpret_cast<const char *>(attributes) + v * attributeStride);
+	};
+
+	// * vertices sharing a position are wedges of one point, the first one
+	// * of every group is canonical and owns the quadric
+	// * twin is the other wedge of a two-wedge seam vertex and the vertex
+	// * itself otherwise. Only vertices indices references count, coarser
+	// * levels leave the wedges of collapsed points behind in the buffer
+	std::vector<uint32_t> canonical(vertexCount);
+	std::vector<uint32_t> twin(vertexCount);
+	std::vector<bool> locked(vertexCount, false);
+	{
+		std::vector<bool> used(vertexCount, false);
+		for (size_t i = 0; i < indexCount; i++) {
+			used[indices[i]] = true;
+		}
+		std::vector<uint32_t> order;
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			canonical[v] = twin[v] = v;
+			if (used[v]) {
+				order.push_back(v);
+			}
+		}
+		auto less = [&](uint32_t a, uint32_t b) {
+			int c = std::memcmp(position(a), position(b), 3 * sizeof(float));
+			return c < 0 || (c == 0 && a < b);
+		};
+		std::sort(order.begin(), order.end(), less);
+		for (size_t i = 0; i < order.size();) {
+			size_t j = i + 1;
+			while (j < order.size() &&
+				   std::memcmp(position(order[i]), position(order[j]),
+							   3 * sizeof(float)) == 0) {
+				j++;
+			}
+			for (size_t k = i; k < j; k++) {
+				canonical[order[k]] = order[i];
+				twin[order[k]] = j - i == 2 ? order[i + j - 1 - k] : order[k];
+				// three or more attribute regions meet
+				locked[order[k]] = j - i > 2;
+			}
+			i = j;
+		}
+	}
+
+	// * open borders and non-manifold edges, found through directed edges
+	// * between canonical vertices
+	{
+		std::unordered_set<uint64_t> directed;
+		std::unordered_set<uint64_t> repeated;
+		directed.reserve(indexCount);
+		auto key = [](uint32_t a, uint32_t b) {
+			return uint64_t(a) << 32 | b;
+		};
+		for (size_t t = 0; t < indexCount; t += 3) {
+			for (int e = 0; e < 3; e++) {
+				uint32_t a = canonical[indices[t + e]];
+				uint32_t b = canonical[indices[t + (e + 1) % 3]];
+				if (!directed.insert(key(a, b)).second) {
+					repeated.insert(key(a, b));
+				}
+			}
+		}
+		for (size_t t = 0; t < indexCount; t += 3) {
+			for (int e = 0; e < 3; e++) {
+				uint32_t a = indices[t + e];
+				uint32_t b = indices[t + (e + 1) % 3];
+				uint32_t ca = canonical[a], cb = canonical[b];
+				if (!directed.count(key(cb, ca)) ||
+					repeated.count(key(ca, cb))) {
+					locked[a] = true;
+					locked[b] = true;
+				}
+			}
+		}
+	}
+
+	// area weighted plane quadrics of every triangle
+	std::vector<MeshQuadric> quadrics(vertexCount);
+	for (size_t t = 0; t < indexCount; t += 3) {
+		const float *p0 = position(indices[t + 0]);
+		const float *p1 = position(indices[t + 1]);
+		const float *p2 = position(indices[t + 2]);
+		double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+		double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+		double n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+					   e1[2] * e2[0] - e1[0] * e2[2],
+					   e1[0] * e2[1] - e1[1] * e2[0]};
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0.0) {
+			continue;
+		}
+		for (double &c : n) {
+			c /= length;
+		}
+		double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+		for (int k = 0; k < 3; k++) {
+			quadrics[canonical[indices[t + k]]].addPlane(n[0], n[1], n[2], d,
+														 length * 0.5);
+		}
+	}
+
+	// * seam collapses move sourceTwin onto targetTwin as well, they equal
+	// * source and target everywhere else
+	struct Collapse {
+		uint32_t source;
+		uint32_t target;
+		uint32_t sourceTwin;
+		uint32_t targetTwin;
+		// geometric error squared, cost adds the attribute differences
+		double error;
+		double cost;
+	};
+
+	auto makeCollapse = [&](uint32_t source, uint32_t target,
+							uint32_t sourceTwin, uint32_t targetTwin) {
+		MeshQuadric q = quadrics[canonical[source]];
+		q.add(quadrics[canonical[target]]);
+		const float *p = position(target);
+		Collapse collapse = {source, target, sourceTwin, targetTwin, 0.0, 0.0};
+		if (q.weight > 0.0) {
+			collapse.error =
+				std::max(0.0, q.evaluate(p[0], p[1], p[2]) / q.weight);
+		}
+		collapse.cost = collapse.error;
+		for (uint32_t k = 0; k < attributeCount; k++) {
+			double delta = attribute(source)[k] - attribute(target)[k];
+			collapse.cost += attributeWeights[k] * delta * delta;
+			if (sourceTwin != source) {
+				delta = attribute(sourceTwin)[k] - attribute(targetTwin)[k];
+				collapse.cost += attributeWeights[k] * delta * delta;
+			}
+		}
+		return collapse;
+	};
+
+	auto triangleNormal = [&](uint32_t a, uint32_t b, uint32_t c, double n[3]) {
+		const float *p0 = position(a);
+		const float *p1 = position(b);
+		const float *p2 = position(c);
+		double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+		double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	};
+
+	double maxErrorSquared = double(maxError) * maxError;
+	double worstCollapse = 0.0;
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> best(vertexCount);
+	std::vector<Collapse> collapses;
+	std::vector<bool> touched(vertexCount);
+	std::vector<uint32_t> remap(vertexCount);
+
+	while (result.size() > targetIndexCount) {
+		size_t triangleCount = result.size() / 3;
+
+		// vertex -> triangle adjacency of the current level
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t v : result) {
+			adjacencyOffsets[v + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(result.size());
+		{
+			std::vector<uint32_t> fill(adjacencyOffsets.begin(),
+									   adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < result.size(); i++) {
+				adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		auto adjacent = [&](uint32_t a, uint32_t b) {
+			for (uint32_t t = adjacencyOffsets[a]; t < adjacencyOffsets[a + 1];
+				 t++) {
+				const uint32_t *triangle = &result[3 * adjacency[t]];
+				if (triangle[0] == b || triangle[1] == b || triangle[2] == b) {
+					return true;
+				}
+			}
+			return false;
+		};
+
+		// cheapest collapse of every unlocked vertex
+		const double NO_COST = std::numeric_limits<double>::max();
+		for (auto &collapse : best) {
+			collapse.cost = NO_COST;
+		}
+		auto consider = [&](uint32_t source, uint32_t target) {
+			if (locked[source]) {
+				return;
+			}
+			uint32_t sourceTwin = source;
+			uint32_t targetTwin = target;
+			if (twin[source] != source) {
+				// * along the seam only: the target is a seam vertex too
+				// * and the twins share the edge on the other side. The
+				// * lower wedge stands for both
+				targetTwin = twin[target];
+				sourceTwin = twin[source];
+				if (sourceTwin < source || targetTwin == target ||
+					!adjacent(sourceTwin, targetTwin)) {
+					return;
+				}
+			}
+			Collapse collapse =
+				makeCollapse(source, target, sourceTwin, targetTwin);
+			if (collapse.cost < best[source].cost) {
+				best[source] = collapse;
+			}
+		};
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (int e = 0; e < 3; e++) {
+				uint32_t a = result[i + e];
+				uint32_t b = result[i + (e + 1) % 3];
+				consider(a, b);
+				consider(b, a);
+			}
+		}
+		collapses.clear();
+		for (const auto &collapse : best) {
+			if (collapse.cost != NO_COST && collapse.error <= maxErrorSquared) {
+				collapses.push_back(collapse);
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(),
+				  [](const Collapse &a, const Collapse &b) {
+					  return a.cost < b.cost;
+				  });
+
+		// * every collapse removes about two triangles, stop the pass once
+		// * the target would be reached
+		size_t targetTriangles = targetIndexCount / 3;
+		size_t collapseBudget = (triangleCount - targetTriangles) / 2 + 1;
+		std::fill(touched.begin(), touched.end(), false);
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			remap[v] = v;
+		}
+
+		size_t applied = 0;
+		for (const Collapse &collapse : collapses) {
+			if (applied == collapseBudget) {
+				break;
+			}
+			uint32_t source = collapse.source;
+			uint32_t target = collapse.target;
+			uint32_t sourceTwin = collapse.sourceTwin;
+			uint32_t targetTwin = collapse.targetTwin;
+			if (touched[source] || touched[target] || touched[sourceTwin] ||
+				touched[targetTwin]) {
+				continue;
+			}
+
+			// * reject collapses that flip a surviving triangle around the
+			// * source, the ones containing the edge itself disappear
+			auto flips = [&](uint32_t from, uint32_t to) {
+				for (uint32_t a = adjacencyOffsets[from];
+					 a < adjacencyOffsets[from + 1]; a++) {
+					const uint32_t *triangle = &result[3 * adjacency[a]];
+					if (triangle[0] == to || triangle[1] == to ||
+						triangle[2] == to) {
+						continue;
+					}
+					uint32_t moved[3];
+					for (int k = 0; k < 3; k++) {
+						moved[k] = triangle[k] == from ? to : triangle[k];
+					}
+					double before[3], after[3];
+					triangleNormal(triangle[0], triangle[1], triangle[2],
+								   before);
+					triangleNormal(moved[0], moved[1], moved[2], after);
+					if (before[0] * after[0] + before[1] * after[1] +
+							before[2] * after[2] <=
+						0.0) {
+						return true;
+					}
+				}
+				return false;
+			};
+			if (flips(source, target) ||
+				(sourceTwin != source && flips(sourceTwin, targetTwin))) {
+				continue;
+			}
+
+			remap[source] = target;
+			remap[sourceTwin] = targetTwin;
+			quadrics[canonical[target]].add(quadrics[canonical[source]]);
+			worstCollapse = std::max(worstCollapse, collapse.error);
+			for (uint32_t from : {source, sourceTwin}) {
+				for (uint32_t a = adjacencyOffsets[from];
+					 a < adjacencyOffsets[from + 1]; a++) {
+					const uint32_t *triangle = &result[3 * adjacency[a]];
+					for (int k = 0; k < 3; k++) {
+						touched[triangle[k]] = true;
+					}
+				}
+			}
+			applied++;
+		}
+
+		if (applied == 0) {
+			break;
+		}
+
+		// * apply the pass and drop triangles that became degenerate, also
+		// * the ones left with two wedges of one point
+		size_t kept = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			uint32_t a = remap[result[i + 0]];
+			uint32_t b = remap[result[i + 1]];
+			uint32_t c = remap[result[i + 2]];
+			uint32_t ca = canonical[a], cb = canonical[b], cc = canonical[c];
+			if (ca == cb || cb == cc || ca == cc) {
+				continue;
+			}
+			result[kept++] = a;
+			result[kept++] = b;
+			result[kept++] = c;
+		}
+		result.resize(kept);
+	}
+
+	if (resultError != nullptr) {
+		*resultError = static_cast<float>(std::sqrt(worstCollapse));
+	}
+	return result;
+}
+
+// * LOD 0 is indices as they are, the coarser levels are simplified from the
+// * previous one (cheaper than starting over from the source every time) and
+// * appended to indices, each reordered for the vertex cache on its own
+inline std::vector<MeshLod>
+buildLodChain(std::vector<uint32_t> &indices, const float *positions,
+			  size_t positionStride, size_t vertexCount,
+			  const float *attributes = nullptr, size_t attributeStride = 0,
+			  uint32_t attributeCount = 0,
+			  const float *attributeWeights = nullptr,
+			  uint32_t maxLods = MESH_LOD_MAX_COUNT) {
+	std::vector<MeshLod> lods;
+	lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.0f, 0});
+
+	std::vector<uint32_t> previous = indices;
+	while (lods.size() < maxLods &&
+		   previous.size() / 3 > MESH_LOD_MIN_TRIANGLES) {
+		size_t target = previous.size() / 6 * 3;
+		float error = 0.0f;
+		std::vector<uint32_t> lod = simplifyMesh(
+			previous.data(), previous.size(), positions, positionStride,
+			vertexCount, target, std::numeric_limits<float>::max(), attributes,
+			attributeStride, attributeCount, attributeWeights, &error);
+
+		// * locked borders and seam corners stop the reduction at some point, a
+		// * level that is barely smaller is not worth its memory
+		if (lod.empty() || lod.size() * 8 > previous.size() * 7) {
+			break;
+		}
+
+		optimizeVertexCache(lod.data(), lod.size(), vertexCount);
+		// * each level is measured against the one it was simplified from,
+		// * summing keeps the estimate growing down the chain
+		lods.push_back({static_cast<uint32_t>(indices.size()),
+						static_cast<uint32_t>(lod.size()),
+						lods.back().error + error, 0});
+		indices.insert(indices.end(), lod.begin(), lod.end());
+		previous = std::move(lod);
+	}
+	return lods;
+}
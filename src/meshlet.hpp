@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "mesh_optimizer.hpp"
+
+/*
+	Meshlets: small clusters of triangles that are culled as a unit.
+
+	buildMeshlets() grows clusters greedily over triangle adjacency (up to
+	MESHLET_MAX_VERTICES unique vertices / MESHLET_MAX_TRIANGLES triangles),
+	preferring triangles that add few new vertices and face the same way as
+	the cluster so far, which keeps the normal cones tight. The index buffer
+	is rewritten so every meshlet is one contiguous index range and can be
+	drawn with a plain indexed (indirect) draw.
+
+	Each meshlet carries a bounding sphere for frustum culling and a normal
+	cone for backface culling, both in model space. The culling helpers take
+	a column-major model-view-projection matrix and the camera position in
+	model space so the caller never has to transform every meshlet.
+*/
+
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	uint32_t vertexCount;
+	// sin of the normal cone half angle, 1.0 marks a cone too wide to cull
+	float coneCutoff;
+	float center[3];
+	float radius;
+	float coneAxis[3];
+	float padding;
+};
+
+struct MeshletMesh {
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> indices;
+};
+
+inline MeshletMesh buildMeshlets(const uint32_t *indices, size_t indexCount,
+								 const float *positions, size_t positionStride,
+								 size_t vertexCount,
+								 uint32_t maxVertices = MESHLET_MAX_VERTICES,
+								 uint32_t maxTriangles = MESHLET_MAX_TRIANGLES) {
+	MeshletMesh result;
+	size_t triangleCount = indexCount / 3;
+	result.indices.reserve(triangleCount * 3);
+	if (triangleCount == 0) {
+		return result;
+	}
+
+	auto position = [&](uint32_t v) {
+		return reinterpret_cast<const float *>(
+			reinterpret_cast<const char *>(positions) + v * positionStride);
+	};
+
+	// unit triangle normals, zero for degenerate triangles
+	std::vector<float> normals(triangleCount * 3);
+	for (size_t t = 0; t < triangleCount; t++) {
+		const float *a = position(indices[3 * t + 0]);
+		const float *b = position(indices[3 * t + 1]);
+		const float *c = position(indices[3 * t + 2]);
+		float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+		float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+		float n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+					  e1[2] * e2[0] - e1[0] * e2[2],
+					  e1[0] * e2[1] - e1[1] * e2[0]};
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		for (int k = 0; k < 3; k++) {
+			normals[3 * t + k] = n[k] * scale;
+		}
+	}
+
+	// vertex -> triangle adjacency in CSR form
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < indexCount; i++) {
+		adjacencyOffsets[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++) {
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(),
+								   adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+	std::vector<bool> emitted(triangleCount, false);
+	// meshlet a vertex was last added to, for O(1) membership tests
+	std::vector<uint32_t> vertexMeshlet(vertexCount, NONE);
+	// position of a vertex inside its meshlet's vertex list
+	std::vector<uint32_t> vertexLocal(vertexCount, 0);
+	std::vector<uint32_t> localIndices;
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint32_t> meshletTriangles;
+	std::vector<uint32_t> candidates;
+	size_t seedCursor = 0;
+
+	while (true) {
+		while (seedCursor < triangleCount && emitted[seedCursor]) {
+			seedCursor++;
+		}
+		if (seedCursor == triangleCount) {
+			break;
+		}
+
+		uint32_t meshletIndex = static_cast<uint32_t>(result.meshlets.size());
+		Meshlet meshlet{};
+		meshlet.indexOffset = static_cast<uint32_t>(result.indices.size());
+		meshletVertices.clear();
+		meshletTriangles.clear();
+		candidates.clear();
+		float normalSum[3] = {0.0f, 0.0f, 0.0f};
+
+		auto newVertices = [&](uint32_t triangle) {
+			uint32_t count = 0;
+			for (int k = 0; k < 3; k++) {
+				count += vertexMeshlet[indices[3 * triangle + k]] != meshletIndex;
+			}
+			return count;
+		};
+
+		auto addTriangle = [&](uint32_t triangle) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = indices[3 * triangle + k];
+				result.indices.push_back(v);
+				if (vertexMeshlet[v] != meshletIndex) {
+					vertexMeshlet[v] = meshletIndex;
+					vertexLocal[v] = static_cast<uint32_t>(meshletVertices.size());
+					meshletVertices.push_back(v);
+					for (uint32_t a = adjacencyOffsets[v];
+						 a < adjacencyOffsets[v + 1]; a++) {
+						if (!emitted[adjacency[a]]) {
+							candidates.push_back(adjacency[a]);
+						}
+					}
+				}
+				normalSum[k] += normals[3 * triangle + k];
+			}
+			emitted[triangle] = true;
+			meshletTriangles.push_back(triangle);
+		};
+
+		addTriangle(static_cast<uint32_t>(seedCursor));
+
+		while (meshletTriangles.size() < maxTriangles) {
+			// * fewest new vertices first, then the normal that agrees most
+			// * with the cluster, stale candidates are compacted away
+			uint32_t best = NONE;
+			uint32_t bestNew = 4;
+			float bestDot = -2.0f;
+			size_t kept = 0;
+			for (size_t c = 0; c < candidates.size(); c++) {
+				uint32_t triangle = candidates[c];
+				if (emitted[triangle]) {
+					continue;
+				}
+				candidates[kept++] = triangle;
+
+				uint32_t added = newVertices(triangle);
+				if (meshletVertices.size() + added > maxVertices) {
+					continue;
+				}
+				float dot = normals[3 * triangle + 0] * normalSum[0] +
+							normals[3 * triangle + 1] * normalSum[1] +
+							normals[3 * triangle + 2] * normalSum[2];
+				if (added < bestNew || (added == bestNew && dot > bestDot)) {
+					best = triangle;
+					bestNew = added;
+					bestDot = dot;
+				}
+			}
+			candidates.resize(kept);
+
+			if (best == NONE) {
+				break;
+			}
+			addTriangle(best);
+		}
+
+		meshlet.indexCount =
+			static_cast<uint32_t>(result.indices.size()) - meshlet.indexOffset;
+		meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+
+		// * growing the cluster scrambles the cache friendly input order,
+		// * re-run the vertex cache pass on meshlet local ids which keeps it
+		// * proportional to the meshlet size
+		localIndices.resize(meshlet.indexCount);
+		for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+			localIndices[i] = vertexLocal[result.indices[meshlet.indexOffset + i]];
+		}
+		optimizeVertexCache(localIndices.data(), localIndices.size(),
+							meshletVertices.size());
+		for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+			result.indices[meshlet.indexOffset + i] =
+				meshletVertices[localIndices[i]];
+		}
+
+		// * bounding sphere around the AABB center, slightly looser than a
+		// * minimal sphere but cheap and stable
+		float boundsMin[3] = {std::numeric_limits<float>::max(),
+							  std::numeric_limits<float>::max(),
+							  std::numeric_limits<float>::max()};
+		float boundsMax[3] = {-std::numeric_limits<float>::max(),
+							  -std::numeric_limits<float>::max(),
+							  -std::numeric_limits<float>::max()};
+		for (uint32_t v : meshletVertices) {
+			const float *p = position(v);
+			for (int k = 0; k < 3; k++) {
+				boundsMin[k] = std::min(boundsMin[k], p[k]);
+				boundsMax[k] = std::max(boundsMax[k], p[k]);
+			}
+		}
+		for (int k = 0; k < 3; k++) {
+			meshlet.center[k] = 0.5f * (boundsMin[k] + boundsMax[k]);
+		}
+		float radiusSquared = 0.0f;
+		for (uint32_t v : meshletVertices) {
+			const float *p = position(v);
+			float d[3] = {p[0] - meshlet.center[0], p[1] - meshlet.center[1],
+						  p[2] - meshlet.center[2]};
+			radiusSquared =
+				std::max(radiusSquared, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+		}
+		meshlet.radius = std::sqrt(radiusSquared);
+
+		// * normal cone: axis is the mean normal, the cutoff is derived from
+		// * the normal deviating most from it
+		float axisLength =
+			std::sqrt(normalSum[0] * normalSum[0] + normalSum[1] * normalSum[1] +
+					  normalSum[2] * normalSum[2]);
+		meshlet.coneCutoff = 1.0f;
+		if (axisLength > 0.0f) {
+			for (int k = 0; k < 3; k++) {
+				meshlet.coneAxis[k] = normalSum[k] / axisLength;
+			}
+			float minDot = 1.0f;
+			for (uint32_t triangle : meshletTriangles) {
+				const float *n = &normals[3 * triangle];
+				if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f) {
+					continue;
+				}
+				minDot = std::min(minDot, n[0] * meshlet.coneAxis[0] +
+											  n[1] * meshlet.coneAxis[1] +
+											  n[2] * meshlet.coneAxis[2]);
+			}
+			// a cone of 90 degrees or more can always be seen from somewhere
+			if (minDot > 0.0f) {
+				meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+			}
+		}
+
+		result.meshlets.push_back(meshlet);
+	}
+
+	return result;
+}
+
+// frustum planes (xyz normal pointing inwards, w distance) of a column-major
+// clip matrix with Vulkan's 0..w depth range, in the space the matrix maps from
+inline void extractFrustumPlanes(const float *m, float planes[6][4]) {
+	auto row = [m](int r, int c) { return m[c * 4 + r]; };
+	for (int c = 0; c < 4; c++) {
+		planes[0][c] = row(3, c) + row(0, c); // left
+		planes[1][c] = row(3, c) - row(0, c); // right
+		planes[2][c] = row(3, c) + row(1, c); // bottom / top
+		planes[3][c] = row(3, c) - row(1, c);
+		planes[4][c] = row(2, c);			  // near
+		planes[5][c] = row(3, c) - row(2, c); // far
+	}
+	for (int p = 0; p < 6; p++) {
+		float *plane = planes[p];
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] +
+								 plane[2] * plane[2]);
+		if (length > 0.0f) {
+			for (int c = 0; c < 4; c++) {
+				plane[c] /= length;
+			}
+		}
+	}
+}
+
+inline bool sphereInFrustum(const float center[3], float radius,
+							const float planes[6][4]) {
+	for (int p = 0; p < 6; p++) {
+		float distance = planes[p][0] * center[0] + planes[p][1] * center[1] +
+						 planes[p][2] * center[2] + planes[p][3];
+		if (distance < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// true when every triangle of the meshlet faces away from the camera
+inline bool meshletBackfacing(const Meshlet &meshlet,
+							  const float cameraPosition[3]) {
+	float d[3] = {meshlet.center[0] - cameraPosition[0],
+				  meshlet.center[1] - cameraPosition[1],
+				  meshlet.center[2] - cameraPosition[2]};
+	float distance = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	return d[0] * meshlet.coneAxis[0] + d[1] * meshlet.coneAxis[1] +
+			   d[2] * meshlet.coneAxis[2] >=
+		   meshlet.coneCutoff * distance + meshlet.radius;
+}
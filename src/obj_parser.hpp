@@ -0,0 +1,681 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "job_system.hpp"
+
+// the including translation unit may already have pulled tinyobj in together
+// with its implementation, including it a second time would redefine that
+#ifndef TINY_OBJ_LOADER_H_
+#include "tinyobj/tiny_obj_loader.h"
+#endif
+
+/*
+	Parallel OBJ ingestion for very large models.
+
+	The file is streamed in OBJ_PARSE_BLOCK_SIZE blocks (the next block is
+	read on a worker while the current one is parsed), so peak memory is two
+	blocks plus the parsed result rather than the whole file on top of it.
+
+	Each block is cut into chunks on line boundaries and the chunks are
+	tokenized in parallel into chunk-local attribute and index arrays. Face
+	indices that are positive already address the global attribute arrays,
+	relative (negative) ones are recorded and rebased during the merge, which
+	uses prefix sums over the chunk sizes to copy every chunk into its final
+	place in attrib / shapes in parallel.
+
+	Only what loadModel consumes is supported: v, vn, vt, f (triangulated as
+	a fan) and o/g shape boundaries. Everything else (materials, lines,
+	points, smoothing groups, ...) is skipped.
+*/
+
+const size_t OBJ_PARSE_BLOCK_SIZE = 32 * 1024 * 1024;
+// chunks per thread and block, more than one balances uneven line mixes
+const size_t OBJ_PARSE_CHUNKS_PER_THREAD = 4;
+
+struct ObjParseStats {
+	uint64_t bytes = 0;
+	double millis = 0.0;
+	uint32_t blocks = 0;
+	uint32_t chunks = 0;
+	unsigned threads = 0;
+
+	double megabytesPerSecond() const {
+		return millis > 0.0 ? (bytes / (1024.0 * 1024.0)) / (millis / 1000.0)
+							: 0.0;
+	}
+};
+
+namespace objparser {
+
+// * Clinger's fast path: a decimal with at most 19 significant digits and a
+// * power of ten that is exactly representable as a double converts with a
+// * single multiply/divide, anything else falls back to strtod
+inline bool parseReal(const char *&p, const char *end, float &out) {
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+
+	const char *start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool anyDigit = false;
+
+	while (p < end && unsigned(*p - '0') < 10) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + unsigned(*p - '0');
+			if (mantissa != 0) {
+				digits++;
+			}
+		} else {
+			exponent++;
+		}
+		anyDigit = true;
+		p++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && unsigned(*p - '0') < 10) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + unsigned(*p - '0');
+				exponent--;
+				if (mantissa != 0) {
+					digits++;
+				}
+			}
+			anyDigit = true;
+			p++;
+		}
+	}
+	if (!anyDigit) {
+		// nan, inf, or garbage
+		char *parsedEnd = nullptr;
+		out = std::strtof(start, &parsedEnd);
+		if (parsedEnd == start || parsedEnd > end) {
+			p = start;
+			return false;
+		}
+		p = parsedEnd;
+		return true;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool negativeExponent = false;
+		if (q < end && (*q == '-' || *q == '+')) {
+			negativeExponent = *q == '-';
+			q++;
+		}
+		if (q < end && unsigned(*q - '0') < 10) {
+			int value = 0;
+			while (q < end && unsigned(*q - '0') < 10) {
+				if (value < 10000) {
+					value = value * 10 + (*q - '0');
+				}
+				q++;
+			}
+			exponent += negativeExponent ? -value : value;
+			p = q;
+		}
+	}
+
+	static const double powersOfTen[] = {
+		1e0,  1e1,  1e2,  1e3,	1e4,  1e5,	1e6,  1e7,	1e8,  1e9,	1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+	if (mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+		double value = double(mantissa);
+		value = exponent < 0 ? value / powersOfTen[-exponent]
+							 : value * powersOfTen[exponent];
+		out = static_cast<float>(negative ? -value : value);
+		return true;
+	}
+
+	// slow path for long mantissas and large exponents
+	std::string copy(start, p);
+	out = std::strtof(copy.c_str(), nullptr);
+	return true;
+}
+
+inline bool parseInt(const char *&p, const char *end, int &out) {
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	if (p >= end || unsigned(*p - '0') >= 10) {
+		return false;
+	}
+	int value = 0;
+	while (p < end && unsigned(*p - '0') < 10) {
+		value = value * 10 + (*p - '0');
+		p++;
+	}
+	out = negative ? -value : value;
+	return true;
+}
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+struct ShapeMark {
+	// number of chunk-local indices emitted before the o/g line
+	size_t indexOffset;
+	std::string name;
+};
+
+struct Chunk {
+	const char *begin = nullptr;
+	const char *end = nullptr;
+
+	std::vector<tinyobj::real_t> positions;
+	std::vector<tinyobj::real_t> normals;
+	std::vector<tinyobj::real_t> texcoords;
+	std::vector<tinyobj::index_t> indices;
+
+	// entries of `indices` holding relative references, encoded as
+	// 3 * entry + component (0 position, 1 normal, 2 texcoord)
+	std::vector<size_t> relative;
+	std::vector<ShapeMark> shapeMarks;
+
+	std::string error;
+
+	// prefix sums filled in by the merge
+	size_t positionBase = 0;
+	size_t normalBase = 0;
+	size_t texcoordBase = 0;
+};
+
+// resolve a 1-based OBJ index, relative ones are made chunk-local and
+// flagged so the merge can rebase them
+inline bool resolveIndex(int value, size_t localCount, int &out,
+						 bool &relative) {
+	relative = value < 0;
+	if (value > 0) {
+		out = value - 1;
+	} else if (value < 0) {
+		out = static_cast<int>(localCount) + value;
+	}
+	return value != 0;
+}
+
+inline void parseChunk(Chunk &chunk) {
+	const char *p = chunk.begin;
+	const char *end = chunk.end;
+
+	// face corners of the current line, before triangulation
+	std::vector<tinyobj::index_t> corners;
+	// bit per component, set for relative references
+	std::vector<uint8_t> cornerRelative;
+
+	auto fail = [&](const char *lineStart, const char *lineEnd,
+					const char *message) {
+		chunk.error = std::string(message) + ": \"" +
+					  std::string(lineStart, lineEnd) + "\"";
+	};
+
+	while (p < end) {
+		const char *lineEnd = static_cast<const char *>(
+			std::memchr(p, '\n', static_cast<size_t>(end - p)));
+		if (lineEnd == nullptr) {
+			lineEnd = end;
+		}
+		const char *lineStart = p;
+
+		while (p < lineEnd && isBlank(*p)) {
+			p++;
+		}
+
+		if (p + 1 < lineEnd && p[0] == 'v' && isBlank(p[1])) {
+			p += 2;
+			float xyz[3];
+			for (float &value : xyz) {
+				if (!parseReal(p, lineEnd, value)) {
+					fail(lineStart, lineEnd, "malformed vertex");
+					return;
+				}
+			}
+			chunk.positions.insert(chunk.positions.end(), xyz, xyz + 3);
+		} else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' &&
+				   isBlank(p[2])) {
+			p += 3;
+			float xyz[3];
+			for (float &value : xyz) {
+				if (!parseReal(p, lineEnd, value)) {
+					fail(lineStart, lineEnd, "malformed normal");
+					return;
+				}
+			}
+			chunk.normals.insert(chunk.normals.end(), xyz, xyz + 3);
+		} else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 't' &&
+				   isBlank(p[2])) {
+			p += 3;
+			float uv[2] = {0.0f, 0.0f};
+			if (!parseReal(p, lineEnd, uv[0])) {
+				fail(lineStart, lineEnd, "malformed texcoord");
+				return;
+			}
+			// v is optional
+			const char *rewind = p;
+			if (!parseReal(p, lineEnd, uv[1])) {
+				p = rewind;
+			}
+			chunk.texcoords.insert(chunk.texcoords.end(), uv, uv + 2);
+		} else if (p + 1 < lineEnd && p[0] == 'f' && isBlank(p[1])) {
+			p += 2;
+			corners.clear();
+			cornerRelative.clear();
+
+			while (true) {
+				while (p < lineEnd && isBlank(*p)) {
+					p++;
+				}
+				if (p >= lineEnd) {
+					break;
+				}
+
+				tinyobj::index_t corner = {-1, -1, -1};
+				bool relative[3] = {false, false, false};
+				int value;
+				if (!parseInt(p, lineEnd, value) ||
+					!resolveIndex(value, chunk.positions.size() / 3,
+								  corner.vertex_index, relative[0])) {
+					fail(lineStart, lineEnd, "malformed face");
+					return;
+				}
+				if (p < lineEnd && *p == '/') {
+					p++;
+					if (p < lineEnd && *p != '/') {
+						if (!parseInt(p, lineEnd, value) ||
+							!resolveIndex(value, chunk.texcoords.size() / 2,
+										  corner.texcoord_index,
+										  relative[2])) {
+							fail(lineStart, lineEnd, "malformed face");
+							return;
+						}
+					}
+					if (p < lineEnd && *p == '/') {
+						p++;
+						if (!parseInt(p, lineEnd, value) ||
+							!resolveIndex(value, chunk.normals.size() / 3,
+										  corner.normal_index, relative[1])) {
+							fail(lineStart, lineEnd, "malformed face");
+							return;
+						}
+					}
+				}
+				corners.push_back(corner);
+				cornerRelative.push_back(uint8_t(relative[0]) |
+										 uint8_t(relative[1]) << 1 |
+										 uint8_t(relative[2]) << 2);
+			}
+
+			if (corners.size() < 3) {
+				fail(lineStart, lineEnd, "face with fewer than 3 vertices");
+				return;
+			}
+
+			// * fan triangulation, unlike tinyobj quads are always split along
+			// * 0-2 since the positions may live in another chunk
+			for (size_t i = 1; i + 1 < corners.size(); i++) {
+				size_t fan[3] = {0, i, i + 1};
+				for (size_t corner : fan) {
+					for (size_t component = 0; component < 3; component++) {
+						if (cornerRelative[corner] & (1u << component)) {
+							chunk.relative.push_back(3 * chunk.indices.size() +
+													 component);
+						}
+					}
+					chunk.indices.push_back(corners[corner]);
+				}
+			}
+		} else if (p < lineEnd && (p[0] == 'o' || p[0] == 'g') &&
+				   (p + 1 == lineEnd || isBlank(p[1]))) {
+			p++;
+			while (p < lineEnd && isBlank(*p)) {
+				p++;
+			}
+			const char *nameEnd = lineEnd;
+			while (nameEnd > p && isBlank(nameEnd[-1])) {
+				nameEnd--;
+			}
+			chunk.shapeMarks.push_back(
+				{chunk.indices.size(), std::string(p, nameEnd)});
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+inline void rebase(int &index, size_t base) {
+	index += static_cast<int>(base);
+}
+
+// where a contiguous run of chunk indices lands in the output shapes
+struct Segment {
+	size_t chunk;
+	size_t begin;
+	size_t end;
+	size_t shape;
+	size_t offset;
+};
+
+class ParallelObjParser {
+  public:
+	ParallelObjParser(JobSystem &jobs, tinyobj::attrib_t &attrib,
+					  std::vector<tinyobj::shape_t> &shapes)
+		: jobs(jobs), attrib(attrib), shapes(shapes) {}
+
+	// * waits on the block reads it submits to jobs, so it must not run on
+	// * one of jobs' workers (see JobSystem)
+	bool parse(const std::string &path, std::string &err,
+			   ObjParseStats &stats) {
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			err = "failed to open " + path;
+			return false;
+		}
+
+		attrib = tinyobj::attrib_t();
+		shapes.clear();
+		shapes.emplace_back();
+		stats = ObjParseStats();
+		stats.threads = jobs.threadCount();
+
+		// * one spare byte per buffer for a terminator, the strtof fallbacks
+		// * may look past the last digit of the final block
+		std::vector<char> buffers[2];
+		buffers[0].resize(OBJ_PARSE_BLOCK_SIZE + 1);
+		buffers[1].resize(OBJ_PARSE_BLOCK_SIZE + 1);
+
+		auto readBlock = [&file](std::vector<char> &buffer) {
+			file.read(buffer.data(),
+					  static_cast<std::streamsize>(OBJ_PARSE_BLOCK_SIZE));
+			size_t size = static_cast<size_t>(file.gcount());
+			buffer[size] = '\0';
+			return size;
+		};
+
+		// incomplete last line of the previous block
+		std::string carry;
+		size_t current = 0;
+		PendingRead pending;
+		pending.size = jobs.submit(
+			[&readBlock, &buffers]() { return readBlock(buffers[0]); });
+
+		while (true) {
+			size_t size = pending.size.get();
+			bool last = size < OBJ_PARSE_BLOCK_SIZE;
+			if (!last) {
+				std::vector<char> &next = buffers[current ^ 1];
+				pending.size = jobs.submit(
+					[&readBlock, &next]() { return readBlock(next); });
+			}
+
+			stats.bytes += size;
+			const char *data = buffers[current].data();
+			const char *end = data + size;
+
+			if (!carry.empty()) {
+				const char *newline = static_cast<const char *>(
+					std::memchr(data, '\n', size));
+				if (newline == nullptr && !last) {
+					// a single line longer than a block
+					carry.append(data, end);
+					current ^= 1;
+					continue;
+				}
+				const char *joinEnd = newline != nullptr ? newline + 1 : end;
+				carry.append(data, joinEnd);
+				data = joinEnd;
+			}
+
+			const char *tail = end;
+			if (!last) {
+				while (tail > data && tail[-1] != '\n') {
+					tail--;
+				}
+			}
+
+			if (!parseBlock(carry, data, tail, stats, err)) {
+				return false;
+			}
+
+			carry.assign(tail, end);
+			stats.blocks++;
+			if (last) {
+				break;
+			}
+			current ^= 1;
+		}
+
+		// a trailing o/g without faces leaves an empty shape behind
+		if (shapes.size() > 1 && shapes.back().mesh.indices.empty()) {
+			shapes.pop_back();
+		}
+
+		if (!validate(err)) {
+			return false;
+		}
+
+		stats.millis = std::chrono::duration<double, std::milli>(
+						   std::chrono::high_resolution_clock::now() - startTime)
+						   .count();
+		return true;
+	}
+
+  private:
+	// a read still in flight must finish before its buffer goes away, also
+	// when parsing bails out early or throws
+	struct PendingRead {
+		std::future<size_t> size;
+		~PendingRead() {
+			if (size.valid()) {
+				size.wait();
+			}
+		}
+	};
+
+	bool parseBlock(const std::string &carry, const char *begin,
+					const char *end, ObjParseStats &stats, std::string &err) {
+		std::vector<Chunk> chunks;
+
+		if (!carry.empty()) {
+			chunks.emplace_back();
+			chunks.back().begin = carry.data();
+			chunks.back().end = carry.data() + carry.size();
+		}
+
+		size_t chunkCount =
+			std::max<size_t>(1, jobs.threadCount() * OBJ_PARSE_CHUNKS_PER_THREAD);
+		size_t targetSize =
+			std::max<size_t>(64 * 1024, (end - begin) / chunkCount + 1);
+		const char *p = begin;
+		while (p < end) {
+			const char *chunkEnd =
+				static_cast<size_t>(end - p) <= targetSize ? end : p + targetSize;
+			while (chunkEnd < end && chunkEnd[-1] != '\n') {
+				chunkEnd++;
+			}
+			chunks.emplace_back();
+			chunks.back().begin = p;
+			chunks.back().end = chunkEnd;
+			p = chunkEnd;
+		}
+		stats.chunks += static_cast<uint32_t>(chunks.size());
+
+		jobs.parallelFor(chunks.size(),
+						 [&chunks](size_t i) { parseChunk(chunks[i]); });
+
+		for (const Chunk &chunk : chunks) {
+			if (!chunk.error.empty()) {
+				err = chunk.error;
+				return false;
+			}
+		}
+
+		merge(chunks);
+		return true;
+	}
+
+	void merge(std::vector<Chunk> &chunks) {
+		// * prefix sums over the chunk attribute counts give every chunk its
+		// * base in the global arrays, which also rebases relative indices
+		size_t positionCount = attrib.vertices.size() / 3;
+		size_t normalCount = attrib.normals.size() / 3;
+		size_t texcoordCount = attrib.texcoords.size() / 2;
+		for (Chunk &chunk : chunks) {
+			chunk.positionBase = positionCount;
+			chunk.normalBase = normalCount;
+			chunk.texcoordBase = texcoordCount;
+			positionCount += chunk.positions.size() / 3;
+			normalCount += chunk.normals.size() / 3;
+			texcoordCount += chunk.texcoords.size() / 2;
+		}
+
+		// * walk the shape marks once to know where each run of indices
+		// * goes, shapes only ever grow at the back so this stays cheap
+		std::vector<Segment> segments;
+		std::vector<size_t> shapeSizes;
+		for (const auto &shape : shapes) {
+			shapeSizes.push_back(shape.mesh.indices.size());
+		}
+		for (size_t c = 0; c < chunks.size(); c++) {
+			const Chunk &chunk = chunks[c];
+			size_t begin = 0;
+			auto emit = [&](size_t segmentEnd) {
+				if (segmentEnd > begin) {
+					segments.push_back({c, begin, segmentEnd,
+										shapeSizes.size() - 1,
+										shapeSizes.back()});
+					shapeSizes.back() += segmentEnd - begin;
+				}
+				begin = segmentEnd;
+			};
+			for (const ShapeMark &mark : chunk.shapeMarks) {
+				emit(mark.indexOffset);
+				// like tinyobj a new shape only starts once the current one
+				// has faces, otherwise the name is just replaced
+				if (shapeSizes.back() != 0) {
+					shapes.emplace_back();
+					shapeSizes.push_back(0);
+				}
+				shapes.back().name = mark.name;
+			}
+			emit(chunk.indices.size());
+		}
+
+		for (size_t s = 0; s < shapes.size(); s++) {
+			tinyobj::mesh_t &mesh = shapes[s].mesh;
+			mesh.indices.resize(shapeSizes[s]);
+			mesh.num_face_vertices.resize(shapeSizes[s] / 3, 3);
+			mesh.material_ids.resize(shapeSizes[s] / 3, -1);
+			mesh.smoothing_group_ids.resize(shapeSizes[s] / 3, 0);
+		}
+		attrib.vertices.resize(positionCount * 3);
+		attrib.normals.resize(normalCount * 3);
+		attrib.texcoords.resize(texcoordCount * 2);
+
+		jobs.parallelFor(chunks.size(), [&](size_t c) {
+			const Chunk &chunk = chunks[c];
+			std::copy(chunk.positions.begin(), chunk.positions.end(),
+					  attrib.vertices.begin() + chunk.positionBase * 3);
+			std::copy(chunk.normals.begin(), chunk.normals.end(),
+					  attrib.normals.begin() + chunk.normalBase * 3);
+			std::copy(chunk.texcoords.begin(), chunk.texcoords.end(),
+					  attrib.texcoords.begin() + chunk.texcoordBase * 2);
+		});
+
+		jobs.parallelFor(segments.size(), [&](size_t s) {
+			const Segment &segment = segments[s];
+			Chunk &chunk = chunks[segment.chunk];
+
+			// relative entries are sorted, find the ones in this segment
+			auto relative = std::lower_bound(chunk.relative.begin(),
+											 chunk.relative.end(),
+											 3 * segment.begin);
+			for (; relative != chunk.relative.end() &&
+				   *relative < 3 * segment.end;
+				 ++relative) {
+				tinyobj::index_t &index = chunk.indices[*relative / 3];
+				switch (*relative % 3) {
+				case 0:
+					rebase(index.vertex_index, chunk.positionBase);
+					break;
+				case 1:
+					rebase(index.normal_index, chunk.normalBase);
+					break;
+				default:
+					rebase(index.texcoord_index, chunk.texcoordBase);
+					break;
+				}
+			}
+
+			std::copy(chunk.indices.begin() + segment.begin,
+					  chunk.indices.begin() + segment.end,
+					  shapes[segment.shape].mesh.indices.begin() +
+						  segment.offset);
+		});
+	}
+
+	// loadModel indexes attrib without bounds checks, reject bad references
+	bool validate(std::string &err) {
+		int positionCount = static_cast<int>(attrib.vertices.size() / 3);
+		int normalCount = static_cast<int>(attrib.normals.size() / 3);
+		int texcoordCount = static_cast<int>(attrib.texcoords.size() / 2);
+
+		std::vector<char> invalid(shapes.size(), 0);
+		jobs.parallelFor(shapes.size(), [&](size_t s) {
+			for (const tinyobj::index_t &index : shapes[s].mesh.indices) {
+				if (index.vertex_index < 0 ||
+					index.vertex_index >= positionCount ||
+					index.normal_index >= normalCount ||
+					index.texcoord_index >= texcoordCount ||
+					index.normal_index < -1 || index.texcoord_index < -1) {
+					invalid[s] = 1;
+					return;
+				}
+			}
+		});
+
+		for (size_t s = 0; s < shapes.size(); s++) {
+			if (invalid[s]) {
+				err = "face index out of range in shape \"" + shapes[s].name +
+					  "\"";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	JobSystem &jobs;
+	tinyobj::attrib_t &attrib;
+	std::vector<tinyobj::shape_t> &shapes;
+};
+
+} // namespace objparser
+
+// drop-in replacement for tinyobj::LoadObj (triangulated, no materials)
+inline bool loadObjParallel(JobSystem &jobs, tinyobj::attrib_t &attrib,
+							std::vector<tinyobj::shape_t> &shapes,
+							const std::string &path, std::string &err,
+							ObjParseStats &stats) {
+	objparser::ParallelObjParser parser(jobs, attrib, shapes);
+	return parser.parse(path, err, stats);
+}
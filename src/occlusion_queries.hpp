@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "device_allocator.hpp"
+
+/*
+	Hardware occlusion queries for a few expensive objects, the cheap
+	alternative to the depth pyramid of GpuCuller when a scene is not made
+	of thousands of instances.
+
+	After the objects are drawn, the bounding box of each one
+	(occlusion_proxy.vert) is rasterized against the depth attachment
+	inside its own VK_QUERY_TYPE_OCCLUSION query, writing neither depth nor
+	color. The box contains the object, so the object never hides its own
+	box: a query that passed no samples means something else covers the
+	object. Boxes reaching in front of the near plane cover the screen
+	instead and always pass.
+
+	Results are never waited for. An object is drawn unless a finished
+	query of an earlier frame found it hidden:
+		conditional	with VK_EXT_conditional_rendering, recordBegin()
+					copies the previous frame's results into the frame's
+					predicate buffer on the GPU (results that are not
+					available yet keep the 1 it was filled with), the
+					object's draws go between beginConditional() and
+					endConditional()
+		host		without it, readResults() picks up the frame's own
+					results once its fence signaled, a full round of
+					frames in flight later, and the caller leaves out the
+					draws of the objects visible() reports hidden
+	A hidden object's box is still tested every frame, so the object is
+	drawn again one (conditional) or a few (host) frames after it comes
+	into view.
+
+	readResults() also counts the finished tests and the hidden objects
+	among them, every hidden object is a draw the queries skipped. One pool
+	holds capacity queries per frame in flight.
+*/
+
+// vertices of the 12 box triangles occlusion_proxy.vert expands
+const uint32_t OCCLUSION_PROXY_VERTEX_COUNT = 36;
+
+class OcclusionQueries {
+  public:
+	// * beginConditionalRendering and endConditionalRendering are nullptr
+	// * without VK_EXT_conditional_rendering, then the caller skips the
+	// * draws of hidden objects itself
+	void create(VkDevice device, DeviceAllocator &allocator,
+				uint32_t frameCount, uint32_t capacity,
+				PFN_vkCmdBeginConditionalRenderingEXT beginConditionalRendering,
+				PFN_vkCmdEndConditionalRenderingEXT endConditionalRendering) {
+		this->device = device;
+		this->allocator = &allocator;
+		this->objectCapacity = capacity;
+		this->beginConditionalRendering = beginConditionalRendering;
+		this->endConditionalRendering = endConditionalRendering;
+
+		VkQueryPoolCreateInfo queryInfo{};
+		queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+		queryInfo.queryCount = capacity * frameCount;
+		if (vkCreateQueryPool(device, &queryInfo, nullptr, &queryPool) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create occlusion query pool!");
+		}
+
+		frames.resize(frameCount);
+		for (Frame &frame : frames) {
+			frame.visible.assign(capacity, 1);
+			if (conditionalRenderingSupported()) {
+				frame.predicates =
+					createPredicateBuffer(frame.predicatesMemory);
+			}
+		}
+	}
+
+	// the device must be idle
+	void destroy() {
+		for (Frame &frame : frames) {
+			if (frame.predicates != VK_NULL_HANDLE) {
+				vkDestroyBuffer(device, frame.predicates, nullptr);
+				allocator->free(frame.predicatesMemory);
+			}
+		}
+		frames.clear();
+		vkDestroyQueryPool(device, queryPool, nullptr);
+	}
+
+	// * once before the first frame, so no result is ever read from a
+	// * query that was not reset yet
+	void resetQueries(VkCommandBuffer commandBuffer) {
+		vkCmdResetQueryPool(commandBuffer, queryPool, 0,
+							objectCapacity *
+								static_cast<uint32_t>(frames.size()));
+	}
+
+	uint32_t capacity() const { return objectCapacity; }
+	bool conditionalRenderingSupported() const {
+		return beginConditionalRendering != nullptr;
+	}
+
+	// * outside a render pass, before the frame's draws: fills the frame's
+	// * predicates from the previous frame's queries (conditional rendering
+	// * only), then resets every query of the frame, so the ones it does
+	// * not issue read as not available
+	void recordBegin(VkCommandBuffer commandBuffer, uint32_t frame) {
+		if (conditionalRenderingSupported()) {
+			uint32_t frameCount = static_cast<uint32_t>(frames.size());
+			uint32_t previous = (frame + frameCount - 1) % frameCount;
+			VkBuffer predicates = frames[frame].predicates;
+			vkCmdFillBuffer(commandBuffer, predicates, 0, VK_WHOLE_SIZE, 1);
+			transferBarrier(commandBuffer, VK_ACCESS_TRANSFER_WRITE_BIT,
+							VK_PIPELINE_STAGE_TRANSFER_BIT);
+			// * no wait: results of queries still running are not written
+			vkCmdCopyQueryPoolResults(commandBuffer, queryPool,
+									  previous * objectCapacity,
+									  objectCapacity, predicates, 0,
+									  sizeof(uint32_t), 0);
+			transferBarrier(commandBuffer,
+							VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT,
+							VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT);
+		}
+		vkCmdResetQueryPool(commandBuffer, queryPool, frame * objectCapacity,
+							objectCapacity);
+	}
+
+	// * inside the render pass, around the draws of object. Records
+	// * nothing without conditional rendering, see visible()
+	void beginConditional(VkCommandBuffer commandBuffer, uint32_t frame,
+						  uint32_t object) {
+		if (!conditionalRenderingSupported()) {
+			return;
+		}
+		VkConditionalRenderingBeginInfoEXT beginInfo{};
+		beginInfo.sType =
+			VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT;
+		beginInfo.buffer = frames[frame].predicates;
+		beginInfo.offset = VkDeviceSize(object) * sizeof(uint32_t);
+		beginConditionalRendering(commandBuffer, &beginInfo);
+	}
+
+	void endConditional(VkCommandBuffer commandBuffer) {
+		if (conditionalRenderingSupported()) {
+			endConditionalRendering(commandBuffer);
+		}
+	}
+
+	// * inside the render pass after the frame's draws, with the proxy
+	// * pipeline bound and the objects' InstanceData at vertex binding 1:
+	// * one query per object [0, count)
+	void drawProxies(VkCommandBuffer commandBuffer, uint32_t frame,
+					 uint32_t count) {
+		uint32_t first = frame * objectCapacity;
+		for (uint32_t object = 0; object < std::min(count, objectCapacity);
+			 object++) {
+			vkCmdBeginQuery(commandBuffer, queryPool, first + object, 0);
+			vkCmdDraw(commandBuffer, OCCLUSION_PROXY_VERTEX_COUNT, 1, 0,
+					  object);
+			vkCmdEndQuery(commandBuffer, queryPool, first + object);
+		}
+	}
+
+	// * once the frame's fence signaled: the results of its last
+	// * submission for objects [0, count). A query that is not available
+	// * (never issued) leaves its object visible and is not counted
+	void readResults(uint32_t frame, uint32_t count) {
+		Frame &current = frames[frame];
+		count = std::min(count, objectCapacity);
+		// * result and availability per query
+		std::vector<uint32_t> results(2 * size_t(count), 0);
+		VkResult result = vkGetQueryPoolResults(
+			device, queryPool, frame * objectCapacity, count,
+			results.size() * sizeof(uint32_t), results.data(),
+			2 * sizeof(uint32_t), VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if (result != VK_SUCCESS && result != VK_NOT_READY) {
+			return;
+		}
+		current.hidden = 0;
+		for (uint32_t object = 0; object < count; object++) {
+			bool available = results[2 * object + 1] != 0;
+			bool hidden = available && results[2 * object] == 0;
+			current.visible[object] = hidden ? 0 : 1;
+			current.hidden += hidden ? 1 : 0;
+			testedCount += available ? 1 : 0;
+		}
+		hiddenCount += current.hidden;
+	}
+
+	// * whether the frame should record object's draws, always true with
+	// * conditional rendering and for objects past the capacity
+	bool visible(uint32_t frame, uint32_t object) const {
+		return conditionalRenderingSupported() || object >= objectCapacity ||
+			   frames[frame].visible[object] != 0;
+	}
+
+	const std::vector<uint8_t> &visibility(uint32_t frame) const {
+		return frames[frame].visible;
+	}
+
+	// objects the frame's last finished submission found hidden
+	uint32_t hiddenObjects(uint32_t frame) const {
+		return frames[frame].hidden;
+	}
+
+	// * finished tests since the last call and how many draws they
+	// * skipped, one line like
+	// *     occlusion queries: 3/40 objects hidden (7.5% of the draws ...
+	void printStats(std::ostream &out) {
+		if (testedCount == 0) {
+			return;
+		}
+		out << "    occlusion queries: " << hiddenCount << "/" << testedCount
+			<< " objects hidden (" << 100.0 * hiddenCount / testedCount
+			<< "% of the draws skipped, "
+			<< (conditionalRenderingSupported() ? "conditional rendering"
+												: "skipped on the host")
+			<< ")" << std::endl;
+		testedCount = 0;
+		hiddenCount = 0;
+	}
+
+  private:
+	struct Frame {
+		// 1 per object that is drawn, VK_NULL_HANDLE on the host path
+		VkBuffer predicates = VK_NULL_HANDLE;
+		DeviceAllocation predicatesMemory;
+		// host path, from the frame's last finished submission
+		std::vector<uint8_t> visible;
+		uint32_t hidden = 0;
+	};
+
+	VkBuffer createPredicateBuffer(DeviceAllocation &memory) {
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = VkDeviceSize(objectCapacity) * sizeof(uint32_t);
+		bufferInfo.usage = VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT |
+						   VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		VkBuffer buffer;
+		if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create predicate buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+		memory = allocator->allocate(
+			memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			DeviceResourceKind::Buffer, bufferMemoryCategory(bufferInfo.usage),
+			DeviceAllocationStrategy::General);
+		vkBindBufferMemory(device, buffer, memory.memory, memory.offset);
+		return buffer;
+	}
+
+	// transfer writes to the predicates before dstAccess in dstStage
+	static void transferBarrier(VkCommandBuffer commandBuffer,
+								VkAccessFlags dstAccess,
+								VkPipelineStageFlags dstStage) {
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = dstAccess;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 dstStage, 0, 1, &barrier, 0, nullptr, 0,
+							 nullptr);
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	DeviceAllocator *allocator = nullptr;
+	uint32_t objectCapacity = 0;
+	PFN_vkCmdBeginConditionalRenderingEXT beginConditionalRendering = nullptr;
+	PFN_vkCmdEndConditionalRenderingEXT endConditionalRendering = nullptr;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	std::vector<Frame> frames;
+
+	uint64_t testedCount = 0;
+	uint64_t hiddenCount = 0;
+};
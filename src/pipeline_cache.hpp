@@ -0,0 +1,190 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/*
+	VkPipelineCache persisted to disk between runs.
+
+	create() loads the file written by the previous run and only hands it
+	to the driver when its header (VkPipelineCacheHeaderVersionOne) matches
+	this device: header version, vendor ID, device ID and
+	pipelineCacheUUID. A cache of another GPU or driver version is dropped
+	and the run starts cold; the driver would ignore or, on some
+	implementations, choke on it otherwise.
+
+	Every pipeline is created through createGraphicsPipeline() /
+	createComputePipeline(), which pass the cache and add up the time the
+	driver spent, so the startup log shows what a warm cache saves. Both
+	may be called from several threads at once (see PipelineCompiler), the
+	driver synchronizes access to the VkPipelineCache itself.
+
+	save() writes the cache to a temporary file and renames it into place,
+	an interrupted run never leaves a truncated cache behind.
+*/
+
+class PipelineCache {
+  public:
+	void create(VkDevice device, VkPhysicalDevice physicalDevice,
+				const std::string &path) {
+		this->device = device;
+		this->path = path;
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		std::vector<char> data = readCache(properties);
+		loadedBytes = data.size();
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+		if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) !=
+			VK_SUCCESS) {
+			// a driver may still reject data that passed the header check
+			cacheInfo.initialDataSize = 0;
+			cacheInfo.pInitialData = nullptr;
+			loadedBytes = 0;
+			if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) !=
+				VK_SUCCESS) {
+				throw std::runtime_error("failed to create pipeline cache!");
+			}
+		}
+	}
+
+	// * writes the cache back to disk, returns false when it could not be
+	// * written (the previous file, if any, is left untouched)
+	bool save() const {
+		size_t size = 0;
+		if (vkGetPipelineCacheData(device, cache, &size, nullptr) !=
+				VK_SUCCESS ||
+			size == 0) {
+			return false;
+		}
+		std::vector<char> data(size);
+		if (vkGetPipelineCacheData(device, cache, &size, data.data()) !=
+			VK_SUCCESS) {
+			return false;
+		}
+
+		std::string tmpPath = path + ".tmp";
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+		file.write(data.data(), static_cast<std::streamsize>(size));
+		file.close();
+		if (!file) {
+			std::remove(tmpPath.c_str());
+			return false;
+		}
+#ifdef _WIN32
+		// rename() does not replace an existing file on Windows
+		std::remove(path.c_str());
+#endif
+		return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+	}
+
+	void destroy() {
+		vkDestroyPipelineCache(device, cache, nullptr);
+		cache = VK_NULL_HANDLE;
+	}
+
+	VkResult createGraphicsPipeline(const VkGraphicsPipelineCreateInfo &info,
+									VkPipeline *pipeline) {
+		auto start = std::chrono::high_resolution_clock::now();
+		VkResult result = vkCreateGraphicsPipelines(device, cache, 1, &info,
+													nullptr, pipeline);
+		addCreateTime(start);
+		return result;
+	}
+
+	VkResult createComputePipeline(const VkComputePipelineCreateInfo &info,
+								   VkPipeline *pipeline) {
+		auto start = std::chrono::high_resolution_clock::now();
+		VkResult result = vkCreateComputePipelines(device, cache, 1, &info,
+												   nullptr, pipeline);
+		addCreateTime(start);
+		return result;
+	}
+
+	// * one line for the startup log, e.g.
+	// *     2 pipelines in 41.3 ms (warm, 182 KiB loaded)
+	void printStats(std::ostream &out) {
+		std::lock_guard<std::mutex> lock(statsMutex);
+		out << "    " << pipelineCount << " pipelines in " << createTime
+			<< " ms (";
+		if (loadedBytes > 0) {
+			out << "warm, " << loadedBytes / 1024 << " KiB loaded";
+		} else {
+			out << "cold";
+		}
+		out << ")" << std::endl;
+	}
+
+	VkPipelineCache handle() const { return cache; }
+	bool isWarm() const { return loadedBytes > 0; }
+	// host time spent inside vkCreate*Pipelines, summed over all threads
+	double createMilliseconds() {
+		std::lock_guard<std::mutex> lock(statsMutex);
+		return createTime;
+	}
+
+  private:
+	std::vector<char> readCache(const VkPhysicalDeviceProperties &properties) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			return {};
+		}
+		std::vector<char> data((std::istreambuf_iterator<char>(file)),
+							   std::istreambuf_iterator<char>());
+
+		// VkPipelineCacheHeaderVersionOne, read field by field since the
+		// data carries no alignment guarantee
+		const size_t headerSize = 16 + VK_UUID_SIZE;
+		uint32_t fields[4];
+		if (data.size() < headerSize) {
+			return {};
+		}
+		std::memcpy(fields, data.data(), sizeof(fields));
+		if (fields[0] < headerSize ||
+			fields[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+			fields[2] != properties.vendorID ||
+			fields[3] != properties.deviceID ||
+			std::memcmp(data.data() + 16, properties.pipelineCacheUUID,
+						VK_UUID_SIZE) != 0) {
+			std::cout << "    pipeline cache " << path
+					  << " belongs to another device or driver, ignored"
+					  << std::endl;
+			return {};
+		}
+		return data;
+	}
+
+	void addCreateTime(std::chrono::high_resolution_clock::time_point start) {
+		std::lock_guard<std::mutex> lock(statsMutex);
+		createTime += std::chrono::duration<double, std::milli>(
+						  std::chrono::high_resolution_clock::now() - start)
+						  .count();
+		pipelineCount++;
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	std::string path;
+	size_t loadedBytes = 0;
+	std::mutex statsMutex;
+	uint32_t pipelineCount = 0;
+	double createTime = 0.0;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "job_system.hpp"
+
+/*
+	Compiles pipelines on the JobSystem workers instead of the main thread.
+
+	request() queues a build function (read the shaders, fill in the create
+	info, call PipelineCache::create*Pipeline) and returns an id right away,
+	several requests compile in parallel against the shared cache.
+	get() never blocks: it returns the pipeline once its job finished and
+	the fallback given to request() until then. With VK_NULL_HANDLE as the
+	fallback the renderer skips whatever needs the pipeline; a new variant
+	can pass an already compiled pipeline instead so frames keep rendering
+	(with the old look) while the driver works.
+
+	Everything the build function writes is visible to the calling thread
+	once get() returned its pipeline. An exception thrown by a build
+	resurfaces from the get() or wait() that first sees it finished.
+	request(), get() and wait() must be called from one thread.
+*/
+
+using PipelineRequest = uint32_t;
+
+class PipelineCompiler {
+  public:
+	void create(VkDevice device, JobSystem &jobSystem) {
+		this->device = device;
+		this->jobSystem = &jobSystem;
+	}
+
+	PipelineRequest request(std::function<VkPipeline()> build,
+							VkPipeline fallback = VK_NULL_HANDLE) {
+		if (pending == 0) {
+			batchStart = std::chrono::high_resolution_clock::now();
+		}
+		Entry entry;
+		entry.fallback = fallback;
+		entry.future = jobSystem->submit(std::move(build));
+		entries.push_back(std::move(entry));
+		pending++;
+		return static_cast<PipelineRequest>(entries.size() - 1);
+	}
+
+	// compiled pipeline, or the fallback while it is still being compiled
+	VkPipeline get(PipelineRequest id) {
+		Entry &entry = entries[id];
+		if (!entry.ready && entry.future.wait_for(std::chrono::seconds(0)) ==
+								std::future_status::ready) {
+			harvest(entry);
+		}
+		return entry.ready ? entry.pipeline : entry.fallback;
+	}
+
+	bool isReady(PipelineRequest id) {
+		get(id);
+		return entries[id].ready;
+	}
+
+	// blocks until the pipeline is compiled
+	VkPipeline wait(PipelineRequest id) {
+		Entry &entry = entries[id];
+		if (!entry.ready) {
+			harvest(entry);
+		}
+		return entry.pipeline;
+	}
+
+	// number of requests still compiling
+	uint32_t pendingCount() {
+		for (PipelineRequest id = 0; id < entries.size() && pending > 0;
+			 id++) {
+			get(id);
+		}
+		return pending;
+	}
+
+	// * wall time from the first request of the current batch until its
+	// * last pipeline was picked up, the time frames ran on fallbacks
+	double batchMilliseconds() const { return batchTime; }
+
+	// waits for every job and destroys the compiled pipelines, fallbacks
+	// belong to the caller
+	void destroy() {
+		for (Entry &entry : entries) {
+			if (!entry.ready) {
+				try {
+					harvest(entry);
+				} catch (...) {
+					// already reported by get() or not needed anymore
+				}
+			}
+			if (entry.pipeline != VK_NULL_HANDLE) {
+				vkDestroyPipeline(device, entry.pipeline, nullptr);
+			}
+		}
+		entries.clear();
+		pending = 0;
+	}
+
+  private:
+	struct Entry {
+		std::future<VkPipeline> future;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkPipeline fallback = VK_NULL_HANDLE;
+		bool ready = false;
+	};
+
+	void harvest(Entry &entry) {
+		entry.ready = true;
+		if (--pending == 0) {
+			batchTime = std::chrono::duration<double, std::milli>(
+							std::chrono::high_resolution_clock::now() -
+							batchStart)
+							.count();
+		}
+		entry.pipeline = entry.future.get();
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	JobSystem *jobSystem = nullptr;
+	std::vector<Entry> entries;
+	uint32_t pending = 0;
+	std::chrono::high_resolution_clock::time_point batchStart;
+	double batchTime = 0.0;
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "job_system.hpp"
+
+/*
+	Records the draws of a render pass into secondary command buffers on
+	the JobSystem workers.
+
+	Every thread of the JobSystem (see JobSystem::threadIndex()) owns one
+	command pool per target, the primary the secondaries are executed
+	from: a frame in flight when the primaries are recorded every frame,
+	or every pre-recorded primary. A pool is only ever touched by its
+	thread while recording, so the pools need no locking. A thread that
+	picks up several chunks records each into its own secondary from the
+	same pool. The target's pools are reset as a whole before its chunks
+	are handed out instead of going through vkResetCommandBuffer.
+	Secondaries of reusable targets are recorded without
+	ONE_TIME_SUBMIT, their primary is submitted again every time it is
+	used and they stay valid until the target is recorded again.
+
+	record() splits the items [0, count) into contiguous chunks of at least
+	minItems, one per thread at most, and records every chunk into a
+	secondary that inherits the render pass, subpass and framebuffer. The
+	buffers come back in item order for vkCmdExecuteCommands, so the draw
+	order does not change. Secondaries inherit no state: the callback binds
+	the pipeline, dynamic state, buffers and descriptor sets itself.
+
+	Recording time and items are summed per thread until printStats()
+	reports and resets them.
+*/
+
+class SecondaryRecorder {
+  public:
+	using RecordFunction =
+		std::function<void(VkCommandBuffer, uint32_t first, uint32_t end)>;
+
+	// * threadCount is the JobSystem's threadCount(), the recorder must
+	// * only be used with that JobSystem
+	void create(VkDevice device, uint32_t queueFamily, uint32_t threadCount,
+				uint32_t targetCount, bool reusable) {
+		this->device = device;
+		this->threads = threadCount;
+		this->reusable = reusable;
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = queueFamily;
+
+		pools.resize(threadCount * targetCount);
+		for (ThreadPool &pool : pools) {
+			if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool.pool) !=
+				VK_SUCCESS) {
+				throw std::runtime_error(
+					"failed to create secondary command pool!");
+			}
+		}
+
+		threadMillis.assign(threadCount, 0.0);
+		threadItems.assign(threadCount, 0);
+		recorded.reserve(threadCount);
+	}
+
+	// the device must be idle
+	void destroy() {
+		for (ThreadPool &pool : pools) {
+			vkDestroyCommandPool(device, pool.pool, nullptr);
+		}
+		pools.clear();
+	}
+
+	uint32_t threadCount() const { return threads; }
+
+	// * records the chunks in parallel and returns their secondaries in
+	// * item order. Every earlier submission of target's secondaries must
+	// * have finished, i.e. its in-flight fence was waited on
+	const std::vector<VkCommandBuffer> &
+	record(JobSystem &jobSystem, uint32_t target, VkRenderPass renderPass,
+		   uint32_t subpass, VkFramebuffer framebuffer, uint32_t count,
+		   uint32_t minItems, const RecordFunction &recordItems) {
+		recorded.clear();
+		if (count == 0) {
+			return recorded;
+		}
+		uint32_t chunks =
+			std::min(threads, std::max(1u, count / std::max(1u, minItems)));
+		uint32_t chunkSize = (count + chunks - 1) / chunks;
+		// rounding up may leave the last chunks without items
+		chunks = (count + chunkSize - 1) / chunkSize;
+
+		for (uint32_t thread = 0; thread < threads; thread++) {
+			ThreadPool &pool = pools[target * threads + thread];
+			vkResetCommandPool(device, pool.pool, 0);
+			pool.used = 0;
+		}
+		recorded.assign(chunks, VK_NULL_HANDLE);
+
+		VkCommandBufferInheritanceInfo inheritance{};
+		inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance.renderPass = renderPass;
+		inheritance.subpass = subpass;
+		inheritance.framebuffer = framebuffer;
+
+		jobSystem.parallelFor(chunks, [&](size_t chunk) {
+			auto start = std::chrono::high_resolution_clock::now();
+			unsigned thread = JobSystem::threadIndex();
+			VkCommandBuffer buffer =
+				nextBuffer(pools[target * threads + thread]);
+
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			if (!reusable) {
+				beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			}
+			beginInfo.pInheritanceInfo = &inheritance;
+			if (vkBeginCommandBuffer(buffer, &beginInfo) != VK_SUCCESS) {
+				throw std::runtime_error(
+					"failed to begin secondary command buffer!");
+			}
+
+			uint32_t first = static_cast<uint32_t>(chunk) * chunkSize;
+			uint32_t end = std::min(count, first + chunkSize);
+			recordItems(buffer, first, end);
+
+			if (vkEndCommandBuffer(buffer) != VK_SUCCESS) {
+				throw std::runtime_error(
+					"failed to record secondary command buffer!");
+			}
+			recorded[chunk] = buffer;
+			// * only this thread writes its entries
+			threadMillis[thread] +=
+				std::chrono::duration<double, std::milli>(
+					std::chrono::high_resolution_clock::now() - start)
+					.count();
+			threadItems[thread] += end - first;
+		});
+
+		recordings++;
+		return recorded;
+	}
+
+	// * average record time and item count per record() call of every
+	// * thread since the last call, e.g.
+	// * "    recorded on 3/4 threads: 0.05 (120) ...". Threads that picked
+	// * up no chunk show 0
+	void printStats(std::ostream &out) {
+		if (recordings == 0) {
+			return;
+		}
+		uint32_t active = 0;
+		for (uint32_t thread = 0; thread < threads; thread++) {
+			active += threadItems[thread] != 0 ? 1 : 0;
+		}
+		out << "    recorded on " << active << "/" << threads << " threads:";
+		for (uint32_t thread = 0; thread < threads; thread++) {
+			out << " " << threadMillis[thread] / recordings << " ("
+				<< threadItems[thread] / recordings << ")";
+		}
+		out << " ms (draws) per recording, " << recordings << " recordings"
+			<< std::endl;
+		threadMillis.assign(threads, 0.0);
+		threadItems.assign(threads, 0);
+		recordings = 0;
+	}
+
+  private:
+	struct ThreadPool {
+		VkCommandPool pool = VK_NULL_HANDLE;
+		// * allocated so far, the first used of them belong to the target's
+		// * current recording
+		std::vector<VkCommandBuffer> buffers;
+		uint32_t used = 0;
+	};
+
+	// the pool's next free secondary, allocated the first time it is needed
+	VkCommandBuffer nextBuffer(ThreadPool &pool) {
+		if (pool.used == pool.buffers.size()) {
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = pool.pool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandBufferCount = 1;
+			VkCommandBuffer buffer;
+			if (vkAllocateCommandBuffers(device, &allocInfo, &buffer) !=
+				VK_SUCCESS) {
+				throw std::runtime_error(
+					"failed to allocate secondary command buffer!");
+			}
+			pool.buffers.push_back(buffer);
+		}
+		return pool.buffers[pool.used++];
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	uint32_t threads = 0;
+	bool reusable = false;
+	// [target * threads + JobSystem::threadIndex()]
+	std::vector<ThreadPool> pools;
+	std::vector<VkCommandBuffer> recorded;
+
+	std::vector<double> threadMillis;
+	std::vector<uint64_t> threadItems;
+	uint32_t recordings = 0;
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "device_allocator.hpp"
+
+/*
+	Persistently mapped ring buffer every upload is staged through.
+
+	One host visible, host coherent buffer with its own memory from the
+	DeviceAllocator stays mapped for the whole run, allocations are handed
+	out front to back and wrap around at the end.
+	Every submission that reads ring memory has to signal the fence returned
+	by submitFence(), which closes the region allocated since the previous
+	call. Regions are reclaimed in order once their fence signaled.
+
+	When an allocation does not fit, finished regions are reclaimed first,
+	then allocate() blocks on the oldest in-flight one. If the region that
+	is still being recorded fills the ring by itself, the flush callback
+	has to submit it (with submitFence()) so it can drain.
+
+	stream() splits uploads larger than the ring into chunks. The ring is
+	not thread safe, only one thread may use it at a time.
+*/
+
+const VkDeviceSize STAGING_RING_ALIGNMENT = 16;
+
+struct StagingAllocation {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void *data = nullptr;
+};
+
+class StagingRing {
+  public:
+	void create(VkDevice device, DeviceAllocator &allocator,
+				VkDeviceSize size) {
+		this->device = device;
+		this->allocator = &allocator;
+		capacity = size;
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create staging ring!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+		memory = allocator.allocate(memRequirements,
+									VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+										VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+									DeviceResourceKind::Buffer,
+									DeviceMemoryCategory::Staging,
+									DeviceAllocationStrategy::Dedicated);
+		vkBindBufferMemory(device, buffer, memory.memory, memory.offset);
+		mapped = memory.mapped;
+	}
+
+	// the device must be idle, or at least done with every region
+	void destroy() {
+		for (const Region &region : regions) {
+			vkDestroyFence(device, region.fence, nullptr);
+		}
+		for (VkFence fence : freeFences) {
+			vkDestroyFence(device, fence, nullptr);
+		}
+		regions.clear();
+		freeFences.clear();
+		vkDestroyBuffer(device, buffer, nullptr);
+		allocator->free(memory);
+		buffer = VK_NULL_HANDLE;
+		mapped = nullptr;
+	}
+
+	// submits everything recorded so far, using submitFence()
+	void setFlush(std::function<void()> flush) {
+		this->flush = std::move(flush);
+	}
+
+	VkDeviceSize size() const { return capacity; }
+	VkBuffer handle() const { return buffer; }
+	// times allocate() had to block on the GPU
+	uint64_t stallCount() const { return stalls; }
+
+	StagingAllocation allocate(VkDeviceSize size,
+							   VkDeviceSize alignment =
+								   STAGING_RING_ALIGNMENT) {
+		if (size > capacity) {
+			throw std::runtime_error("upload larger than the staging ring!");
+		}
+
+		StagingAllocation allocation;
+		while (!tryAllocate(size, alignment, allocation)) {
+			if (reclaim()) {
+				continue;
+			}
+			if (!regions.empty()) {
+				stalls++;
+				vkWaitForFences(device, 1, &regions.front().fence, VK_TRUE,
+								UINT64_MAX);
+				continue;
+			}
+			if (pendingBytes > 0 && flush) {
+				flush();
+				continue;
+			}
+			throw std::runtime_error("staging ring is full!");
+		}
+		return allocation;
+	}
+
+	// fence for the submission reading everything allocated since the last
+	// call, the ring owns it and resets it once it signaled
+	VkFence submitFence() {
+		VkFence fence;
+		if (!freeFences.empty()) {
+			fence = freeFences.back();
+			freeFences.pop_back();
+		} else {
+			VkFenceCreateInfo fenceInfo{};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			if (vkCreateFence(device, &fenceInfo, nullptr, &fence) !=
+				VK_SUCCESS) {
+				throw std::runtime_error("failed to create staging fence!");
+			}
+		}
+		regions.push_back({pendingBytes, fence});
+		pendingBytes = 0;
+		return fence;
+	}
+
+	// * uploads size bytes in chunks of at most half the ring (a multiple of
+	// * granularity, e.g. an image row), so one chunk can be filled while the
+	// * previous one is still being copied. fill(data, offset, bytes) writes
+	// * the chunk, record(allocation, offset) records its copy
+	void stream(VkDeviceSize size, VkDeviceSize granularity,
+				const std::function<void(void *, VkDeviceSize, VkDeviceSize)>
+					&fill,
+				const std::function<void(const StagingAllocation &,
+										 VkDeviceSize)> &record) {
+		VkDeviceSize maxChunk = capacity / 2 / granularity * granularity;
+		if (maxChunk == 0) {
+			throw std::runtime_error("staging ring smaller than one chunk!");
+		}
+		for (VkDeviceSize offset = 0; offset < size;) {
+			VkDeviceSize bytes = std::min(size - offset, maxChunk);
+			StagingAllocation allocation = allocate(bytes);
+			fill(allocation.data, offset, bytes);
+			record(allocation, offset);
+			offset += bytes;
+		}
+	}
+
+  private:
+	struct Region {
+		VkDeviceSize bytes;
+		VkFence fence;
+	};
+
+	bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment,
+					 StagingAllocation &allocation) {
+		if (used == 0) {
+			head = 0;
+		}
+		VkDeviceSize tail = (head + capacity - used) % capacity;
+		VkDeviceSize aligned = (head + alignment - 1) / alignment * alignment;
+
+		VkDeviceSize offset;
+		VkDeviceSize consumed;
+		if (used == capacity) {
+			return false;
+		} else if (head >= tail) {
+			// free space is [head, capacity) followed by [0, tail)
+			if (aligned + size <= capacity) {
+				offset = aligned;
+				consumed = aligned - head + size;
+			} else if (size <= tail) {
+				offset = 0;
+				consumed = capacity - head + size;
+			} else {
+				return false;
+			}
+		} else if (aligned + size <= tail) {
+			offset = aligned;
+			consumed = aligned - head + size;
+		} else {
+			return false;
+		}
+
+		head = (offset + size) % capacity;
+		used += consumed;
+		pendingBytes += consumed;
+
+		allocation.buffer = buffer;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.data = static_cast<char *>(mapped) + offset;
+		return true;
+	}
+
+	bool reclaim() {
+		bool reclaimed = false;
+		while (!regions.empty() &&
+			   vkGetFenceStatus(device, regions.front().fence) == VK_SUCCESS) {
+			used -= regions.front().bytes;
+			vkResetFences(device, 1, &regions.front().fence);
+			freeFences.push_back(regions.front().fence);
+			regions.pop_front();
+			reclaimed = true;
+		}
+		return reclaimed;
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	DeviceAllocator *allocator = nullptr;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	DeviceAllocation memory;
+	void *mapped = nullptr;
+	VkDeviceSize capacity = 0;
+
+	VkDeviceSize head = 0;
+	// bytes of submitted and pending regions, including alignment padding
+	// and the skipped end of the buffer when an allocation wrapped
+	VkDeviceSize used = 0;
+	VkDeviceSize pendingBytes = 0;
+	std::deque<Region> regions;
+	std::vector<VkFence> freeFences;
+	std::function<void()> flush;
+	uint64_t stalls = 0;
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/*
+	Records a whole batch of uploads (buffer copies, image copies, layout
+	transitions, mip blits) into one command buffer that is submitted once
+	and waited on with a single fence, instead of a submit plus
+	vkQueueWaitIdle per operation.
+
+	Barriers are not recorded right away: they are queued and flushed as
+	one vkCmdPipelineBarrier (with the union of their stage masks) before
+	the next command that is recorded through record(), or on submit. Back
+	to back transitions, e.g. the depth image and the placeholder texture,
+	or the two barriers around each mip blit, end up in a single barrier.
+
+	The counters accumulate over every batch recorded with the same object,
+	operationCount() is the number of single time submits this replaced.
+	measureSingleSubmits() times that replaced path as a baseline: one
+	submit and vkQueueWaitIdle per operation, with empty command buffers
+	since the copies themselves cost the same either way. What it takes
+	beyond the batch's own single round trip is the stall the batch saved.
+*/
+
+class UploadBatch {
+  public:
+	void begin(VkDevice device, VkCommandPool commandPool) {
+		this->device = device;
+		this->commandPool = commandPool;
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = commandPool;
+		allocInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate upload commands!");
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	}
+
+	// command buffer to record one operation into, with every queued
+	// barrier already flushed in front of it
+	VkCommandBuffer record() {
+		flushBarriers();
+		operations++;
+		return commandBuffer;
+	}
+
+	void imageBarrier(const VkImageMemoryBarrier &barrier,
+					  VkPipelineStageFlags srcStage,
+					  VkPipelineStageFlags dstStage) {
+		imageBarriers.push_back(barrier);
+		srcStages |= srcStage;
+		dstStages |= dstStage;
+		operations++;
+	}
+
+	void bufferBarrier(const VkBufferMemoryBarrier &barrier,
+					   VkPipelineStageFlags srcStage,
+					   VkPipelineStageFlags dstStage) {
+		bufferBarriers.push_back(barrier);
+		srcStages |= srcStage;
+		dstStages |= dstStage;
+		operations++;
+	}
+
+	// * fence is signaled by the submission, when it is VK_NULL_HANDLE the
+	// * batch uses its own. The caller serializes access to the queue
+	void submit(VkQueue queue, VkFence fence = VK_NULL_HANDLE,
+				VkSemaphore waitSemaphore = VK_NULL_HANDLE,
+				VkPipelineStageFlags waitStage = 0) {
+		flushBarriers();
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record upload commands!");
+		}
+
+		if (fence == VK_NULL_HANDLE) {
+			if (ownFence == VK_NULL_HANDLE) {
+				VkFenceCreateInfo fenceInfo{};
+				fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+				if (vkCreateFence(device, &fenceInfo, nullptr, &ownFence) !=
+					VK_SUCCESS) {
+					throw std::runtime_error("failed to create upload fence!");
+				}
+			} else {
+				vkResetFences(device, 1, &ownFence);
+			}
+			fence = ownFence;
+		}
+		submittedFence = fence;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.waitSemaphoreCount = waitSemaphore != VK_NULL_HANDLE ? 1 : 0;
+		submitInfo.pWaitSemaphores = &waitSemaphore;
+		submitInfo.pWaitDstStageMask = &waitStage;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit upload commands!");
+		}
+		submits++;
+	}
+
+	bool isComplete() const {
+		return vkGetFenceStatus(device, submittedFence) == VK_SUCCESS;
+	}
+
+	// blocks until the submission finished and frees its command buffer
+	void wait() {
+		auto start = std::chrono::high_resolution_clock::now();
+		vkWaitForFences(device, 1, &submittedFence, VK_TRUE, UINT64_MAX);
+		waitTime += std::chrono::duration<double, std::milli>(
+						std::chrono::high_resolution_clock::now() - start)
+						.count();
+
+		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+		commandBuffer = VK_NULL_HANDLE;
+		submittedFence = VK_NULL_HANDLE;
+	}
+
+	// * count submits of an empty command buffer, each waited on with
+	// * vkQueueWaitIdle, returns the milliseconds they took. The caller
+	// * serializes access to the queue
+	double measureSingleSubmits(VkQueue queue, uint32_t count) {
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = commandPool;
+		allocInfo.commandBufferCount = 1;
+		VkCommandBuffer empty;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &empty) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate upload commands!");
+		}
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		vkBeginCommandBuffer(empty, &beginInfo);
+		vkEndCommandBuffer(empty);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &empty;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < count; i++) {
+			if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) !=
+				VK_SUCCESS) {
+				throw std::runtime_error("failed to submit upload commands!");
+			}
+			vkQueueWaitIdle(queue);
+		}
+		double millis = std::chrono::duration<double, std::milli>(
+							std::chrono::high_resolution_clock::now() - start)
+							.count();
+
+		vkFreeCommandBuffers(device, commandPool, 1, &empty);
+		return millis;
+	}
+
+	void destroy() {
+		if (ownFence != VK_NULL_HANDLE) {
+			vkDestroyFence(device, ownFence, nullptr);
+			ownFence = VK_NULL_HANDLE;
+		}
+	}
+
+	uint32_t operationCount() const { return operations; }
+	uint32_t submitCount() const { return submits; }
+	uint32_t barrierCount() const { return barriers; }
+	// host time spent blocked in wait()
+	double waitMilliseconds() const { return waitTime; }
+
+  private:
+	void flushBarriers() {
+		if (imageBarriers.empty() && bufferBarriers.empty()) {
+			return;
+		}
+		vkCmdPipelineBarrier(
+			commandBuffer, srcStages, dstStages, 0, 0, nullptr,
+			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+		imageBarriers.clear();
+		bufferBarriers.clear();
+		srcStages = 0;
+		dstStages = 0;
+		barriers++;
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkFence ownFence = VK_NULL_HANDLE;
+	VkFence submittedFence = VK_NULL_HANDLE;
+
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+	VkPipelineStageFlags srcStages = 0;
+	VkPipelineStageFlags dstStages = 0;
+
+	uint32_t operations = 0;
+	uint32_t submits = 0;
+	uint32_t barriers = 0;
+	double waitTime = 0.0;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+/*
+	Compile-time vertex input layouts.
+
+	A layout is a list of VertexAttribute<location, format>, attributes are
+	packed back to back in declaration order. Stride, offsets and the Vulkan
+	binding / attribute descriptions are all derived as constant expressions,
+	so a vertex struct only has to static_assert that it matches its layout:
+
+		struct Vertex {
+			float pos[3];
+			uint16_t uv[2];
+
+			using Layout = VertexLayout<
+				VertexAttribute<0, VK_FORMAT_R32G32B32_SFLOAT>,
+				VertexAttribute<1, VK_FORMAT_R16G16_UNORM>>;
+		};
+		static_assert(Vertex::Layout::stride == sizeof(Vertex));
+*/
+
+constexpr uint32_t vertexFormatSize(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SNORM:
+	case VK_FORMAT_R8G8B8A8_UINT:
+	case VK_FORMAT_R16G16_UNORM:
+	case VK_FORMAT_R16G16_SNORM:
+	case VK_FORMAT_R16G16_UINT:
+	case VK_FORMAT_R16G16_SFLOAT:
+	case VK_FORMAT_R32_UINT:
+	case VK_FORMAT_R32_SFLOAT:
+	case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+	case VK_FORMAT_A2B10G10R10_SNORM_PACK32:
+		return 4;
+	case VK_FORMAT_R16G16B16A16_UNORM:
+	case VK_FORMAT_R16G16B16A16_SNORM:
+	case VK_FORMAT_R16G16B16A16_UINT:
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+	case VK_FORMAT_R32G32_UINT:
+	case VK_FORMAT_R32G32_SFLOAT:
+		return 8;
+	case VK_FORMAT_R32G32B32_UINT:
+	case VK_FORMAT_R32G32B32_SFLOAT:
+		return 12;
+	case VK_FORMAT_R32G32B32A32_UINT:
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+template <uint32_t Location, VkFormat Format> struct VertexAttribute {
+	static constexpr uint32_t location = Location;
+	static constexpr VkFormat format = Format;
+	static constexpr uint32_t size = vertexFormatSize(Format);
+	static_assert(size != 0, "vertex format missing from vertexFormatSize");
+};
+
+template <typename... Attributes> struct VertexLayout {
+	static constexpr uint32_t attributeCount = sizeof...(Attributes);
+	static constexpr uint32_t stride = (0 + ... + Attributes::size);
+
+	static constexpr uint32_t offset(uint32_t attribute) {
+		constexpr uint32_t sizes[] = {Attributes::size...};
+		uint32_t result = 0;
+		for (uint32_t i = 0; i < attribute; i++) {
+			result += sizes[i];
+		}
+		return result;
+	}
+
+	static constexpr VkVertexInputBindingDescription
+	bindingDescription(uint32_t binding = 0,
+					   VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX) {
+		return {binding, stride, inputRate};
+	}
+
+	static constexpr std::array<VkVertexInputAttributeDescription,
+								attributeCount>
+	attributeDescriptions(uint32_t binding = 0) {
+		constexpr uint32_t locations[] = {Attributes::location...};
+		constexpr VkFormat formats[] = {Attributes::format...};
+
+		std::array<VkVertexInputAttributeDescription, attributeCount>
+			descriptions{};
+		for (uint32_t i = 0; i < attributeCount; i++) {
+			descriptions[i].location = locations[i];
+			descriptions[i].binding = binding;
+			descriptions[i].format = formats[i];
+			descriptions[i].offset = offset(i);
+		}
+		return descriptions;
+	}
+};
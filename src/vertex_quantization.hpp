@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+/*
+	Scalar encoders for compact vertex attributes. Each one has a matching
+	decode in the vertex shader (or in the fixed function vertex fetch for
+	the UNORM / SNORM / SFLOAT formats).
+*/
+
+// [0, 1] -> VK_FORMAT_R16_UNORM
+inline uint16_t quantizeUnorm16(float value) {
+	value = std::min(std::max(value, 0.0f), 1.0f);
+	return static_cast<uint16_t>(value * 65535.0f + 0.5f);
+}
+
+// [-1, 1] -> VK_FORMAT_R16_SNORM
+inline int16_t quantizeSnorm16(float value) {
+	value = std::min(std::max(value, -1.0f), 1.0f);
+	return static_cast<int16_t>(std::lround(value * 32767.0f));
+}
+
+// round to nearest even float -> IEEE 754 binary16 (VK_FORMAT_R16_SFLOAT)
+inline uint16_t floatToHalf(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000u;
+	uint32_t exponent = (bits >> 23) & 0xffu;
+	uint32_t mantissa = bits & 0x7fffffu;
+
+	if (exponent == 0xffu) {
+		// inf stays inf, nan keeps a mantissa bit set
+		return static_cast<uint16_t>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+	}
+
+	int halfExponent = static_cast<int>(exponent) - 127 + 15;
+	if (halfExponent >= 31) {
+		return static_cast<uint16_t>(sign | 0x7c00u);
+	}
+
+	if (halfExponent <= 0) {
+		// subnormal half (or zero)
+		if (halfExponent < -10) {
+			return static_cast<uint16_t>(sign);
+		}
+		mantissa |= 0x800000u;
+		uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+			half++;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1fffu;
+	if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+		// may carry into the exponent, which correctly rounds up to inf
+		half++;
+	}
+	return static_cast<uint16_t>(sign | half);
+}
+
+// * octahedral normal encoding: project onto the octahedron |x|+|y|+|z| = 1
+// * and fold the lower hemisphere over the diagonals, two snorm16 values
+// * keep the angular error well below what 8-bit lighting can show
+inline void encodeOctahedral(const float normal[3], int16_t encoded[2]) {
+	float length =
+		std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+	if (length == 0.0f) {
+		// missing normal, decodes to +z
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+
+	float x = normal[0] / length;
+	float y = normal[1] / length;
+	if (normal[2] < 0.0f) {
+		float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	encoded[0] = quantizeSnorm16(x);
+	encoded[1] = quantizeSnorm16(y);
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/*
+	Finds the fastest workgroup size of a compute kernel on this device.
+
+	The size reaches the shader as a specialization constant
+	(local_size_x_id), so every candidate is just another pipeline built
+	from the same SPIR-V. Candidates are the powers of two from the
+	subgroup size, smaller groups leave lanes idle, up to the device limits.
+
+	tune() times WORKGROUP_TUNE_DISPATCHES back to back dispatches of each
+	candidate between two timestamp queries, WORKGROUP_TUNE_RUNS times, and
+	keeps the best run. The result is stored in a small text file, one
+	line per device, driver version and kernel:
+		<vendorID> <deviceID> <driverVersion> <kernel> <size> <microseconds>
+	so a driver update re-tunes while results for other GPUs are kept.
+*/
+
+const uint32_t WORKGROUP_TUNE_DISPATCHES = 64;
+const uint32_t WORKGROUP_TUNE_RUNS = 5;
+const uint32_t WORKGROUP_TUNE_MAX_SIZE = 1024;
+
+struct WorkgroupTuning {
+	uint32_t size = 0;
+	// GPU time of one dispatch
+	double microseconds = 0.0;
+};
+
+class WorkgroupTuner {
+  public:
+	void create(const std::string &path,
+				const VkPhysicalDeviceProperties &properties,
+				const std::string &kernel) {
+		this->path = path;
+		this->properties = properties;
+		this->kernel = kernel;
+	}
+
+	// size stored for this device, driver and kernel by an earlier run
+	bool load(uint32_t &size) const {
+		std::ifstream file(path);
+		std::string line;
+		while (std::getline(file, line)) {
+			uint32_t storedSize;
+			double microseconds;
+			if (matches(line, storedSize, microseconds)) {
+				size = storedSize;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// * replaces this device's line and keeps every other one, written to a
+	// * temporary file and renamed into place
+	bool save(const WorkgroupTuning &tuning) const {
+		std::vector<std::string> lines;
+		{
+			std::ifstream file(path);
+			std::string line;
+			while (std::getline(file, line)) {
+				uint32_t size;
+				double microseconds;
+				if (!line.empty() && !matches(line, size, microseconds)) {
+					lines.push_back(line);
+				}
+			}
+		}
+		std::ostringstream entry;
+		entry << properties.vendorID << " " << properties.deviceID << " "
+			  << properties.driverVersion << " " << kernel << " "
+			  << tuning.size << " " << tuning.microseconds;
+		lines.push_back(entry.str());
+
+		std::string tmpPath = path + ".tmp";
+		std::ofstream file(tmpPath, std::ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+		for (const std::string &line : lines) {
+			file << line << "\n";
+		}
+		file.close();
+		if (!file) {
+			std::remove(tmpPath.c_str());
+			return false;
+		}
+#ifdef _WIN32
+		// rename() does not replace an existing file on Windows
+		std::remove(path.c_str());
+#endif
+		return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+	}
+
+	// * powers of two from subgroupSize up to the device limits, empty when
+	// * the subgroup is larger than the largest workgroup
+	std::vector<uint32_t> candidates(uint32_t subgroupSize) const {
+		const VkPhysicalDeviceLimits &limits = properties.limits;
+		uint32_t maxSize =
+			std::min({limits.maxComputeWorkGroupSize[0],
+					  limits.maxComputeWorkGroupInvocations,
+					  WORKGROUP_TUNE_MAX_SIZE});
+		std::vector<uint32_t> sizes;
+		for (uint32_t size = std::max(subgroupSize, 1u); size <= maxSize;
+			 size *= 2) {
+			sizes.push_back(size);
+		}
+		return sizes;
+	}
+
+	// * build(size) returns a pipeline specialized for size, dispatch
+	// * records one run of the workload with it. Every candidate pipeline is
+	// * destroyed again, the queue must be idle and is used exclusively
+	WorkgroupTuning
+	tune(VkDevice device, VkQueue queue, VkCommandPool commandPool,
+		 uint32_t timestampValidBits, const std::vector<uint32_t> &sizes,
+		 const std::function<VkPipeline(uint32_t)> &build,
+		 const std::function<void(VkCommandBuffer, VkPipeline, uint32_t)>
+			 &dispatch) const {
+		if (timestampValidBits == 0) {
+			throw std::runtime_error("queue does not support timestamps!");
+		}
+		if (sizes.empty()) {
+			throw std::runtime_error("no workgroup sizes to tune!");
+		}
+
+		VkQueryPoolCreateInfo queryInfo{};
+		queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryInfo.queryCount = 2;
+		VkQueryPool queryPool;
+		if (vkCreateQueryPool(device, &queryInfo, nullptr, &queryPool) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create timestamp queries!");
+		}
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		VkFence fence;
+		if (vkCreateFence(device, &fenceInfo, nullptr, &fence) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to create autotune fence!");
+		}
+
+		uint64_t mask = timestampValidBits >= 64
+							? std::numeric_limits<uint64_t>::max()
+							: (uint64_t(1) << timestampValidBits) - 1;
+
+		WorkgroupTuning best;
+		for (uint32_t size : sizes) {
+			VkPipeline pipeline = build(size);
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = commandPool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = 1;
+			VkCommandBuffer commandBuffer;
+			if (vkAllocateCommandBuffers(device, &allocInfo,
+										 &commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error(
+					"failed to allocate autotune commands!");
+			}
+			record(commandBuffer, queryPool, pipeline, size, dispatch);
+
+			double bestTicks = std::numeric_limits<double>::max();
+			for (uint32_t run = 0; run < WORKGROUP_TUNE_RUNS; run++) {
+				VkSubmitInfo submitInfo{};
+				submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+				submitInfo.commandBufferCount = 1;
+				submitInfo.pCommandBuffers = &commandBuffer;
+				if (vkQueueSubmit(queue, 1, &submitInfo, fence) !=
+					VK_SUCCESS) {
+					throw std::runtime_error(
+						"failed to submit autotune commands!");
+				}
+				vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+				vkResetFences(device, 1, &fence);
+
+				uint64_t timestamps[2];
+				vkGetQueryPoolResults(
+					device, queryPool, 0, 2, sizeof(timestamps), timestamps,
+					sizeof(uint64_t),
+					VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+				uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+				bestTicks = std::min(bestTicks, static_cast<double>(ticks));
+			}
+
+			vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+			vkDestroyPipeline(device, pipeline, nullptr);
+
+			double microseconds = bestTicks *
+								  properties.limits.timestampPeriod / 1000.0 /
+								  WORKGROUP_TUNE_DISPATCHES;
+			std::cout << "    workgroup size " << size << ": " << microseconds
+					  << " us per dispatch" << std::endl;
+			if (best.size == 0 || microseconds < best.microseconds) {
+				best.size = size;
+				best.microseconds = microseconds;
+			}
+		}
+
+		vkDestroyFence(device, fence, nullptr);
+		vkDestroyQueryPool(device, queryPool, nullptr);
+		return best;
+	}
+
+  private:
+	bool matches(const std::string &line, uint32_t &size,
+				 double &microseconds) const {
+		std::istringstream stream(line);
+		uint32_t vendorID, deviceID, driverVersion;
+		std::string storedKernel;
+		if (!(stream >> vendorID >> deviceID >> driverVersion >>
+			  storedKernel >> size >> microseconds)) {
+			return false;
+		}
+		return vendorID == properties.vendorID &&
+			   deviceID == properties.deviceID &&
+			   driverVersion == properties.driverVersion &&
+			   storedKernel == kernel && size != 0;
+	}
+
+	void record(VkCommandBuffer commandBuffer, VkQueryPool queryPool,
+				VkPipeline pipeline, uint32_t size,
+				const std::function<void(VkCommandBuffer, VkPipeline,
+										 uint32_t)> &dispatch) const {
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+							queryPool, 0);
+
+		// * the dispatches touch the same buffers, as consecutive frames do
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask =
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		for (uint32_t i = 0; i < WORKGROUP_TUNE_DISPATCHES; i++) {
+			if (i != 0) {
+				vkCmdPipelineBarrier(commandBuffer,
+									 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+									 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+									 1, &barrier, 0, nullptr, 0, nullptr);
+			}
+			dispatch(commandBuffer, pipeline, size);
+		}
+
+		vkCmdWriteTimestamp(commandBuffer,
+							VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool,
+							1);
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record autotune commands!");
+		}
+	}
+
+	std::string path;
+	VkPhysicalDeviceProperties properties{};
+	std::string kernel;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/*
+	Host memory stand-ins for the Vulkan entry points DeviceAllocator and
+	StagingRing call, so their bookkeeping can be tested without a device.
+	The test executables do not link the Vulkan loader, these definitions
+	are the only ones. Include from exactly one translation unit.
+
+	The fake device has a device local heap (memory type 0) and a host
+	visible, host coherent one (memory type 1). Fences only signal through
+	signalFence() or when they are waited on, which stands in for the GPU
+	finishing the submission.
+*/
+
+struct FakeVulkan {
+	VkDeviceSize bufferImageGranularity = 1;
+	std::map<VkDeviceMemory, std::vector<char>> memories;
+	std::map<VkBuffer, VkDeviceSize> buffers;
+	std::map<VkFence, bool> fences;
+	// times each fence signaled, it may be reset and reused in between
+	std::map<VkFence, uint64_t> fenceSignals;
+	uint32_t fenceWaits = 0;
+	uint64_t nextHandle = 0;
+};
+
+inline FakeVulkan &fakeVulkan() {
+	static FakeVulkan fake;
+	return fake;
+}
+
+// C-style cast, handles are pointers on 64-bit and uint64_t elsewhere
+template <typename Handle> Handle fakeHandle() {
+	return (Handle)(uintptr_t)++fakeVulkan().nextHandle;
+}
+
+inline void signalFence(VkFence fence) {
+	if (!fakeVulkan().fences[fence]) {
+		fakeVulkan().fences[fence] = true;
+		fakeVulkan().fenceSignals[fence]++;
+	}
+}
+
+inline bool fenceSignaled(VkFence fence) { return fakeVulkan().fences[fence]; }
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(
+	VkPhysicalDevice, VkPhysicalDeviceMemoryProperties *properties) {
+	*properties = VkPhysicalDeviceMemoryProperties{};
+	properties->memoryTypeCount = 2;
+	properties->memoryTypes[0].propertyFlags =
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	properties->memoryTypes[0].heapIndex = 0;
+	properties->memoryTypes[1].propertyFlags =
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	properties->memoryTypes[1].heapIndex = 1;
+	properties->memoryHeapCount = 2;
+	properties->memoryHeaps[0].size = VkDeviceSize(4) << 30;
+	properties->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+	properties->memoryHeaps[1].size = VkDeviceSize(1) << 30;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(
+	VkPhysicalDevice, VkPhysicalDeviceProperties *properties) {
+	*properties = VkPhysicalDeviceProperties{};
+	properties->limits.bufferImageGranularity =
+		fakeVulkan().bufferImageGranularity;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo *info,
+				 const VkAllocationCallbacks *, VkDeviceMemory *memory) {
+	*memory = fakeHandle<VkDeviceMemory>();
+	fakeVulkan().memories[*memory].resize(info->allocationSize);
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory,
+										const VkAllocationCallbacks *) {
+	fakeVulkan().memories.erase(memory);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory,
+										   VkDeviceSize offset, VkDeviceSize,
+										   VkMemoryMapFlags, void **data) {
+	*data = fakeVulkan().memories[memory].data() + offset;
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkUnmapMemory(VkDevice, VkDeviceMemory) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+vkCreateBuffer(VkDevice, const VkBufferCreateInfo *info,
+			   const VkAllocationCallbacks *, VkBuffer *buffer) {
+	*buffer = fakeHandle<VkBuffer>();
+	fakeVulkan().buffers[*buffer] = info->size;
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer buffer,
+										   const VkAllocationCallbacks *) {
+	fakeVulkan().buffers.erase(buffer);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(
+	VkDevice, VkBuffer buffer, VkMemoryRequirements *requirements) {
+	requirements->size = fakeVulkan().buffers[buffer];
+	requirements->alignment = 256;
+	requirements->memoryTypeBits = 0x3;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer,
+												  VkDeviceMemory,
+												  VkDeviceSize) {
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateFence(VkDevice,
+											 const VkFenceCreateInfo *info,
+											 const VkAllocationCallbacks *,
+											 VkFence *fence) {
+	*fence = fakeHandle<VkFence>();
+	fakeVulkan().fences[*fence] =
+		(info->flags & VK_FENCE_CREATE_SIGNALED_BIT) != 0;
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyFence(VkDevice, VkFence fence,
+										  const VkAllocationCallbacks *) {
+	fakeVulkan().fences.erase(fence);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkGetFenceStatus(VkDevice, VkFence fence) {
+	return fakeVulkan().fences[fence] ? VK_SUCCESS : VK_NOT_READY;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetFences(VkDevice, uint32_t count,
+											 const VkFence *fences) {
+	for (uint32_t i = 0; i < count; i++) {
+		fakeVulkan().fences[fences[i]] = false;
+	}
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkWaitForFences(VkDevice, uint32_t count,
+											   const VkFence *fences,
+											   VkBool32, uint64_t) {
+	fakeVulkan().fenceWaits++;
+	for (uint32_t i = 0; i < count; i++) {
+		signalFence(fences[i]);
+	}
+	return VK_SUCCESS;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+/*
+	Minimal checks for the tests in this directory, one executable per
+	tests/test_*.cpp registered with CTest.
+
+	CHECK reports the failed condition with its location and keeps going so
+	a run lists every failure, main() returns testResult() which is non-zero
+	once any check failed.
+*/
+
+inline int &testFailures() {
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition)                                                       \
+	do {                                                                       \
+		if (!(condition)) {                                                    \
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__,        \
+						 __LINE__, #condition);                                \
+			testFailures()++;                                                  \
+		}                                                                      \
+	} while (0)
+
+#define CHECK_NEAR(a, b, tolerance) CHECK(std::fabs((a) - (b)) <= (tolerance))
+
+inline int testResult() {
+	if (testFailures() != 0) {
+		std::fprintf(stderr, "%d check(s) failed\n", testFailures());
+		return 1;
+	}
+	return 0;
+}
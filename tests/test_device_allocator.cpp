@@ -0,0 +1,197 @@
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "device_allocator.hpp"
+#include "fake_vulkan.hpp"
+#include "test.hpp"
+
+struct Range {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+};
+
+static bool overlaps(const Range &a, const Range &b) {
+	return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+static void testBitScans() {
+	for (uint32_t bit = 0; bit < 64; bit++) {
+		uint64_t value = uint64_t(1) << bit;
+		CHECK(lowestSetBit(value) == bit);
+		CHECK(highestSetBit(value) == bit);
+		CHECK(lowestSetBit(value | (value << 1)) == bit);
+		CHECK(highestSetBit(value | 1) == bit);
+	}
+}
+
+// * random allocations and frees: live ranges never overlap, respect their
+// * alignment and stay inside the heap, and once everything is freed the
+// * neighbours have merged back into a single chunk
+static void testTlsf() {
+	const VkDeviceSize heapSize = 1 << 20;
+	TlsfHeap heap;
+	heap.init(heapSize);
+
+	std::mt19937 random(19);
+	std::uniform_int_distribution<VkDeviceSize> size(1, 16384);
+	std::uniform_int_distribution<int> alignmentShift(0, 8);
+	std::map<uint32_t, Range> live;
+	size_t overlapping = 0, misplaced = 0, failures = 0;
+	for (int i = 0; i < 50000; i++) {
+		if (!live.empty() && (random() % 2 == 0 || live.size() > 48)) {
+			auto victim = live.begin();
+			std::advance(victim, random() % live.size());
+			heap.free(victim->first);
+			live.erase(victim);
+			continue;
+		}
+		VkDeviceSize bytes = size(random);
+		VkDeviceSize alignment = VkDeviceSize(1) << alignmentShift(random);
+		VkDeviceSize offset = 0;
+		uint32_t chunk = heap.allocate(bytes, alignment, offset);
+		if (chunk == TlsfHeap::NONE) {
+			failures++;
+			continue;
+		}
+		Range range = {offset, bytes};
+		misplaced += offset % alignment != 0 || offset + bytes > heapSize ||
+					 heap.chunkSize(chunk) < bytes;
+		for (const auto &other : live) {
+			overlapping += overlaps(range, other.second);
+		}
+		CHECK(live.count(chunk) == 0);
+		live[chunk] = range;
+	}
+	CHECK(overlapping == 0);
+	CHECK(misplaced == 0);
+	// * at most 49 live allocations of up to 16 KiB plus alignment, a
+	// * quarter of the heap even with the size class rounding
+	CHECK(failures == 0);
+
+	for (const auto &allocation : live) {
+		heap.free(allocation.first);
+	}
+	VkDeviceSize offset = 1;
+	uint32_t whole = heap.allocate(heapSize, 1, offset);
+	CHECK(whole != TlsfHeap::NONE);
+	CHECK(offset == 0);
+	CHECK(heap.allocate(1, 1, offset) == TlsfHeap::NONE);
+}
+
+static VkMemoryRequirements requirements(VkDeviceSize size,
+										 VkDeviceSize alignment) {
+	VkMemoryRequirements memRequirements{};
+	memRequirements.size = size;
+	memRequirements.alignment = alignment;
+	memRequirements.memoryTypeBits = 0x3;
+	return memRequirements;
+}
+
+// * small resources share a handful of blocks, mapped pointers follow the
+// * offsets, and the accounting drops back to zero once all are freed
+static void testAllocator(VkDevice device, VkPhysicalDevice physicalDevice) {
+	const VkDeviceSize blockSize = 1 << 20;
+	DeviceAllocator allocator;
+	allocator.create(device, physicalDevice, blockSize);
+
+	std::vector<DeviceAllocation> allocations;
+	for (int i = 0; i < 300; i++) {
+		allocations.push_back(allocator.allocate(
+			requirements(1000 + 37 * i, 256),
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, DeviceResourceKind::Buffer,
+			DeviceMemoryCategory::UniformBuffer));
+	}
+	CHECK(allocator.deviceAllocationCount() < 10);
+
+	size_t wrong = 0;
+	for (size_t a = 0; a < allocations.size(); a++) {
+		const DeviceAllocation &allocation = allocations[a];
+		wrong += allocation.offset % 256 != 0 || allocation.mapped == nullptr ||
+				 allocation.mapped !=
+					 fakeVulkan().memories[allocation.memory].data() +
+						 allocation.offset;
+		for (size_t b = 0; b < a; b++) {
+			wrong += allocation.memory == allocations[b].memory &&
+					 overlaps({allocation.offset, allocation.size},
+							  {allocations[b].offset, allocations[b].size});
+		}
+	}
+	CHECK(wrong == 0);
+
+	const DeviceHeapStats &host = allocator.stats()[1];
+	CHECK(host.allocationCount == 300);
+	CHECK(host.categoryCount[size_t(DeviceMemoryCategory::UniformBuffer)] ==
+		  300);
+	CHECK(allocator.stats()[0].allocationCount == 0);
+
+	// half a block or more gets its own memory
+	DeviceAllocation large = allocator.allocate(
+		requirements(blockSize / 2, 256), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		DeviceResourceKind::Buffer, DeviceMemoryCategory::VertexBuffer);
+	CHECK(large.offset == 0);
+	CHECK(large.mapped == nullptr);
+	CHECK(allocator.stats()[0].dedicatedCount == 1);
+
+	// linear blocks bump an offset
+	DeviceAllocation first = allocator.allocate(
+		requirements(100, 64), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		DeviceResourceKind::Buffer, DeviceMemoryCategory::IndexBuffer,
+		DeviceAllocationStrategy::Linear);
+	DeviceAllocation second = allocator.allocate(
+		requirements(100, 64), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		DeviceResourceKind::Buffer, DeviceMemoryCategory::IndexBuffer,
+		DeviceAllocationStrategy::Linear);
+	CHECK(first.memory == second.memory);
+	CHECK(first.offset == 0 && second.offset == 128);
+
+	allocator.free(large);
+	CHECK(large.block == nullptr);
+	allocator.free(first);
+	allocator.free(second);
+	for (DeviceAllocation &allocation : allocations) {
+		allocator.free(allocation);
+	}
+	std::ostringstream leaks;
+	CHECK(allocator.reportLeaks(leaks) == 0);
+	for (const DeviceHeapStats &stats : allocator.stats()) {
+		CHECK(stats.allocationCount == 0 && stats.allocationBytes == 0);
+		CHECK(stats.dedicatedCount == 0);
+	}
+
+	allocator.destroy();
+	CHECK(fakeVulkan().memories.empty());
+}
+
+// with a bufferImageGranularity above 1, buffers and images never share
+// a block
+static void testImageGranularity(VkDevice device,
+								 VkPhysicalDevice physicalDevice) {
+	fakeVulkan().bufferImageGranularity = 1024;
+	DeviceAllocator allocator;
+	allocator.create(device, physicalDevice, 1 << 20);
+	DeviceAllocation buffer = allocator.allocate(
+		requirements(4096, 256), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		DeviceResourceKind::Buffer, DeviceMemoryCategory::StorageBuffer);
+	DeviceAllocation image = allocator.allocate(
+		requirements(4096, 256), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		DeviceResourceKind::Image, DeviceMemoryCategory::Texture);
+	CHECK(buffer.memory != image.memory);
+	allocator.free(buffer);
+	allocator.free(image);
+	allocator.destroy();
+	fakeVulkan().bufferImageGranularity = 1;
+}
+
+int main() {
+	VkDevice device = fakeHandle<VkDevice>();
+	VkPhysicalDevice physicalDevice = fakeHandle<VkPhysicalDevice>();
+	testBitScans();
+	testTlsf();
+	testAllocator(device, physicalDevice);
+	testImageGranularity(device, physicalDevice);
+	return testResult();
+}
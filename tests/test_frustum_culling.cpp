@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "frustum_culling.hpp"
+#include "job_system.hpp"
+#include "meshlet.hpp"
+#include "test.hpp"
+
+// * spheres touching a plane within float precision may go either way
+// * once the SIMD path uses fused multiply-adds (see frustum_culling.hpp)
+static bool nearPlane(const BoundingSpheres &spheres, size_t i,
+					  const float planes[6][4]) {
+	for (int p = 0; p < 6; p++) {
+		double distance = double(planes[p][0]) * spheres.x[i] +
+						  double(planes[p][1]) * spheres.y[i] +
+						  double(planes[p][2]) * spheres.z[i] + planes[p][3];
+		if (std::fabs(distance + spheres.radius[i]) < 1e-3) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static BoundingSpheres randomSpheres(size_t count, float extent,
+									 uint32_t seed) {
+	BoundingSpheres spheres;
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> position(-extent, extent);
+	std::uniform_real_distribution<float> radius(0.01f * extent,
+												 0.05f * extent);
+	for (size_t i = 0; i < count; i++) {
+		float center[3] = {position(random), position(random),
+						   position(random)};
+		spheres.push_back(center, radius(random));
+	}
+	return spheres;
+}
+
+// column-major projection * view looking down -z from (0, 0, 10)
+static void frustum(float planes[6][4]) {
+	float m[16] = {};
+	float f = 1.0f / std::tan(0.6f);
+	float zNear = 0.5f, zFar = 40.0f;
+	m[0] = f / 1.5f;
+	m[5] = -f;
+	m[10] = zFar / (zNear - zFar);
+	m[11] = -1.0f;
+	m[14] = zNear * zFar / (zNear - zFar) + m[10] * -10.0f;
+	m[15] = 10.0f;
+	extractFrustumPlanes(m, planes);
+}
+
+// * the SIMD path, its scalar tail and the scalar reference agree on every
+// * sphere, over ranges that start and end off the register width
+static void testSimdMatchesScalar() {
+	float planes[6][4];
+	frustum(planes);
+	BoundingSpheres spheres = randomSpheres(10007, 20.0f, 23);
+
+	const size_t ranges[][2] = {{0, 10007}, {3, 10007}, {0, 7}, {5, 22},
+								{13, 13},	{4096, 6001}};
+	for (const auto &range : ranges) {
+		size_t first = range[0], end = range[1];
+		std::vector<uint8_t> scalar(spheres.size(), 2);
+		std::vector<uint8_t> simd(spheres.size(), 2);
+		uint32_t scalarCount =
+			cullSpheresScalar(spheres, planes, first, end, scalar.data());
+		uint32_t simdCount =
+			cullSpheres(spheres, planes, first, end, simd.data());
+
+		size_t mismatches = 0, boundary = 0, untouched = 0;
+		for (size_t i = 0; i < spheres.size(); i++) {
+			if (i < first || i >= end) {
+				untouched += simd[i] == 2;
+				continue;
+			}
+			if (simd[i] != scalar[i]) {
+				if (nearPlane(spheres, i, planes)) {
+					boundary++;
+				} else {
+					mismatches++;
+				}
+			}
+			// the per-sphere test of the meshlet culling is the same test
+			float center[3] = {spheres.x[i], spheres.y[i], spheres.z[i]};
+			mismatches += !nearPlane(spheres, i, planes) &&
+						  sphereInFrustum(center, spheres.radius[i], planes) !=
+							  (scalar[i] == 1);
+		}
+		CHECK(mismatches == 0);
+		CHECK(untouched == spheres.size() - (end - first));
+		CHECK(uint64_t(simdCount) + boundary >= scalarCount &&
+			  simdCount <= uint64_t(scalarCount) + boundary);
+	}
+
+	// something on both sides, or the comparison says little
+	std::vector<uint8_t> visible(spheres.size());
+	uint32_t count =
+		cullSpheresScalar(spheres, planes, 0, spheres.size(), visible.data());
+	CHECK(count > spheres.size() / 20 && count < spheres.size() / 2);
+}
+
+// splitting over the workers gives the same answer as one call
+static void testParallel() {
+	float planes[6][4];
+	frustum(planes);
+	BoundingSpheres spheres = randomSpheres(100003, 20.0f, 29);
+	JobSystem jobs(4);
+
+	std::vector<uint8_t> single(spheres.size());
+	std::vector<uint8_t> parallel(spheres.size());
+	uint32_t singleCount =
+		cullSpheres(spheres, planes, 0, spheres.size(), single.data());
+	uint32_t parallelCount = cullSpheresParallel(jobs, spheres, planes,
+												 parallel.data(), 1000);
+	CHECK(parallelCount == singleCount);
+	CHECK(parallel == single);
+}
+
+int main() {
+	testSimdMatchesScalar();
+	testParallel();
+	return testResult();
+}
@@ -0,0 +1,93 @@
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include "job_system.hpp"
+#include "test.hpp"
+
+// every index runs exactly once, on the caller or a worker
+static void testParallelFor(JobSystem &jobs) {
+	const size_t count = 100000;
+	std::vector<std::atomic<int>> runs(count);
+	for (auto &run : runs) {
+		run = 0;
+	}
+	std::mutex mutex;
+	std::set<unsigned> threads;
+	jobs.parallelFor(count, [&](size_t i) {
+		runs[i]++;
+		unsigned thread = JobSystem::threadIndex();
+		std::lock_guard<std::mutex> lock(mutex);
+		threads.insert(thread);
+	});
+	size_t wrong = 0;
+	for (auto &run : runs) {
+		wrong += run != 1;
+	}
+	CHECK(wrong == 0);
+	for (unsigned thread : threads) {
+		CHECK(thread < jobs.threadCount());
+	}
+
+	// nested inside a job, the worker ends up doing the work itself
+	std::atomic<size_t> nested{0};
+	jobs.parallelFor(8, [&](size_t) {
+		jobs.parallelFor(100, [&](size_t) { nested++; });
+	});
+	CHECK(nested == 800);
+
+	jobs.parallelFor(0, [&](size_t) { CHECK(false); });
+}
+
+static void testSubmit(JobSystem &jobs) {
+	std::vector<std::future<size_t>> futures;
+	for (size_t i = 0; i < 64; i++) {
+		futures.push_back(jobs.submit([i]() { return i * i; }));
+	}
+	for (size_t i = 0; i < futures.size(); i++) {
+		CHECK(futures[i].get() == i * i);
+	}
+
+	std::future<unsigned> worker =
+		jobs.submit([]() { return JobSystem::threadIndex(); });
+	unsigned index = worker.get();
+	CHECK(index >= 1 && index < jobs.threadCount());
+	CHECK(JobSystem::threadIndex() == 0);
+}
+
+// exceptions from jobs resurface on the thread waiting for them
+static void testExceptions(JobSystem &jobs) {
+	bool threw = false;
+	try {
+		jobs.parallelFor(1000, [](size_t i) {
+			if (i == 637) {
+				throw std::runtime_error("job failed");
+			}
+		});
+	} catch (const std::runtime_error &) {
+		threw = true;
+	}
+	CHECK(threw);
+
+	std::future<int> failed =
+		jobs.submit([]() -> int { throw std::runtime_error("job failed"); });
+	threw = false;
+	try {
+		failed.get();
+	} catch (const std::runtime_error &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+int main() {
+	JobSystem jobs(4);
+	CHECK(jobs.threadCount() == 4);
+	testParallelFor(jobs);
+	testSubmit(jobs);
+	testExceptions(jobs);
+	return testResult();
+}
@@ -0,0 +1,65 @@
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "mesh_builder.hpp"
+#include "test.hpp"
+
+struct TestVertex {
+	float position[3];
+	float texCoord[2];
+};
+
+// the indexed mesh has to expand back to exactly the vertex stream it was
+// built from, with every unique vertex stored once
+static void testRoundTrip() {
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> pick(0, 299);
+	std::vector<TestVertex> stream;
+	for (int i = 0; i < 3000; i++) {
+		int id = pick(random);
+		stream.push_back({{float(id), float(id % 7), 0.5f}, {0.25f, 0.0f}});
+	}
+
+	// a small initial capacity makes the table grow while building
+	MeshBuilder<TestVertex> builder(4);
+	for (const TestVertex &vertex : stream) {
+		builder.addVertex(vertex);
+	}
+
+	CHECK(builder.indices.size() == stream.size());
+	CHECK(builder.vertices.size() <= 300);
+	for (size_t i = 0; i < stream.size(); i++) {
+		const TestVertex &vertex = builder.vertices[builder.indices[i]];
+		CHECK(std::memcmp(&vertex, &stream[i], sizeof(TestVertex)) == 0);
+	}
+	for (size_t a = 0; a < builder.vertices.size(); a++) {
+		for (size_t b = a + 1; b < builder.vertices.size(); b++) {
+			CHECK(std::memcmp(&builder.vertices[a], &builder.vertices[b],
+							  sizeof(TestVertex)) != 0);
+		}
+	}
+}
+
+static void testUint16() {
+	MeshBuilder<TestVertex> builder(70000);
+	for (int i = 0; i < 65536; i++) {
+		builder.addVertex({{float(i), 0.0f, 0.0f}, {0.0f, 0.0f}});
+	}
+	CHECK(builder.fitsUint16());
+	builder.addVertex({{-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}});
+	CHECK(!builder.fitsUint16());
+
+	std::vector<uint16_t> packed(65536);
+	packIndicesUint16(builder.indices.data(), packed.size(), packed.data());
+	for (size_t i = 0; i < packed.size(); i++) {
+		CHECK(packed[i] == builder.indices[i]);
+	}
+}
+
+int main() {
+	testRoundTrip();
+	testUint16();
+	return testResult();
+}
@@ -0,0 +1,144 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "mesh_cache.hpp"
+#include "test.hpp"
+
+// written to the working directory, i.e. the build directory under ctest
+const char *SOURCE_PATH = "test_mesh_cache.obj";
+const char *CACHE_PATH = "test_mesh_cache.bin";
+const uint32_t FORMAT_VERSION = 3;
+
+static void writeSource(const std::string &contents) {
+	std::ofstream file(SOURCE_PATH, std::ios::binary | std::ios::trunc);
+	file << contents;
+}
+
+// sections come back byte for byte, aligned, from a cache that matches
+// its source and format
+static void testRoundTrip() {
+	writeSource("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n");
+	MeshSourceInfo source;
+	CHECK(queryMeshSource(SOURCE_PATH, source));
+
+	std::vector<float> vertices = {0, 0, 0, 1, 0, 0, 0, 1, 0};
+	std::vector<uint32_t> indices = {0, 1, 2};
+	// odd size, the next section still has to start aligned
+	const char note[] = "abc";
+
+	MeshCacheWriter writer;
+	writer.addSection(MESH_SECTION_VERTICES, vertices.data(),
+					  vertices.size() * sizeof(float));
+	writer.addSection(meshCacheTag('N', 'O', 'T', 'E'), note, sizeof(note));
+	writer.addSection(MESH_SECTION_INDICES, indices.data(),
+					  indices.size() * sizeof(uint32_t));
+
+	MeshCacheHeader header{};
+	header.formatVersion = FORMAT_VERSION;
+	header.sourceSize = source.size;
+	header.sourceMtime = source.mtime;
+	header.sourceHash = source.hash;
+	header.vertexStride = 3 * sizeof(float);
+	header.vertexCount = 3;
+	header.indexCount = 3;
+	header.indexSize = sizeof(uint32_t);
+	CHECK(writer.write(CACHE_PATH, header));
+
+	MeshCache cache;
+	CHECK(cache.open(CACHE_PATH, source, FORMAT_VERSION));
+	CHECK(cache.isOpen());
+	if (cache.isOpen()) {
+		CHECK(cache.header().sectionCount == 3);
+		CHECK(cache.header().vertexCount == 3);
+		CHECK(cache.header().indexCount == 3);
+
+		uint64_t size = 0;
+		const void *bytes = cache.section(MESH_SECTION_VERTICES, &size);
+		CHECK(size == vertices.size() * sizeof(float));
+		CHECK(bytes != nullptr &&
+			  std::memcmp(bytes, vertices.data(), size) == 0);
+
+		bytes = cache.section(meshCacheTag('N', 'O', 'T', 'E'), &size);
+		CHECK(size == sizeof(note));
+		CHECK(bytes != nullptr && std::memcmp(bytes, note, size) == 0);
+
+		bytes = cache.section(MESH_SECTION_INDICES, &size);
+		CHECK(size == indices.size() * sizeof(uint32_t));
+		CHECK(reinterpret_cast<uintptr_t>(bytes) % MESH_CACHE_ALIGNMENT == 0);
+		CHECK(bytes != nullptr &&
+			  std::memcmp(bytes, indices.data(), size) == 0);
+
+		CHECK(cache.section(MESH_SECTION_LODS) == nullptr);
+	}
+	cache.close();
+	CHECK(!cache.isOpen());
+
+	// another processing version or an edited source reject the cache
+	CHECK(!cache.open(CACHE_PATH, source, FORMAT_VERSION + 1));
+	MeshSourceInfo edited = source;
+	edited.hash ^= 1;
+	CHECK(!cache.open(CACHE_PATH, edited, FORMAT_VERSION));
+	edited = source;
+	edited.size++;
+	CHECK(!cache.open(CACHE_PATH, edited, FORMAT_VERSION));
+	CHECK(!cache.open("test_mesh_cache_missing.bin", source, FORMAT_VERSION));
+}
+
+// a cache cut short must not hand out sections past the end of the file
+static void testTruncated() {
+	MeshSourceInfo source;
+	CHECK(queryMeshSource(SOURCE_PATH, source));
+
+	std::vector<uint8_t> blob(4096, 7);
+	MeshCacheWriter writer;
+	writer.addSection(MESH_SECTION_VERTICES, blob.data(), blob.size());
+	MeshCacheHeader header{};
+	header.formatVersion = FORMAT_VERSION;
+	header.sourceSize = source.size;
+	header.sourceMtime = source.mtime;
+	header.sourceHash = source.hash;
+	CHECK(writer.write(CACHE_PATH, header));
+
+	std::ifstream in(CACHE_PATH, std::ios::binary);
+	std::vector<char> bytes((std::istreambuf_iterator<char>(in)),
+							std::istreambuf_iterator<char>());
+	in.close();
+	std::ofstream out(CACHE_PATH, std::ios::binary | std::ios::trunc);
+	out.write(bytes.data(), bytes.size() - 1);
+	out.close();
+
+	MeshCache cache;
+	CHECK(!cache.open(CACHE_PATH, source, FORMAT_VERSION));
+}
+
+static void testSectionLimit() {
+	MeshCacheWriter writer;
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < MESH_CACHE_MAX_SECTIONS; i++) {
+		writer.addSection(meshCacheTag('S', 'E', 'C', char('A' + i)), &value,
+						  sizeof(value));
+	}
+	bool threw = false;
+	try {
+		writer.addSection(meshCacheTag('L', 'A', 'S', 'T'), &value,
+						  sizeof(value));
+	} catch (const std::runtime_error &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+int main() {
+	testRoundTrip();
+	testTruncated();
+	testSectionLimit();
+	std::remove(SOURCE_PATH);
+	std::remove(CACHE_PATH);
+	return testResult();
+}
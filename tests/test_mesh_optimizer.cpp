@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "mesh_optimizer.hpp"
+#include "test.hpp"
+#include "test_meshes.hpp"
+
+typedef std::array<uint32_t, 3> Triangle;
+
+// triangles in a canonical order, each keeping its winding
+static std::vector<Triangle> sortedTriangles(const std::vector<uint32_t> &in) {
+	std::vector<Triangle> triangles;
+	for (size_t i = 0; i + 2 < in.size(); i += 3) {
+		triangles.push_back({in[i], in[i + 1], in[i + 2]});
+	}
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+static void shuffleTriangles(std::vector<uint32_t> &indices) {
+	std::vector<Triangle> triangles;
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		triangles.push_back({indices[i], indices[i + 1], indices[i + 2]});
+	}
+	std::mt19937 random(5);
+	std::shuffle(triangles.begin(), triangles.end(), random);
+	for (size_t t = 0; t < triangles.size(); t++) {
+		std::copy(triangles[t].begin(), triangles[t].end(),
+				  indices.begin() + 3 * t);
+	}
+}
+
+static void testAnalyze() {
+	// a single triangle misses every vertex once
+	std::vector<uint32_t> indices = {0, 1, 2, 0, 1, 2};
+	VertexCacheStats stats = analyzeVertexCache(indices.data(), 6, 3);
+	CHECK_NEAR(stats.acmr, 1.5, 1e-9);
+	CHECK_NEAR(stats.atvr, 1.0, 1e-9);
+
+	// a cache of one entry misses on every vertex change
+	stats = analyzeVertexCache(indices.data(), 6, 3, 1);
+	CHECK_NEAR(stats.acmr, 3.0, 1e-9);
+	CHECK_NEAR(stats.atvr, 2.0, 1e-9);
+}
+
+// Tipsify keeps the triangles and their winding and beats a random order
+static void testVertexCache() {
+	TestMesh grid = makeGrid(64);
+	shuffleTriangles(grid.indices);
+	std::vector<uint32_t> original = grid.indices;
+	double before = analyzeVertexCache(grid.indices.data(),
+									   grid.indices.size(), grid.vertexCount())
+						.acmr;
+
+	std::vector<uint32_t> clusterStarts;
+	optimizeVertexCache(grid.indices.data(), grid.indices.size(),
+						grid.vertexCount(), VERTEX_CACHE_SIZE, &clusterStarts);
+	CHECK(sortedTriangles(grid.indices) == sortedTriangles(original));
+
+	double after = analyzeVertexCache(grid.indices.data(), grid.indices.size(),
+									  grid.vertexCount())
+					   .acmr;
+	CHECK(after < before * 0.5);
+	CHECK(after < 1.0);
+
+	CHECK(!clusterStarts.empty());
+	CHECK(clusterStarts.empty() || clusterStarts[0] == 0);
+	CHECK(std::is_sorted(clusterStarts.begin(), clusterStarts.end()));
+	CHECK(clusterStarts.empty() ||
+		  clusterStarts.back() < grid.indices.size() / 3);
+
+	// * reordering the clusters keeps the triangles too, and the cache
+	// * efficiency within the threshold
+	TestMesh sphere = makeSphere(32, 48, 1.0f);
+	original = sphere.indices;
+	optimizeVertexCache(sphere.indices.data(), sphere.indices.size(),
+						sphere.vertexCount(), VERTEX_CACHE_SIZE,
+						&clusterStarts);
+	double tipsify =
+		analyzeVertexCache(sphere.indices.data(), sphere.indices.size(),
+						   sphere.vertexCount())
+			.acmr;
+	optimizeOverdraw(sphere.indices.data(), sphere.indices.size(),
+					 sphere.positions.data(), 3 * sizeof(float),
+					 sphere.vertexCount(), clusterStarts, 1.05f);
+	CHECK(sortedTriangles(sphere.indices) == sortedTriangles(original));
+	double overdraw =
+		analyzeVertexCache(sphere.indices.data(), sphere.indices.size(),
+						   sphere.vertexCount())
+			.acmr;
+	CHECK(overdraw <= tipsify * 1.05 + 1e-9);
+}
+
+// the vertex stream seen through the indices stays the same, only the
+// storage order changes to first use and unreferenced vertices go away
+static void testVertexFetch() {
+	TestMesh grid = makeGrid(16);
+	shuffleTriangles(grid.indices);
+	struct Vertex {
+		float position[3];
+	};
+	std::vector<Vertex> vertices(grid.vertexCount());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		std::copy(&grid.positions[3 * v], &grid.positions[3 * v + 3],
+				  vertices[v].position);
+	}
+	// never referenced
+	vertices.push_back({{-1.0f, -1.0f, -1.0f}});
+	std::vector<Vertex> original = vertices;
+	std::vector<uint32_t> originalIndices = grid.indices;
+
+	size_t count = optimizeVertexFetch(vertices, grid.indices.data(),
+									   grid.indices.size());
+	CHECK(count == grid.vertexCount());
+	CHECK(vertices.size() == count);
+
+	uint32_t next = 0;
+	size_t mismatches = 0;
+	for (size_t i = 0; i < grid.indices.size(); i++) {
+		const Vertex &a = vertices[grid.indices[i]];
+		const Vertex &b = original[originalIndices[i]];
+		mismatches += !std::equal(a.position, a.position + 3, b.position);
+		// first use order: every index is at most one past the highest yet
+		CHECK(grid.indices[i] <= next);
+		next = std::max(next, grid.indices[i] + 1);
+	}
+	CHECK(mismatches == 0);
+}
+
+int main() {
+	testAnalyze();
+	testVertexCache();
+	testVertexFetch();
+	return testResult();
+}
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "mesh_simplifier.hpp"
+#include "test.hpp"
+#include "test_meshes.hpp"
+
+const size_t STRIDE = 3 * sizeof(float);
+
+// indices in range and no triangle collapsed to a line or a point
+static bool wellFormed(const std::vector<uint32_t> &indices,
+					   size_t vertexCount) {
+	if (indices.size() % 3 != 0) {
+		return false;
+	}
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+		if (a >= vertexCount || b >= vertexCount || c >= vertexCount ||
+			a == b || b == c || a == c) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void testSphere() {
+	TestMesh sphere = makeSphere(32, 48, 1.0f);
+	size_t target = sphere.indices.size() / 4 / 3 * 3;
+	float error = -1.0f;
+	std::vector<uint32_t> result = simplifyMesh(
+		sphere.indices.data(), sphere.indices.size(), sphere.positions.data(),
+		STRIDE, sphere.vertexCount(), target, std::numeric_limits<float>::max(),
+		nullptr, 0, 0, nullptr, &error);
+
+	CHECK(wellFormed(result, sphere.vertexCount()));
+	CHECK(result.size() <= target);
+	CHECK(result.size() >= target / 2);
+	CHECK(error > 0.0f && error < 0.1f);
+
+	// * a closed surface stays closed: every edge is shared by exactly two
+	// * triangles, in opposite directions
+	std::multiset<std::pair<uint32_t, uint32_t>> edges;
+	for (size_t i = 0; i < result.size(); i += 3) {
+		for (int k = 0; k < 3; k++) {
+			edges.insert({result[i + k], result[i + (k + 1) % 3]});
+		}
+	}
+	size_t unmatched = 0;
+	for (const auto &edge : edges) {
+		unmatched += edges.count(edge) != 1 ||
+					 edges.count({edge.second, edge.first}) != 1;
+	}
+	CHECK(unmatched == 0);
+
+	// no collapse may exceed maxError
+	float limit = error / 4.0f;
+	std::vector<uint32_t> bounded = simplifyMesh(
+		sphere.indices.data(), sphere.indices.size(), sphere.positions.data(),
+		STRIDE, sphere.vertexCount(), target, limit, nullptr, 0, 0, nullptr,
+		&error);
+	CHECK(wellFormed(bounded, sphere.vertexCount()));
+	CHECK(error <= limit);
+	CHECK(bounded.size() > result.size());
+}
+
+// a flat grid simplifies without error, but its open border is locked
+static void testBorder() {
+	const uint32_t size = 24;
+	TestMesh grid = makeGrid(size);
+	float error = -1.0f;
+	std::vector<uint32_t> result = simplifyMesh(
+		grid.indices.data(), grid.indices.size(), grid.positions.data(),
+		STRIDE, grid.vertexCount(), 0, std::numeric_limits<float>::max(),
+		nullptr, 0, 0, nullptr, &error);
+
+	CHECK(wellFormed(result, grid.vertexCount()));
+	CHECK(result.size() < grid.indices.size() / 4);
+	CHECK(error < 1e-4f);
+
+	std::set<uint32_t> used(result.begin(), result.end());
+	size_t missing = 0;
+	for (uint32_t y = 0; y <= size; y++) {
+		for (uint32_t x = 0; x <= size; x++) {
+			if (x == 0 || y == 0 || x == size || y == size) {
+				missing += used.count(y * (size + 1) + x) == 0;
+			}
+		}
+	}
+	CHECK(missing == 0);
+}
+
+// * LOD 0 is the input, every further level is a contiguous, smaller range
+// * appended to the buffer with a growing error
+static void testLodChain() {
+	TestMesh sphere = makeSphere(48, 64, 1.0f);
+	std::vector<uint32_t> indices = sphere.indices;
+	std::vector<MeshLod> lods =
+		buildLodChain(indices, sphere.positions.data(), STRIDE,
+					  sphere.vertexCount());
+
+	CHECK(lods.size() > 2);
+	CHECK(lods.size() <= MESH_LOD_MAX_COUNT);
+	CHECK(std::equal(sphere.indices.begin(), sphere.indices.end(),
+					 indices.begin()));
+	uint32_t offset = 0;
+	for (size_t l = 0; l < lods.size(); l++) {
+		CHECK(lods[l].indexOffset == offset);
+		offset += lods[l].indexCount;
+		std::vector<uint32_t> level(indices.begin() + lods[l].indexOffset,
+									indices.begin() + lods[l].indexOffset +
+										lods[l].indexCount);
+		CHECK(wellFormed(level, sphere.vertexCount()));
+		if (l > 0) {
+			CHECK(lods[l].indexCount < lods[l - 1].indexCount);
+			CHECK(lods[l].error >= lods[l - 1].error);
+		}
+	}
+	CHECK(offset == indices.size());
+	CHECK(lods[0].error == 0.0f);
+}
+
+int main() {
+	testSphere();
+	testBorder();
+	testLodChain();
+	return testResult();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/*
+	Procedural meshes for the mesh processing tests, positions are packed
+	xyz floats (stride 3 * sizeof(float)).
+*/
+
+struct TestMesh {
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+
+	size_t vertexCount() const { return positions.size() / 3; }
+};
+
+// size x size quads in the z = 0 plane, facing +z
+inline TestMesh makeGrid(uint32_t size) {
+	TestMesh mesh;
+	for (uint32_t y = 0; y <= size; y++) {
+		for (uint32_t x = 0; x <= size; x++) {
+			mesh.positions.insert(mesh.positions.end(),
+								  {float(x), float(y), 0.0f});
+		}
+	}
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			uint32_t v = y * (size + 1) + x;
+			mesh.indices.insert(mesh.indices.end(),
+								{v, v + 1, v + size + 2, v, v + size + 2,
+								 v + size + 1});
+		}
+	}
+	return mesh;
+}
+
+// closed UV sphere of the given radius around the origin, facing outwards
+inline TestMesh makeSphere(uint32_t rings, uint32_t segments, float radius) {
+	const float PI = 3.14159265358979f;
+	TestMesh mesh;
+	mesh.positions.insert(mesh.positions.end(), {0.0f, 0.0f, radius});
+	for (uint32_t r = 1; r < rings; r++) {
+		float theta = PI * r / rings;
+		for (uint32_t s = 0; s < segments; s++) {
+			float phi = 2.0f * PI * s / segments;
+			mesh.positions.insert(mesh.positions.end(),
+								  {radius * std::sin(theta) * std::cos(phi),
+								   radius * std::sin(theta) * std::sin(phi),
+								   radius * std::cos(theta)});
+		}
+	}
+	mesh.positions.insert(mesh.positions.end(), {0.0f, 0.0f, -radius});
+
+	uint32_t south = (rings - 1) * segments + 1;
+	auto ring = [segments](uint32_t r, uint32_t s) {
+		return 1 + (r - 1) * segments + s % segments;
+	};
+	for (uint32_t s = 0; s < segments; s++) {
+		mesh.indices.insert(mesh.indices.end(),
+							{0, ring(1, s), ring(1, s + 1)});
+		mesh.indices.insert(mesh.indices.end(),
+							{south, ring(rings - 1, s + 1),
+							 ring(rings - 1, s)});
+	}
+	for (uint32_t r = 1; r + 1 < rings; r++) {
+		for (uint32_t s = 0; s < segments; s++) {
+			mesh.indices.insert(mesh.indices.end(),
+								{ring(r, s), ring(r + 1, s),
+								 ring(r + 1, s + 1), ring(r, s),
+								 ring(r + 1, s + 1), ring(r, s + 1)});
+		}
+	}
+	return mesh;
+}
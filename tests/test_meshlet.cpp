@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "meshlet.hpp"
+#include "test.hpp"
+#include "test_meshes.hpp"
+
+typedef std::array<uint32_t, 3> Triangle;
+
+static std::multiset<Triangle> triangleSet(const uint32_t *indices,
+										   size_t count) {
+	std::multiset<Triangle> triangles;
+	for (size_t i = 0; i + 2 < count; i += 3) {
+		// rotated so the smallest index comes first, keeping the winding
+		Triangle t = {indices[i], indices[i + 1], indices[i + 2]};
+		std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+		triangles.insert(t);
+	}
+	return triangles;
+}
+
+// * every triangle lands in exactly one meshlet with its winding, the
+// * meshlets tile the index buffer and respect the limits, and each
+// * bounding sphere contains its vertices
+static void testBuild(const TestMesh &mesh, uint32_t maxVertices,
+					  uint32_t maxTriangles) {
+	MeshletMesh result = buildMeshlets(
+		mesh.indices.data(), mesh.indices.size(), mesh.positions.data(),
+		3 * sizeof(float), mesh.vertexCount(), maxVertices, maxTriangles);
+
+	CHECK(result.indices.size() == mesh.indices.size());
+	CHECK(triangleSet(result.indices.data(), result.indices.size()) ==
+		  triangleSet(mesh.indices.data(), mesh.indices.size()));
+
+	uint32_t offset = 0;
+	for (const Meshlet &meshlet : result.meshlets) {
+		CHECK(meshlet.indexOffset == offset);
+		CHECK(meshlet.indexCount > 0 && meshlet.indexCount % 3 == 0);
+		CHECK(meshlet.indexCount / 3 <= maxTriangles);
+		offset += meshlet.indexCount;
+
+		std::set<uint32_t> vertices(
+			result.indices.begin() + meshlet.indexOffset,
+			result.indices.begin() + meshlet.indexOffset + meshlet.indexCount);
+		CHECK(vertices.size() == meshlet.vertexCount);
+		CHECK(meshlet.vertexCount <= maxVertices);
+
+		float farthest = 0.0f;
+		for (uint32_t v : vertices) {
+			const float *p = &mesh.positions[3 * v];
+			float d[3] = {p[0] - meshlet.center[0], p[1] - meshlet.center[1],
+						  p[2] - meshlet.center[2]};
+			farthest = std::max(farthest,
+								std::sqrt(d[0] * d[0] + d[1] * d[1] +
+										  d[2] * d[2]));
+		}
+		CHECK(farthest <= meshlet.radius * 1.0001f);
+	}
+	CHECK(offset == result.indices.size());
+}
+
+// * the cone test may keep backfacing meshlets but never cull one with a
+// * triangle facing the camera
+static void testBackfaceCulling() {
+	TestMesh sphere = makeSphere(24, 32, 1.0f);
+	MeshletMesh result = buildMeshlets(
+		sphere.indices.data(), sphere.indices.size(), sphere.positions.data(),
+		3 * sizeof(float), sphere.vertexCount(), 32, 32);
+
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> coordinate(-4.0f, 4.0f);
+	size_t culled = 0, wrong = 0;
+	for (int camera = 0; camera < 200; camera++) {
+		float eye[3] = {coordinate(random), coordinate(random),
+						coordinate(random)};
+		if (eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2] < 1.5f) {
+			continue;
+		}
+		for (const Meshlet &meshlet : result.meshlets) {
+			if (!meshletBackfacing(meshlet, eye)) {
+				continue;
+			}
+			culled++;
+			for (uint32_t i = meshlet.indexOffset;
+				 i < meshlet.indexOffset + meshlet.indexCount; i += 3) {
+				const float *a = &sphere.positions[3 * result.indices[i]];
+				const float *b = &sphere.positions[3 * result.indices[i + 1]];
+				const float *c = &sphere.positions[3 * result.indices[i + 2]];
+				float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+				float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+				float n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+							  e1[2] * e2[0] - e1[0] * e2[2],
+							  e1[0] * e2[1] - e1[1] * e2[0]};
+				float toEye = n[0] * (eye[0] - a[0]) + n[1] * (eye[1] - a[1]) +
+							  n[2] * (eye[2] - a[2]);
+				wrong += toEye > 1e-6f;
+			}
+		}
+	}
+	// the test has to cull something to mean anything
+	CHECK(culled > 0);
+	CHECK(wrong == 0);
+}
+
+// column-major perspective looking down -z, Vulkan clip space (y down,
+// depth 0..1)
+static void perspective(float fovY, float aspect, float zNear, float zFar,
+						float m[16]) {
+	std::fill(m, m + 16, 0.0f);
+	float f = 1.0f / std::tan(fovY / 2.0f);
+	m[0] = f / aspect;
+	m[5] = -f;
+	m[10] = zFar / (zNear - zFar);
+	m[11] = -1.0f;
+	m[14] = zNear * zFar / (zNear - zFar);
+}
+
+// a point passes the planes exactly when its clip coordinates are inside
+// the view volume
+static void testFrustumPlanes() {
+	float m[16];
+	perspective(1.2f, 1.5f, 0.5f, 50.0f, m);
+	float planes[6][4];
+	extractFrustumPlanes(m, planes);
+
+	std::mt19937 random(13);
+	std::uniform_real_distribution<float> coordinate(-60.0f, 60.0f);
+	size_t inside = 0, mismatches = 0;
+	for (int i = 0; i < 100000; i++) {
+		float p[3] = {coordinate(random), coordinate(random),
+					  coordinate(random)};
+		float clip[4];
+		for (int r = 0; r < 4; r++) {
+			clip[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] +
+					  m[12 + r];
+		}
+		float w = clip[3];
+		bool expected = std::fabs(clip[0]) <= w && std::fabs(clip[1]) <= w &&
+						clip[2] >= 0.0f && clip[2] <= w;
+		// points within float noise of a plane could go either way
+		float nearest = std::numeric_limits<float>::max();
+		for (int q = 0; q < 6; q++) {
+			nearest = std::min(
+				nearest, std::fabs(planes[q][0] * p[0] + planes[q][1] * p[1] +
+								   planes[q][2] * p[2] + planes[q][3]));
+		}
+		if (nearest < 1e-3f) {
+			continue;
+		}
+		inside += expected;
+		mismatches += sphereInFrustum(p, 0.0f, planes) != expected;
+	}
+	CHECK(inside > 0);
+	CHECK(mismatches == 0);
+
+	// a sphere reaching into the frustum from behind the near plane is kept
+	float behind[3] = {0.0f, 0.0f, 1.0f};
+	CHECK(!sphereInFrustum(behind, 1.0f, planes));
+	CHECK(sphereInFrustum(behind, 1.6f, planes));
+}
+
+int main() {
+	testBuild(makeGrid(40), MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+	testBuild(makeSphere(30, 40, 2.0f), MESHLET_MAX_VERTICES,
+			  MESHLET_MAX_TRIANGLES);
+	testBuild(makeSphere(12, 16, 1.0f), 16, 10);
+	testBackfaceCulling();
+	testFrustumPlanes();
+	return testResult();
+}
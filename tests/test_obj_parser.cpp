@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tinyobj/tiny_obj_loader.h"
+
+#include "job_system.hpp"
+#include "obj_parser.hpp"
+#include "test.hpp"
+
+const char *OBJ_PATH = "test_obj_parser.obj";
+
+static void writeObj(const std::string &contents) {
+	std::ofstream file(OBJ_PATH, std::ios::binary | std::ios::trunc);
+	file << contents;
+}
+
+static std::vector<tinyobj::index_t>
+allIndices(const std::vector<tinyobj::shape_t> &shapes) {
+	std::vector<tinyobj::index_t> indices;
+	for (const tinyobj::shape_t &shape : shapes) {
+		indices.insert(indices.end(), shape.mesh.indices.begin(),
+					   shape.mesh.indices.end());
+	}
+	return indices;
+}
+
+// * a file large enough to be cut into many chunks, mixing absolute and
+// * relative references, every face corner form and several objects, has
+// * to give the same attributes and indices as tinyobj::LoadObj
+static void testMatchesTinyobj() {
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+	std::string obj = "# generated\nmtllib unused.mtl\n";
+	size_t positions = 0;
+	for (int object = 0; object < 8; object++) {
+		obj += (object % 2 ? "g group" : "o object") + std::to_string(object) +
+			   "\n";
+		for (int i = 0; i < 2000; i++) {
+			char line[160];
+			std::snprintf(line, sizeof(line),
+						  "v %.6f %.6f %.6e\nvn %g %g %g\nvt %.4f %.4f\n",
+						  coordinate(random), coordinate(random),
+						  coordinate(random), coordinate(random) / 100.0f,
+						  coordinate(random) / 100.0f, 1.0f,
+						  (coordinate(random) + 100.0f) / 200.0f, 0.5f);
+			obj += line;
+			positions++;
+
+			if (i >= 3) {
+				std::uniform_int_distribution<int> pick(1, int(positions));
+				int a = pick(random), b = pick(random), c = pick(random);
+				switch (i % 4) {
+				case 0:
+					obj += "f " + std::to_string(a) + " " + std::to_string(b) +
+						   " " + std::to_string(c) + "\n";
+					break;
+				case 1:
+					obj += "f " + std::to_string(a) + "/" + std::to_string(b) +
+						   " " + std::to_string(b) + "/" + std::to_string(c) +
+						   " " + std::to_string(c) + "/" + std::to_string(a) +
+						   "\n";
+					break;
+				case 2:
+					obj += "f -1//-1 -2//-3 -4//-2\n";
+					break;
+				default:
+					obj += "f -3/-1/-2 " + std::to_string(a) + "/" +
+						   std::to_string(a) + "/" + std::to_string(a) +
+						   " -1/-2/-3\n";
+					break;
+				}
+			}
+		}
+		obj += "s 1\nusemtl unused\n";
+	}
+	writeObj(obj);
+
+	tinyobj::attrib_t expectedAttrib;
+	std::vector<tinyobj::shape_t> expectedShapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+	CHECK(tinyobj::LoadObj(&expectedAttrib, &expectedShapes, &materials,
+						   &warn, &err, OBJ_PATH, nullptr, true));
+
+	JobSystem jobs(4);
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	ObjParseStats stats;
+	CHECK(loadObjParallel(jobs, attrib, shapes, OBJ_PATH, err, stats));
+	CHECK(stats.chunks > 1);
+	CHECK(stats.bytes == obj.size());
+
+	CHECK(attrib.vertices == expectedAttrib.vertices);
+	CHECK(attrib.normals == expectedAttrib.normals);
+	CHECK(attrib.texcoords == expectedAttrib.texcoords);
+
+	std::vector<tinyobj::index_t> indices = allIndices(shapes);
+	std::vector<tinyobj::index_t> expected = allIndices(expectedShapes);
+	CHECK(indices.size() == expected.size());
+	size_t mismatches = 0;
+	for (size_t i = 0; i < std::min(indices.size(), expected.size()); i++) {
+		mismatches += indices[i].vertex_index != expected[i].vertex_index ||
+					  indices[i].normal_index != expected[i].normal_index ||
+					  indices[i].texcoord_index != expected[i].texcoord_index;
+	}
+	CHECK(mismatches == 0);
+}
+
+// polygons are split as a fan around their first corner
+static void testFan() {
+	writeObj("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv -1 1 0\n"
+			 "f 1 2 3 4 5\n");
+	JobSystem jobs(2);
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	ObjParseStats stats;
+	std::string err;
+	CHECK(loadObjParallel(jobs, attrib, shapes, OBJ_PATH, err, stats));
+
+	std::vector<tinyobj::index_t> indices = allIndices(shapes);
+	const int fan[9] = {0, 1, 2, 0, 2, 3, 0, 3, 4};
+	CHECK(indices.size() == 9);
+	for (size_t i = 0; i < indices.size() && i < 9; i++) {
+		CHECK(indices[i].vertex_index == fan[i]);
+	}
+}
+
+static void testErrors() {
+	JobSystem jobs(2);
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	ObjParseStats stats;
+	std::string err;
+
+	// a reference past the positions parsed so far
+	writeObj("v 0 0 0\nf 1 -2 1\n");
+	CHECK(!loadObjParallel(jobs, attrib, shapes, OBJ_PATH, err, stats));
+	CHECK(!err.empty());
+
+	err.clear();
+	CHECK(!loadObjParallel(jobs, attrib, shapes, "test_obj_missing.obj", err,
+						   stats));
+	CHECK(!err.empty());
+}
+
+int main() {
+	testMatchesTinyobj();
+	testFan();
+	testErrors();
+	std::remove(OBJ_PATH);
+	return testResult();
+}
@@ -0,0 +1,189 @@
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "fake_vulkan.hpp"
+#include "staging_ring.hpp"
+#include "test.hpp"
+
+const VkDeviceSize RING_SIZE = 1024;
+
+struct Staged {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	VkFence fence;
+	// signal count of the fence when it was handed out, the ring resets
+	// and reuses fences once they signaled
+	uint64_t signals;
+
+	bool finished() const {
+		return fakeVulkan().fenceSignals[fence] > signals;
+	}
+};
+
+// * allocations fill the ring front to back, wrap to the start once the
+// * end is too short and wait for the oldest submission only when nothing
+// * finished yet
+static void testWraparound(VkDevice device, DeviceAllocator &allocator) {
+	StagingRing ring;
+	ring.create(device, allocator, RING_SIZE);
+
+	VkFence fences[3];
+	VkDeviceSize offsets[3];
+	for (int i = 0; i < 3; i++) {
+		StagingAllocation allocation = ring.allocate(300);
+		offsets[i] = allocation.offset;
+		CHECK(allocation.buffer == ring.handle());
+		std::memset(allocation.data, 'a' + i, 300);
+		fences[i] = ring.submitFence();
+	}
+	CHECK(offsets[0] == 0 && offsets[1] == 304 && offsets[2] == 608);
+
+	// the end of the ring is too short and the start is still in flight
+	StagingAllocation wrapped = ring.allocate(300);
+	CHECK(wrapped.offset == 0);
+	CHECK(ring.stallCount() == 1);
+	CHECK(fenceSignaled(fences[0]) == false);
+	CHECK(fakeVulkan().fenceWaits == 1);
+	// the regions still in flight were not overwritten
+	std::memset(wrapped.data, 'z', 300);
+	const char *mapped = static_cast<const char *>(wrapped.data);
+	CHECK(mapped[304] == 'b' && mapped[907] == 'c');
+	ring.submitFence();
+
+	// finished regions are reclaimed without waiting
+	signalFence(fences[1]);
+	StagingAllocation reclaimed = ring.allocate(200);
+	CHECK(reclaimed.offset == 304);
+	CHECK(ring.stallCount() == 1);
+	ring.submitFence();
+
+	ring.destroy();
+}
+
+// * random sizes and completion order: an allocation never overlaps memory
+// * of a submission that has not finished, and the region being recorded
+// * is flushed when it fills the ring by itself
+static void testRandom(VkDevice device, DeviceAllocator &allocator) {
+	StagingRing ring;
+	ring.create(device, allocator, RING_SIZE);
+	std::vector<Staged> staged;
+	std::vector<Staged> pending;
+	uint32_t flushes = 0;
+	ring.setFlush([&]() {
+		VkFence fence = ring.submitFence();
+		for (Staged &allocation : pending) {
+			allocation.fence = fence;
+			allocation.signals = fakeVulkan().fenceSignals[fence];
+			staged.push_back(allocation);
+		}
+		pending.clear();
+		flushes++;
+	});
+
+	std::mt19937 random(17);
+	std::uniform_int_distribution<VkDeviceSize> size(1, RING_SIZE / 3);
+	std::uniform_int_distribution<int> action(0, 9);
+	size_t overlaps = 0, misaligned = 0;
+	for (int i = 0; i < 20000; i++) {
+		StagingAllocation allocation = ring.allocate(size(random));
+		misaligned += allocation.offset % STAGING_RING_ALIGNMENT != 0 ||
+					  allocation.offset + allocation.size > RING_SIZE;
+		for (const Staged &other : staged) {
+			if (!other.finished() &&
+				allocation.offset < other.offset + other.size &&
+				other.offset < allocation.offset + allocation.size) {
+				overlaps++;
+			}
+		}
+		for (const Staged &other : pending) {
+			overlaps += allocation.offset < other.offset + other.size &&
+						other.offset < allocation.offset + allocation.size;
+		}
+		pending.push_back({allocation.offset, allocation.size,
+						   VK_NULL_HANDLE, 0});
+
+		int next = action(random);
+		if (next < 4) {
+			// submit what was recorded
+			VkFence fence = ring.submitFence();
+			for (Staged &recorded : pending) {
+				recorded.fence = fence;
+				recorded.signals = fakeVulkan().fenceSignals[fence];
+				staged.push_back(recorded);
+			}
+			pending.clear();
+		}
+		// * forget what can no longer conflict, its fence may already be
+		// * reset and handed out again
+		size_t kept = 0;
+		for (const Staged &other : staged) {
+			if (!other.finished()) {
+				staged[kept++] = other;
+			}
+		}
+		staged.resize(kept);
+		if (next < 6 && !staged.empty()) {
+			// some submission finishes, not necessarily the oldest
+			std::uniform_int_distribution<size_t> pick(0, staged.size() - 1);
+			signalFence(staged[pick(random)].fence);
+		}
+	}
+	CHECK(overlaps == 0);
+	CHECK(misaligned == 0);
+	CHECK(flushes > 0);
+	CHECK(ring.stallCount() > 0);
+	ring.submitFence();
+	ring.destroy();
+}
+
+// uploads larger than the ring arrive complete and in order
+static void testStream(VkDevice device, DeviceAllocator &allocator) {
+	StagingRing ring;
+	ring.create(device, allocator, RING_SIZE);
+	ring.setFlush([&]() { ring.submitFence(); });
+
+	std::vector<char> source(5000);
+	for (size_t i = 0; i < source.size(); i++) {
+		source[i] = char(i * 7 + i / 251);
+	}
+	std::vector<char> destination(source.size(), 0);
+	VkDeviceSize expectedOffset = 0;
+	uint32_t chunks = 0;
+	ring.stream(
+		source.size(), 64,
+		[&](void *data, VkDeviceSize offset, VkDeviceSize bytes) {
+			CHECK(offset == expectedOffset);
+			CHECK(bytes <= RING_SIZE / 2);
+			std::memcpy(data, source.data() + offset, bytes);
+			expectedOffset += bytes;
+		},
+		[&](const StagingAllocation &allocation, VkDeviceSize offset) {
+			// the copy the recorded command would do
+			std::memcpy(destination.data() + offset, allocation.data,
+						allocation.size);
+			chunks++;
+		});
+	CHECK(expectedOffset == source.size());
+	CHECK(destination == source);
+	CHECK(chunks >= source.size() / (RING_SIZE / 2));
+	ring.submitFence();
+	ring.destroy();
+}
+
+int main() {
+	VkDevice device = fakeHandle<VkDevice>();
+	VkPhysicalDevice physicalDevice = fakeHandle<VkPhysicalDevice>();
+	DeviceAllocator allocator;
+	allocator.create(device, physicalDevice);
+
+	testWraparound(device, allocator);
+	testRandom(device, allocator);
+	testStream(device, allocator);
+
+	allocator.destroy();
+	CHECK(fakeVulkan().memories.empty());
+	CHECK(fakeVulkan().buffers.empty());
+	return testResult();
+}
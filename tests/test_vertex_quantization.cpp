@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+
+#include "test.hpp"
+#include "vertex_quantization.hpp"
+
+// the decodes the vertex fetch and shader.vert apply
+
+static float halfToFloat(uint16_t half) {
+	uint32_t sign = uint32_t(half & 0x8000u) << 16;
+	uint32_t exponent = (half >> 10) & 0x1fu;
+	uint32_t mantissa = half & 0x3ffu;
+	float magnitude;
+	if (exponent == 0) {
+		magnitude = std::ldexp(float(mantissa), -24);
+	} else if (exponent == 31) {
+		magnitude = mantissa ? std::numeric_limits<float>::quiet_NaN()
+							 : std::numeric_limits<float>::infinity();
+	} else {
+		magnitude = std::ldexp(float(mantissa | 0x400u), int(exponent) - 25);
+	}
+	uint32_t bits;
+	std::memcpy(&bits, &magnitude, sizeof(bits));
+	bits |= sign;
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static void decodeOctahedral(const int16_t encoded[2], float normal[3]) {
+	float x = std::max(encoded[0] / 32767.0f, -1.0f);
+	float y = std::max(encoded[1] / 32767.0f, -1.0f);
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+	float t = std::max(-z, 0.0f);
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+	float length = std::sqrt(x * x + y * y + z * z);
+	normal[0] = x / length;
+	normal[1] = y / length;
+	normal[2] = z / length;
+}
+
+static void testNormalized() {
+	CHECK(quantizeUnorm16(0.0f) == 0);
+	CHECK(quantizeUnorm16(1.0f) == 65535);
+	CHECK(quantizeUnorm16(-3.0f) == 0);
+	CHECK(quantizeUnorm16(7.0f) == 65535);
+	CHECK(quantizeSnorm16(-1.0f) == -32767);
+	CHECK(quantizeSnorm16(1.0f) == 32767);
+	CHECK(quantizeSnorm16(0.0f) == 0);
+	CHECK(quantizeSnorm16(-2.0f) == -32767);
+
+	// round to nearest, half a step is the most a value may move
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	float unormError = 0.0f, snormError = 0.0f;
+	for (int i = 0; i < 100000; i++) {
+		float u = unit(random);
+		unormError = std::max(
+			unormError, std::fabs(quantizeUnorm16(u) / 65535.0f - u));
+		float s = 2.0f * u - 1.0f;
+		snormError = std::max(
+			snormError, std::fabs(quantizeSnorm16(s) / 32767.0f - s));
+	}
+	CHECK(unormError <= 0.5f / 65535.0f + 1e-7f);
+	CHECK(snormError <= 0.5f / 32767.0f + 1e-7f);
+}
+
+static void testHalf() {
+	// every finite half converts back to itself
+	int mismatches = 0;
+	for (uint32_t h = 0; h < 0x10000u; h++) {
+		if ((h & 0x7c00u) == 0x7c00u) {
+			continue;
+		}
+		mismatches += floatToHalf(halfToFloat(uint16_t(h))) != h;
+	}
+	CHECK(mismatches == 0);
+
+	// * between two neighbouring halves the nearest wins, an exact tie goes
+	// * to the even one, including the carry into the next exponent and the
+	// * step from the largest subnormal to the smallest normal
+	mismatches = 0;
+	for (uint32_t h = 0; h < 0x7bffu; h++) {
+		float low = halfToFloat(uint16_t(h));
+		float high = halfToFloat(uint16_t(h + 1));
+		float middle = (low + high) / 2.0f;
+		uint16_t even = uint16_t(h % 2 == 0 ? h : h + 1);
+		mismatches += floatToHalf(middle) != even;
+		mismatches += floatToHalf(std::nextafter(middle, low)) != h;
+		mismatches += floatToHalf(std::nextafter(middle, high)) != h + 1;
+		mismatches += floatToHalf(-middle) != (even | 0x8000u);
+	}
+	CHECK(mismatches == 0);
+
+	const float infinity = std::numeric_limits<float>::infinity();
+	CHECK(floatToHalf(65504.0f) == 0x7bffu);
+	// halfway to the next power of two already rounds to infinity
+	CHECK(floatToHalf(65520.0f) == 0x7c00u);
+	CHECK(floatToHalf(1e10f) == 0x7c00u);
+	CHECK(floatToHalf(infinity) == 0x7c00u);
+	CHECK(floatToHalf(-infinity) == 0xfc00u);
+	uint16_t nan = floatToHalf(std::numeric_limits<float>::quiet_NaN());
+	CHECK((nan & 0x7c00u) == 0x7c00u && (nan & 0x3ffu) != 0);
+	CHECK(floatToHalf(-0.0f) == 0x8000u);
+	// below half the smallest subnormal flushes to zero
+	CHECK(floatToHalf(std::ldexp(1.0f, -26)) == 0);
+	CHECK(floatToHalf(std::ldexp(1.0f, -24)) == 1);
+}
+
+// octahedral snorm16 keeps the direction within a few thousandths of a
+// degree, both hemispheres and the folds along the axes
+static void testOctahedral() {
+	std::mt19937 random(9);
+	std::normal_distribution<float> gaussian;
+	const double PI = 3.14159265358979;
+	// degrees between the normal and its decode
+	double worst = 0.0;
+	for (int i = 0; i < 200000; i++) {
+		float n[3] = {gaussian(random), gaussian(random), gaussian(random)};
+		if (i < 6) {
+			std::fill(n, n + 3, 0.0f);
+			n[i / 2] = i % 2 ? -1.0f : 1.0f;
+		}
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (float &c : n) {
+			c /= length;
+		}
+		int16_t encoded[2];
+		encodeOctahedral(n, encoded);
+		float decoded[3];
+		decodeOctahedral(encoded, decoded);
+		// * atan2 of the cross and dot products, acos of a dot product
+		// * close to 1 would mostly measure float rounding
+		double a[3] = {n[0], n[1], n[2]};
+		double b[3] = {decoded[0], decoded[1], decoded[2]};
+		double cross[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+						   a[0] * b[1] - a[1] * b[0]};
+		double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+		double sine = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] +
+								cross[2] * cross[2]);
+		worst = std::max(worst, std::atan2(sine, dot) * 180.0 / PI);
+	}
+	CHECK(worst <= 0.005);
+
+	float zero[3] = {0.0f, 0.0f, 0.0f};
+	int16_t encoded[2];
+	encodeOctahedral(zero, encoded);
+	float decoded[3];
+	decodeOctahedral(encoded, decoded);
+	CHECK(decoded[2] == 1.0f);
+}
+
+int main() {
+	testNormalized();
+	testHalf();
+	testOctahedral();
+	return testResult();
+}